@@ -0,0 +1,42 @@
+#!/bin/sh
+# Measure the round trip of a syscall stop in each low-latency configuration.
+#
+# bench-getpid stops at every syscall, so the time of an operation under
+# GravelBox is the round trip from the tracee to the tracer thread and back.
+# Options are passed to GravelBox in every configuration, e.g.:
+#   bench/latency.sh --tracer-cpus 3
+# Build in release mode first, as `make RELEASE=1 bench-latency` does.
+
+set -e
+cd "$(dirname "$0")/.."
+BINDIR=${BINDIR:-bin}
+CONFIG=bench/config.json
+OUT=$(mktemp)
+trap 'rm -f "$OUT"' EXIT
+
+# name, options of the configuration
+CONFIGURATIONS="
+default
+low-latency --low-latency
+pin-tracees --low-latency --pin-tracees
+"
+
+# Print the value of a key=value field of a report line.
+field() {
+	echo "$1" | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+printf '%-12s %13s %9s %9s %11s\n' configuration ops/s p50 p99 p99.9
+echo "$CONFIGURATIONS" | while read -r name options; do
+	[ -n "$name" ] || continue
+	$BINDIR/gravelbox -n -c $CONFIG --stdout "$OUT" $options "$@" -- \
+		$BINDIR/bench-getpid < /dev/null
+	report=$(cat "$OUT")
+	if [ -z "$(field "$report" ops_per_sec)" ]; then
+		echo "Error: configuration $name failed" >&2
+		exit 1
+	fi
+	printf '%-12s %13s %7.2fus %7.2fus %9.2fus\n' "$name" \
+		"$(field "$report" ops_per_sec)" "$(field "$report" p50_us)" \
+		"$(field "$report" p99_us)" "$(field "$report" p999_us)"
+done
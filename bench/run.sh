@@ -0,0 +1,60 @@
+#!/bin/sh
+# Measure the tracing overhead of GravelBox on the benchmark targets.
+#
+# Each target runs natively and under GravelBox with bench/config.json, which
+# never asks, and the throughput and latency percentiles are compared.
+# Options are passed to GravelBox, e.g.:
+#   bench/run.sh --threads 4
+# Build in release mode first, as `make RELEASE=1 bench` does.
+
+set -e
+cd "$(dirname "$0")/.."
+BINDIR=${BINDIR:-bin}
+CONFIG=bench/config.json
+OUT=$(mktemp)
+trap 'rm -f "$OUT"' EXIT
+
+# name, syscalls per operation (0 if it varies), command
+BENCHMARKS="
+getpid 1 $BINDIR/bench-getpid
+open 2 $BINDIR/bench-open
+io 2 $BINDIR/bench-io 4
+fork 0 $BINDIR/bench-fork
+"
+
+# Print the value of a key=value field of a report line.
+field() {
+	echo "$1" | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+# The configuration never asks, so GravelBox needs no terminal. The report goes
+# to a file to keep it apart from the output of GravelBox.
+traced() {
+	$BINDIR/gravelbox -n -c $CONFIG --stdout "$OUT" $GRAVELBOX_ARGS -- "$@" \
+		< /dev/null
+	cat "$OUT"
+}
+
+GRAVELBOX_ARGS="$*"
+printf '%-8s %13s %13s %9s %13s %11s %11s %12s\n' benchmark native-ops/s \
+	traced-ops/s slowdown syscalls/s native-p99 traced-p99 traced-p99.9
+echo "$BENCHMARKS" | while read -r name syscalls cmd; do
+	[ -n "$name" ] || continue
+	native=$($cmd)
+	traced=$(traced $cmd)
+	native_rate=$(field "$native" ops_per_sec)
+	traced_rate=$(field "$traced" ops_per_sec)
+	if [ -z "$native_rate" ] || [ -z "$traced_rate" ]; then
+		echo "Error: benchmark $name failed" >&2
+		exit 1
+	fi
+	awk -v name="$name" -v syscalls="$syscalls" -v native="$native_rate" \
+		-v traced="$traced_rate" -v np99="$(field "$native" p99_us)" \
+		-v tp99="$(field "$traced" p99_us)" \
+		-v tp999="$(field "$traced" p999_us)" 'BEGIN {
+		rate = syscalls > 0 ? sprintf("%d", traced * syscalls) : "-"
+		slowdown = traced > 0 ? native / traced : 0
+		printf "%-8s %13d %13d %8.1fx %13s %9.2fus %9.2fus %10.2fus\n",
+			name, native, traced, slowdown, rate, np99, tp99, tp999
+	}'
+done
@@ -1,9 +1,14 @@
 #ifndef DEBUG_CONFIG_H_
 #define DEBUG_CONFIG_H_
 
+#include <parser/rendering.h>
 #include <type_traits.h>
 
+#include <chrono>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace GravelBox {
 
@@ -17,6 +22,14 @@ class DebugConfig {
 	 */
 	enum class Action { ALLOW, DENY, ASK };
 
+	/**
+	 * What to do when the user does not answer in time.
+	 */
+	struct AskTimeout {
+		std::chrono::milliseconds timeout;
+		Action action;
+	};
+
 	/**
 	 * Path of syscall definition file.
 	 *
@@ -39,16 +52,54 @@ class DebugConfig {
 	 */
 	size_t max_str_len() const noexcept { return 64; }
 
+	/**
+	 * System calls allowed without tracing.
+	 *
+	 * @return an empty list.
+	 */
+	const std::vector<uint64_t> &seccomp_allow() const noexcept {
+		static const std::vector<uint64_t> empty;
+		return empty;
+	}
+
+	/**
+	 * Syscalls allowed on files whose open was allowed.
+	 *
+	 * @return an empty list.
+	 */
+	const std::vector<std::string> &fd_inherit() const noexcept {
+		static const std::vector<std::string> empty;
+		return empty;
+	}
+
+	/**
+	 * Rules enforced with Landlock.
+	 *
+	 * @return `nullptr`, Landlock is not used.
+	 */
+	const LandlockRuleset *landlock() const noexcept { return nullptr; }
+
 	/**
 	 * Get an action for a syscall.
 	 *
-	 * @param syscall syscall string.
+	 * @param syscall the rendering of the syscall.
 	 * @return ASK
 	 */
-	Action get_action(const std::string &syscall) const noexcept {
+	Action get_action(const Rendering &syscall) const noexcept {
 		return Action::ASK;
 	}
 
+	/**
+	 * Get the timeout for asking the user about a syscall.
+	 *
+	 * @param syscall the rendering of the syscall.
+	 * @return nothing, the user is waited for.
+	 */
+	std::optional<AskTimeout> ask_timeout(const Rendering &syscall) const
+		noexcept {
+		return std::nullopt;
+	}
+
 	/**
 	 * Check if the configuration contains a password for user interactions.
 	 *
@@ -3,11 +3,19 @@
 
 #include <cassert>
 #include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <fstream>
 #include <iterator>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 
 #include <json/json.h>
 #include <openssl/err.h>
@@ -16,15 +24,16 @@
 
 namespace GravelBox {
 
-constexpr auto kRegexFlags = std::regex_constants::optimize;
 constexpr size_t kHashSize = 512 / 8;
+// one day, in seconds
+constexpr int kMaxAskTimeout = 24 * 60 * 60;
 
-[[noreturn]] inline void error(const std::string &path,
+[[noreturn]] static void error(const std::string &path,
 							   const std::string &details) {
 	throw ConfigException(path, "GravelBox configuration", details);
 }
 
-FileConfig::FileConfig(const std::string &config_path) {
+FileConfig::FileConfig(const std::string &config_path) : path_(config_path) {
 	try {
 		{
 			std::ifstream file(config_path, std::ios::binary);
@@ -35,6 +44,19 @@ FileConfig::FileConfig(const std::string &config_path) {
 						   std::istreambuf_iterator<char>());
 		}
 
+		{
+			uint8_t md[kHashSize];
+			if (EVP_Digest(config_.data(), config_.size(), md, nullptr,
+						   EVP_sha512(), nullptr)
+				!= 1)
+				error(config_path, "Cannot compute digest");
+			constexpr char kHex[] = "0123456789abcdef";
+			for (uint8_t byte : md) {
+				digest_.push_back(kHex[byte >> 4]);
+				digest_.push_back(kHex[byte & 0xf]);
+			}
+		}
+
 		Json::Value config;
 		{
 			std::istringstream iss(config_);
@@ -58,6 +80,38 @@ FileConfig::FileConfig(const std::string &config_path) {
 				error(config_path, "unknown action: \"" + s + '\"');
 		};
 
+		// an optional timeout with its fallback, on an action that asks
+		auto to_timeout = [&config_path](const Json::Value &json,
+										 Action action)
+			-> std::optional<AskTimeout> {
+			const Json::Value &seconds = json["ask-timeout"];
+			const Json::Value &fallback = json["timeout-action"];
+			if (seconds.isNull()) {
+				if (!fallback.isNull())
+					error(config_path, "timeout-action without ask-timeout");
+				return std::nullopt;
+			}
+			if (action != Action::ASK)
+				error(config_path, "ask-timeout on an action that never asks");
+			if (!seconds.isNumeric() || seconds.asDouble() <= 0
+				|| seconds.asDouble() > kMaxAskTimeout)
+				error(config_path, "ask-timeout is not between 0 and "
+									   + std::to_string(kMaxAskTimeout)
+									   + " seconds");
+			AskTimeout timeout = {
+				std::chrono::milliseconds(
+					static_cast<int64_t>(std::ceil(seconds.asDouble() * 1000))),
+				Action::DENY};
+			if (!fallback.isNull()) {
+				if (fallback.asString() == "allow")
+					timeout.action = Action::ALLOW;
+				else if (fallback.asString() != "deny")
+					error(config_path, "timeout-action is not \"allow\" or "
+									   "\"deny\"");
+			}
+			return timeout;
+		};
+
 		auto hex2bytes = [&config_path](const std::string &hex) -> std::string {
 			if (hex.size() % 2 != 0)
 				error(config_path, "invalid hex string \"" + hex + '\"');
@@ -84,18 +138,87 @@ FileConfig::FileConfig(const std::string &config_path) {
 		syscalldef_ = config["syscall-definition"].asString();
 		pinentry_ = config["pinentry"].asString();
 		max_str_len_ = config["max-string-length"].asUInt64();
+		Json::Value seccomp_allow = config["seccomp-allow"];
+		sanitize(seccomp_allow.isNull() || seccomp_allow.isArray(),
+				 "seccomp-allow is not an array");
+		for (const Json::Value &nr : seccomp_allow)
+			seccomp_allow_.push_back(nr.asUInt64());
+		Json::Value fd_inherit = config["fd-inherit"];
+		sanitize(fd_inherit.isNull() || fd_inherit.isArray(),
+				 "fd-inherit is not an array");
+		for (const Json::Value &name : fd_inherit)
+			fd_inherit_.push_back(name.asString());
 		action_default_ = to_action(config["default-action"].asString());
+		timeout_default_ = to_timeout(config, action_default_);
 		Json::Value action_groups = config["action-groups"];
 		sanitize(action_groups.isArray(), "action group is not an array");
+		auto strings = [&sanitize](const Json::Value &list,
+								   const std::string &name) {
+			sanitize(list.isNull() || list.isArray(),
+					 name + " is not an array");
+			std::vector<std::string> values;
+			for (const Json::Value &value : list)
+				values.push_back(value.asString());
+			return values;
+		};
+		Json::Value landlock = config["landlock"];
+		sanitize(landlock.isNull() || landlock.isBool(),
+				 "landlock is not a boolean");
+		auto index = std::make_shared<PatternIndex>();
+		std::vector<LandlockRuleset::Group> landlock_groups;
 		for (const Json::Value &ag : action_groups) {
 			Action action = to_action(ag["action"].asString());
-			std::vector<std::regex> patterns;
-			Json::Value patterns_json = ag["patterns"];
-			sanitize(patterns_json.isArray(), "patterns is not an array");
-			for (const Json::Value &p : patterns_json)
-				patterns.emplace_back(p.asString(), kRegexFlags);
-			action_groups_.emplace_back(action, std::move(patterns));
+			std::vector<std::string> patterns
+				= strings(ag["patterns"], "patterns");
+			std::vector<std::string> paths = strings(ag["paths"], "paths");
+			std::vector<std::string> prefixes
+				= strings(ag["prefixes"], "prefixes");
+			std::vector<std::string> networks
+				= strings(ag["networks"], "networks");
+			std::vector<std::string> ports = strings(ag["ports"], "ports");
+			std::vector<std::string> syscalls
+				= strings(ag["syscalls"], "syscalls");
+			sanitize(!patterns.empty() || !paths.empty() || !prefixes.empty()
+						 || !networks.empty(),
+					 "action group has no patterns, paths or networks");
+			sanitize(ports.empty() || !networks.empty(),
+					 "action group has ports but no networks");
+			size_t id = action_groups_.size();
+			ActionGroup &group = action_groups_.emplace_back(action);
+			group.timeout = to_timeout(ag, action);
+			for (const auto *list : {&patterns, &paths, &prefixes, &networks})
+				if (!list->empty()) {
+					size_t more = patterns.size() + paths.size()
+								  + prefixes.size() + networks.size() - 1;
+					group.summary = list->front();
+					if (more > 0)
+						group.summary += " (+" + std::to_string(more) + ')';
+					break;
+				}
+			try {
+				if (!paths.empty() || !prefixes.empty())
+					group.paths = std::make_shared<PathSet>(paths, prefixes);
+				if (!networks.empty())
+					group.networks
+						= std::make_shared<NetworkSet>(networks, ports);
+			} catch (const std::invalid_argument &ia) {
+				error(config_path, ia.what());
+			}
+			if (group.paths != nullptr || group.networks != nullptr)
+				index->add_sets(id, std::unordered_set<std::string>(
+										syscalls.begin(), syscalls.end()));
+			for (const std::string &p : patterns)
+				index->add_pattern(id, p);
+			landlock_groups.push_back({action == Action::ALLOW,
+									   action == Action::DENY,
+									   !networks.empty(), std::move(paths),
+									   std::move(prefixes)});
 		}
+		index->build();
+		if (landlock.asBool())
+			landlock_ = std::make_shared<LandlockRuleset>(
+				*index, landlock_groups, action_default_ == Action::DENY);
+		index_ = std::move(index);
 	} catch (const std::regex_error &re) {
 		error(config_path, std::string("Regex error: ") + re.what());
 	} catch (const Json::Exception &je) {
@@ -119,23 +242,99 @@ bool FileConfig::verify_signature(std::string &&key) {
 	file.seekg(0);
 	if (verify_hmac(config_, sig)) {
 		dismiss_signature();
+		verified_ = true;
 		return true;
 	}
 	return false;
 }
 
-FileConfig::Action FileConfig::get_action(const std::string &syscall) const
+std::unique_ptr<FileConfig> FileConfig::reload() const {
+	auto config = std::make_unique<FileConfig>(path_);
+	if (!verified_) {
+		config->dismiss_signature();
+		config->remove_password();
+	} else if (!config->verify_signature(std::string(key_))) {
+		return nullptr;
+	}
+	return config;
+}
+
+const FileConfig::ActionGroup *FileConfig::match(
+	const Rendering &syscall) const noexcept {
+	std::string_view str = syscall.str();
+	for (const PatternIndex::Rule &rule : index_->rules(str)) {
+		const ActionGroup &ag = action_groups_[rule.group];
+		if (rule.pattern != nullptr ? rule.pattern->matches(str)
+									: ag.matches_sets(syscall))
+			return &ag;
+	}
+	return nullptr;
+}
+
+FileConfig::Action FileConfig::get_action(const Rendering &syscall) const
 	noexcept {
-	for (const ActionGroup &ag : action_groups_)
-		for (const std::regex &r : ag.patterns)
-			if (std::regex_match(syscall.cbegin(), syscall.cend(), r,
-								 std::regex_constants::match_any))
-				return ag.action;
-	return action_default_;
+	const ActionGroup *ag = match(syscall);
+	return ag != nullptr ? ag->action : action_default_;
 }
 
-bool FileConfig::verify_hmac(const std::string &data,
-							 const std::string &mac) const noexcept {
+size_t FileConfig::rule(const Rendering &syscall) const noexcept {
+	const ActionGroup *ag = match(syscall);
+	return ag != nullptr ? ag - action_groups_.data() : action_groups_.size();
+}
+
+std::string FileConfig::describe(size_t rule) const {
+	static const char *const kActions[] = {"allow", "deny", "ask"};
+	const char *action = kActions[static_cast<int>(this->action(rule))];
+	if (rule >= action_groups_.size())
+		return std::string("default-action ") + action;
+	return "action-groups[" + std::to_string(rule) + "] " + action + ' '
+		   + action_groups_[rule].summary;
+}
+
+std::optional<FileConfig::AskTimeout> FileConfig::ask_timeout(
+	const Rendering &syscall) const noexcept {
+	const ActionGroup *ag = match(syscall);
+	return ag != nullptr ? ag->timeout : timeout_default_;
+}
+
+bool FileConfig::can_ask() const noexcept {
+	return action_default_ == Action::ASK
+		   || std::any_of(action_groups_.begin(), action_groups_.end(),
+						  [](const ActionGroup &ag) {
+							  return ag.action == Action::ASK;
+						  });
+}
+
+/**
+ * Check the path or address arguments of a syscall against a set. Allowing
+ * needs every argument in the set, e.g. both paths of a rename, while denying
+ * or asking needs any.
+ */
+template <typename Args, typename Contains>
+static bool matches(FileConfig::Action action, const Args &args,
+					Contains contains) {
+	if (args.empty())
+		return false;
+	if (action == FileConfig::Action::ALLOW)
+		return std::all_of(args.begin(), args.end(), contains);
+	return std::any_of(args.begin(), args.end(), contains);
+}
+
+bool FileConfig::ActionGroup::matches_sets(const Rendering &syscall) const
+	noexcept {
+	return (paths != nullptr
+			&& matches(action, syscall.paths(),
+					   [this](std::string_view path) {
+						   return paths->contains(path);
+					   }))
+		   || (networks != nullptr
+			   && matches(action, syscall.addresses(),
+						  [this](const SockAddr &address) {
+							  return networks->contains(address);
+						  }));
+}
+
+std::string FileConfig::sign(const std::string &data) const {
 	char md[kHashSize];
 	auto r = HMAC(EVP_sha512(), key_.data(), key_.size(),
 				  reinterpret_cast<const uint8_t *>(data.data()), data.size(),
@@ -143,9 +342,16 @@ bool FileConfig::verify_hmac(const std::string &data,
 	if (r == nullptr) {
 		// Crypto error for unknown reasons
 		ERR_print_errors_fp(stderr);
-		return false;
+		throw std::runtime_error("HMAC failed");
 	}
-	return std::string_view(md, sizeof(md)) == mac;
+	return std::string(md, sizeof(md));
+}
+
+bool FileConfig::verify_hmac(const std::string &data,
+							 const std::string &mac) const noexcept {
+	try {
+		return sign(data) == mac;
+	} catch (const std::runtime_error &) { return false; }
 }
 
 }  // namespace GravelBox
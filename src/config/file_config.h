@@ -1,11 +1,19 @@
 #ifndef FILE_CONFIG_H_
 #define FILE_CONFIG_H_
 
+#include "landlock.h"
+#include "network_set.h"
+#include "path_set.h"
+#include "pattern_index.h"
+#include <parser/rendering.h>
 #include <type_traits.h>
 
+#include <chrono>
 #include <cstdint>
-#include <regex>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace GravelBox {
 
@@ -19,6 +27,21 @@ class FileConfig {
 	 */
 	enum class Action { ALLOW, DENY, ASK };
 
+	/**
+	 * What to do when the user does not answer an asked syscall in time.
+	 */
+	struct AskTimeout {
+		/**
+		 * How long to wait for the user.
+		 */
+		std::chrono::milliseconds timeout;
+
+		/**
+		 * The fallback action, `ALLOW` or `DENY`.
+		 */
+		Action action;
+	};
+
 	/**
 	 * Construct a FileConfig from a configuration file.
 	 *
@@ -47,14 +70,97 @@ class FileConfig {
 	 */
 	size_t max_str_len() const noexcept { return max_str_len_; }
 
+	/**
+	 * Return the x86-64 system calls that are allowed without tracing.
+	 *
+	 * @return const std::vector<uint64_t>& the syscall numbers.
+	 */
+	const std::vector<uint64_t> &seccomp_allow() const noexcept {
+		return seccomp_allow_;
+	}
+
+	/**
+	 * Return the fd-based syscalls that are allowed on files whose open was
+	 * allowed.
+	 *
+	 * @return const std::vector<std::string>& the syscall names.
+	 */
+	const std::vector<std::string> &fd_inherit() const noexcept {
+		return fd_inherit_;
+	}
+
+	/**
+	 * Return the rules that the kernel enforces with Landlock.
+	 *
+	 * @return const LandlockRuleset* the ruleset, or `nullptr` if Landlock is
+	 * not enabled.
+	 */
+	const LandlockRuleset *landlock() const noexcept { return landlock_.get(); }
+
 	/**
 	 * Get an action for a syscall.
 	 *
-	 * @param syscall the string representation of the system call with
-	 * arguments.
+	 * @param syscall the rendering of the system call, with its path and
+	 * socket address arguments.
 	 * @return Action the action for this syscall.
 	 */
-	Action get_action(const std::string &syscall) const noexcept;
+	Action get_action(const Rendering &syscall) const noexcept;
+
+	/**
+	 * Get the rule that decides a syscall, like `get_action`.
+	 *
+	 * @param syscall the rendering of the system call.
+	 * @return size_t the index of the first action group that matches the
+	 * syscall, or `rules()` for the default action.
+	 */
+	size_t rule(const Rendering &syscall) const noexcept;
+
+	/**
+	 * Return the number of action groups. The default action is the rule
+	 * after the last action group.
+	 *
+	 * @return size_t the number of action groups.
+	 */
+	size_t rules() const noexcept { return action_groups_.size(); }
+
+	/**
+	 * Return the action of a rule.
+	 *
+	 * @param rule an action group index, or `rules()` for the default action.
+	 * @return Action the action.
+	 */
+	Action action(size_t rule) const noexcept {
+		return rule < action_groups_.size() ? action_groups_[rule].action
+											: action_default_;
+	}
+
+	/**
+	 * Describe a rule for a human, by its position in the configuration and
+	 * its first pattern, path or network.
+	 *
+	 * @param rule an action group index, or `rules()` for the default action.
+	 * @return std::string the description.
+	 */
+	std::string describe(size_t rule) const;
+
+	/**
+	 * Get the timeout for asking the user about a syscall, set by the action
+	 * group that matches it, or by the configuration for the default action.
+	 *
+	 * @param syscall the rendering of the system call.
+	 * @return std::optional<AskTimeout> the timeout, or nothing to wait for
+	 * the user.
+	 */
+	std::optional<AskTimeout> ask_timeout(const Rendering &syscall) const
+		noexcept;
+
+	/**
+	 * Check if a syscall may be asked, i.e. if the default action or an action
+	 * group asks.
+	 *
+	 * @return true if `get_action` may return `Action::ASK`.
+	 */
+	bool can_ask() const noexcept;
 
 	/**
 	 * Verify configuration signature. Release memory resource if the signature
@@ -67,6 +173,51 @@ class FileConfig {
 	 */
 	bool verify_signature(std::string &&key);
 
+	/**
+	 * Load the configuration file again. The new configuration is verified
+	 * with the key that verified this configuration. If the signature of this
+	 * configuration was dismissed, so is the signature of the new
+	 * configuration, along with its password.
+	 *
+	 * @return the new configuration, or `nullptr` if its signature is
+	 * invalid.
+	 * @throw ConfigException if the file is not a valid configuration.
+	 */
+	std::unique_ptr<FileConfig> reload() const;
+
+	/**
+	 * Sign data with the key that verified this configuration, e.g. to derive
+	 * the key of another signed file.
+	 *
+	 * @param data the data.
+	 * @return std::string the HMAC-SHA-512 of the data. The key is empty if
+	 * the signature was dismissed.
+	 * @throw std::runtime_error on crypto errors.
+	 */
+	std::string sign(const std::string &data) const;
+
+	/**
+	 * Return a digest of the configuration file, which changes whenever the
+	 * file does.
+	 *
+	 * @return const std::string& the SHA-512 of the file in hex.
+	 */
+	const std::string &digest() const noexcept { return digest_; }
+
+	/**
+	 * Return the path of the configuration file.
+	 *
+	 * @return const std::string& the path.
+	 */
+	const std::string &path() const noexcept { return path_; }
+
+	/**
+	 * Return the path of the signature file.
+	 *
+	 * @return const std::string& the path.
+	 */
+	const std::string &signature() const noexcept { return signature_; }
+
 	/**
 	 * Don't verify signature, release memory resource.
 	 */
@@ -112,21 +263,36 @@ class FileConfig {
   private:
 	struct ActionGroup {
 		Action action;
-		std::vector<std::regex> patterns;
-		ActionGroup(Action a, std::vector<std::regex> &&p)
-			: action(a), patterns(std::move(p)) {}
+		// shared by copies of the configuration, may be null
+		std::shared_ptr<const PathSet> paths;
+		std::shared_ptr<const NetworkSet> networks;
+		std::optional<AskTimeout> timeout;
+		// the first pattern, path or network, for `describe`
+		std::string summary;
+		explicit ActionGroup(Action a) : action(a) {}
+		bool matches_sets(const Rendering &syscall) const noexcept;
 	};
 
+	std::string path_;
 	std::string config_;
+	std::string digest_;
 	std::string signature_;
+	bool verified_ = false;
 	std::string key_;
 	std::string password_hash_;
 	std::string syscalldef_;
 	std::string pinentry_;
 	size_t max_str_len_;
+	std::vector<uint64_t> seccomp_allow_;
+	std::vector<std::string> fd_inherit_;
 	Action action_default_;
+	std::optional<AskTimeout> timeout_default_;
 	std::vector<ActionGroup> action_groups_;
+	// the patterns and sets of the action groups, shared by copies
+	std::shared_ptr<const PatternIndex> index_;
+	std::shared_ptr<const LandlockRuleset> landlock_;
 
+	const ActionGroup *match(const Rendering &syscall) const noexcept;
 	bool verify_hmac(const std::string &data, const std::string &mac) const
 		noexcept;
 };
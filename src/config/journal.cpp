@@ -0,0 +1,197 @@
+#include "journal.h"
+#include <exceptions.h>
+#include <utils.h>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <json/json.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+namespace GravelBox {
+
+constexpr size_t kHashSize = 512 / 8;
+
+[[noreturn]] static void error(const std::string &path,
+							   const std::string &details) {
+	throw ConfigException(path, "GravelBox decision journal", details);
+}
+
+/**
+ * Write a file through a temporary file, so readers never see it half
+ * written.
+ */
+static void write_file(const std::string &path, const std::string &data) {
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+		if (!file)
+			throw std::system_error(errno, std::system_category(),
+									"Cannot open \"" + tmp + '\"');
+		file.write(data.data(), data.size());
+		file.flush();
+		if (!file)
+			throw std::system_error(errno, std::system_category(),
+									"Cannot write \"" + tmp + '\"');
+	}
+	Utils::check(::rename(tmp.c_str(), path.c_str()));
+}
+
+Journal::Journal(const std::string &path, const std::string &target,
+				 const std::string &digest, std::string key)
+	: path_(path), target_(target), digest_(digest), key_(std::move(key)),
+	  others_(std::make_unique<Json::Value>(Json::objectValue)) {
+	std::string text;
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			if (errno == ENOENT)
+				return;
+			error(path, "Cannot open file \"" + path + '\"');
+		}
+		text.assign(std::istreambuf_iterator<char>(file),
+					std::istreambuf_iterator<char>());
+	}
+
+	std::string signature_path = path + ".sig";
+	std::string signature;
+	{
+		std::ifstream file(signature_path, std::ios::binary);
+		if (!file)
+			error(path, "Cannot open signature \"" + signature_path + '\"');
+		signature.assign(std::istreambuf_iterator<char>(file),
+						 std::istreambuf_iterator<char>());
+	}
+	if (signature != sign(text))
+		error(path, "Signature does not match. Remove the journal and \""
+						+ signature_path + "\" to start over.");
+
+	Json::Value journal;
+	try {
+		std::istringstream iss(text);
+		iss >> journal;
+	} catch (const Json::Exception &je) { error(path, je.what()); }
+	if (!journal.isObject())
+		error(path, "journal is not an object");
+	for (const std::string &name : journal.getMemberNames()) {
+		if (name != target_) {
+			(*others_)[name] = journal[name];
+			continue;
+		}
+		const Json::Value &section = journal[name];
+		// decisions made under another configuration are dropped
+		if (!section.isObject()
+			|| section["configuration"].asString() != digest_)
+			continue;
+		for (bool allowed : {true, false}) {
+			const Json::Value &list = section[allowed ? "allow" : "deny"];
+			if (!list.isNull() && !list.isArray())
+				error(path, "decisions are not an array");
+			for (const Json::Value &syscall : list)
+				decisions_[*syscalls_.insert(syscall.asString()).first]
+					= allowed;
+		}
+	}
+}
+
+Journal::~Journal() = default;
+
+std::optional<bool> Journal::decision(std::string_view syscall) const {
+	std::shared_lock<std::shared_mutex> lock(mutex_);
+	auto it = decisions_.find(syscall);
+	if (it == decisions_.end())
+		return std::nullopt;
+	return it->second;
+}
+
+void Journal::record(std::string_view syscall, bool allowed) noexcept {
+	std::unique_lock<std::shared_mutex> lock(mutex_);
+	try {
+		decisions_[*syscalls_.emplace(syscall).first] = allowed;
+		save();
+	} catch (const std::exception &e) {
+		std::cerr << "Decision journal not saved: " << e.what() << std::endl;
+	}
+}
+
+void Journal::save() const {
+	std::vector<std::string_view> allow, deny;
+	for (const auto &[syscall, allowed] : decisions_)
+		(allowed ? allow : deny).push_back(syscall);
+	Json::Value section(Json::objectValue);
+	section["configuration"] = digest_;
+	for (auto *list : {&allow, &deny}) {
+		std::sort(list->begin(), list->end());
+		Json::Value json(Json::arrayValue);
+		for (std::string_view syscall : *list)
+			json.append(std::string(syscall));
+		section[list == &allow ? "allow" : "deny"] = json;
+	}
+	Json::Value journal = *others_;
+	journal[target_] = section;
+
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "\t";
+	std::string text = Json::writeString(builder, journal) + '\n';
+	// a crash between the two writes leaves a mismatch, which is reported
+	// on the next load rather than trusted
+	write_file(path_, text);
+	write_file(path_ + ".sig", sign(text));
+}
+
+std::string Journal::sign(const std::string &data) const {
+	char md[kHashSize];
+	auto r = HMAC(EVP_sha512(), key_.data(), key_.size(),
+				  reinterpret_cast<const uint8_t *>(data.data()), data.size(),
+				  reinterpret_cast<uint8_t *>(md), nullptr);
+	if (r == nullptr) {
+		// Crypto error for unknown reasons
+		ERR_print_errors_fp(stderr);
+		throw std::runtime_error("HMAC failed");
+	}
+	return std::string(md, sizeof(md));
+}
+
+std::string Journal::executable(const std::string &name) {
+	auto canonical = [](const std::string &path) -> std::optional<std::string> {
+		char resolved[PATH_MAX];
+		if (::access(path.c_str(), X_OK) != 0
+			|| ::realpath(path.c_str(), resolved) == nullptr)
+			return std::nullopt;
+		return std::string(resolved);
+	};
+	if (name.find('/') != std::string::npos)
+		return canonical(name).value_or(name);
+	const char *env = ::getenv("PATH");
+	std::string dirs = env != nullptr ? env : "/usr/local/bin:/usr/bin:/bin";
+	size_t begin = 0;
+	while (begin <= dirs.size()) {
+		size_t end = std::min(dirs.find(':', begin), dirs.size());
+		std::string dir = dirs.substr(begin, end - begin);
+		if (auto path = canonical((dir.empty() ? "." : dir) + '/' + name))
+			return *path;
+		begin = end + 1;
+	}
+	return name;
+}
+
+}  // namespace GravelBox
@@ -0,0 +1,97 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Json {
+class Value;
+}
+
+namespace GravelBox {
+
+/**
+ * A journal of the decisions the user made for asked syscalls, reused by
+ * later runs of the same target.
+ *
+ * The journal file holds one section per target executable. A section is
+ * only reused with the configuration it was recorded with, so changing the
+ * configuration discards the decisions made under the old one. The journal is
+ * signed with HMAC-SHA-512 using a key derived from the configuration signing
+ * key, and is saved with its signature whenever a decision is recorded.
+ *
+ * Lookups may run concurrently from several tracer threads.
+ */
+class Journal {
+  public:
+	/**
+	 * Load the journal of a target, or start an empty one if the file does
+	 * not exist.
+	 *
+	 * @param path the path of the journal. The signature is saved to the
+	 * path with ".sig" appended.
+	 * @param target the absolute path of the target executable.
+	 * @param digest the digest of the configuration.
+	 * @param key the key to sign the journal with.
+	 * @throw ConfigException if the journal is invalid or its signature does
+	 * not match.
+	 */
+	Journal(const std::string &path, const std::string &target,
+			const std::string &digest, std::string key);
+
+	~Journal();
+
+	Journal(const Journal &) = delete;
+	Journal &operator=(const Journal &) = delete;
+
+	/**
+	 * Look up the decision recorded for a syscall.
+	 *
+	 * @param syscall the string representation of the syscall.
+	 * @return std::optional<bool> whether the syscall was allowed, or nothing
+	 * if it was never asked.
+	 */
+	std::optional<bool> decision(std::string_view syscall) const;
+
+	/**
+	 * Record a decision and save the journal. Errors are printed and
+	 * otherwise ignored, keeping the decision for this run.
+	 *
+	 * @param syscall the string representation of the syscall.
+	 * @param allowed whether the user allowed the syscall.
+	 */
+	void record(std::string_view syscall, bool allowed) noexcept;
+
+	/**
+	 * Resolve a program like `execvp` does.
+	 *
+	 * @param name the program name or path.
+	 * @return std::string the canonical path of the executable, or `name` if
+	 * it is not found.
+	 */
+	static std::string executable(const std::string &name);
+
+  private:
+	std::string path_;
+	std::string target_;
+	std::string digest_;
+	std::string key_;
+	// the sections of other targets, saved unchanged
+	std::unique_ptr<Json::Value> others_;
+	mutable std::shared_mutex mutex_;
+	// owns the syscall strings viewed by `decisions_`
+	std::unordered_set<std::string> syscalls_;
+	std::unordered_map<std::string_view, bool> decisions_;
+
+	void save() const;
+	std::string sign(const std::string &data) const;
+};
+
+}  // namespace GravelBox
+
+#endif  // JOURNAL_H_
@@ -0,0 +1,258 @@
+#include "landlock.h"
+#include <utils.h>
+
+#include <fcntl.h>
+#include <linux/landlock.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+
+namespace GravelBox {
+
+using Utils::check;
+
+constexpr uint64_t kExecute = LANDLOCK_ACCESS_FS_EXECUTE;
+constexpr uint64_t kWriteFile = LANDLOCK_ACCESS_FS_WRITE_FILE;
+constexpr uint64_t kReadFile = LANDLOCK_ACCESS_FS_READ_FILE;
+constexpr uint64_t kReadDir = LANDLOCK_ACCESS_FS_READ_DIR;
+constexpr uint64_t kRemoveDir = LANDLOCK_ACCESS_FS_REMOVE_DIR;
+constexpr uint64_t kRemoveFile = LANDLOCK_ACCESS_FS_REMOVE_FILE;
+constexpr uint64_t kMakeDir = LANDLOCK_ACCESS_FS_MAKE_DIR;
+constexpr uint64_t kMakeReg = LANDLOCK_ACCESS_FS_MAKE_REG;
+constexpr uint64_t kMakeSock = LANDLOCK_ACCESS_FS_MAKE_SOCK;
+constexpr uint64_t kMakeSym = LANDLOCK_ACCESS_FS_MAKE_SYM;
+constexpr uint64_t kMakeNode = LANDLOCK_ACCESS_FS_MAKE_CHAR | kMakeReg
+							   | kMakeSock | LANDLOCK_ACCESS_FS_MAKE_FIFO
+							   | LANDLOCK_ACCESS_FS_MAKE_BLOCK;
+constexpr uint64_t kRefer = LANDLOCK_ACCESS_FS_REFER;
+constexpr uint64_t kTruncate = LANDLOCK_ACCESS_FS_TRUNCATE;
+
+constexpr uint64_t kOpenFile = kReadFile | kWriteFile | kTruncate;
+constexpr uint64_t kOpen = kOpenFile | kReadDir | kMakeReg;
+constexpr uint64_t kExec = kExecute | kReadFile;
+constexpr uint64_t kLink = kMakeNode | kMakeDir | kMakeSym | kRefer;
+constexpr uint64_t kRename = kLink | kRemoveDir | kRemoveFile;
+// the rights that a rule on a file, rather than a directory, may grant
+constexpr uint64_t kFileRights = kExecute | kWriteFile | kReadFile | kTruncate;
+
+/**
+ * The Landlock rights of a syscall.
+ */
+struct SyscallRights {
+	const char *name;
+	uint64_t number;
+	// every right the syscall may need
+	uint64_t rights;
+	// the rights it needs on an existing file, or 0 if it needs rights on
+	// the parent directory
+	uint64_t file_rights;
+	// whether path sets apply, i.e. it has `path` or `sockaddr*` parameters
+	// in the syscall definition
+	bool paths;
+	// whether it can be left to the kernel: it has a single path, and its
+	// return is not needed by the path cache
+	bool offloadable;
+	int flags_arg;
+};
+
+// Every syscall that Landlock checks, since a handled right is denied to all
+// of them outside the rules.
+constexpr SyscallRights kSyscalls[] = {
+	{"open", SYS_open, kOpen, kOpenFile, true, true, 1},
+	{"openat", SYS_openat, kOpen, kOpenFile, true, true, 2},
+	{"creat", SYS_creat, kWriteFile | kTruncate | kMakeReg,
+	 kWriteFile | kTruncate, true, true, -1},
+	{"truncate", SYS_truncate, kTruncate, kTruncate, true, true, -1},
+	{"mkdir", SYS_mkdir, kMakeDir, 0, true, true, -1},
+	{"rmdir", SYS_rmdir, kRemoveDir, 0, true, true, -1},
+	{"unlink", SYS_unlink, kRemoveFile, 0, true, true, -1},
+	{"symlink", SYS_symlink, kMakeSym, 0, true, true, -1},
+	{"execve", SYS_execve, kExec, kExec, true, false, -1},
+	{"rename", SYS_rename, kRename, 0, true, false, -1},
+	{"link", SYS_link, kLink, 0, true, false, -1},
+	{"bind", SYS_bind, kMakeSock, 0, true, false, -1},
+	{"openat2", SYS_openat2, kOpen, 0, false, false, -1},
+	{"open_by_handle_at", SYS_open_by_handle_at, kOpen, 0, false, false, -1},
+	{"execveat", SYS_execveat, kExec, 0, false, false, -1},
+	{"uselib", SYS_uselib, kExec, 0, false, false, -1},
+	{"mkdirat", SYS_mkdirat, kMakeDir, 0, false, false, -1},
+	{"unlinkat", SYS_unlinkat, kRemoveDir | kRemoveFile, 0, false, false, -1},
+	{"symlinkat", SYS_symlinkat, kMakeSym, 0, false, false, -1},
+	{"mknod", SYS_mknod, kMakeNode, 0, false, false, -1},
+	{"mknodat", SYS_mknodat, kMakeNode, 0, false, false, -1},
+	{"renameat", SYS_renameat, kRename, 0, false, false, -1},
+	{"renameat2", SYS_renameat2, kRename, 0, false, false, -1},
+	{"linkat", SYS_linkat, kLink, 0, false, false, -1},
+};
+constexpr size_t kSyscallCount = sizeof(kSyscalls) / sizeof(kSyscalls[0]);
+// the names of syscalls that are not in the syscall definition, and of
+// 32-bit syscalls
+constexpr char kUndefined[] = "syscall";
+constexpr char kUndefined32[] = "syscall32";
+
+/**
+ * Return the rights the kernel supports, or 0 if they are not enough.
+ * Landlock always denies moving files between directories unless `REFER` is
+ * granted, which needs ABI 2.
+ */
+static uint64_t supported_rights(int abi) noexcept {
+	if (abi < 2)
+		return 0;
+	uint64_t rights = (kRefer << 1) - 1;
+	if (abi >= 3)
+		rights |= kTruncate;
+	return rights;
+}
+
+/**
+ * Check if a path exists and whether it is a directory.
+ */
+static bool exists(const std::string &path, bool directory) noexcept {
+	struct ::stat st;
+	return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode) == directory;
+}
+
+LandlockRuleset::LandlockRuleset(const PatternIndex &index,
+								 const std::vector<Group> &groups,
+								 bool default_denies) {
+	uint64_t supported = supported_rights(abi());
+	if (supported == 0)
+		return;
+
+	// path sets of "allow" groups that Landlock can express
+	std::vector<bool> expressible;
+	for (const Group &group : groups)
+		expressible.push_back(
+			group.allows && !group.networks
+			&& (!group.paths.empty() || !group.prefixes.empty())
+			&& std::all_of(group.prefixes.begin(), group.prefixes.end(),
+						   [](const std::string &p) { return exists(p, true); })
+			&& std::all_of(group.paths.begin(), group.paths.end(),
+						   [](const std::string &p) {
+							   return exists(p, false);
+						   }));
+
+	// the groups whose path sets allow each syscall, and the rights that
+	// other rules may allow, which cannot be handled
+	std::vector<std::vector<bool>> allowed(
+		kSyscallCount, std::vector<bool>(groups.size()));
+	std::vector<bool> shadowed(kSyscallCount);
+	uint64_t handled = supported;
+	for (size_t i = 0; i < kSyscallCount; i++) {
+		const SyscallRights &syscall = kSyscalls[i];
+		bool other = !default_denies;
+		bool denied = false;
+		for (const PatternIndex::Rule &rule : index.rules(syscall.name)) {
+			const Group &group = groups[rule.group];
+			if (rule.pattern == nullptr && !syscall.paths)
+				continue;
+			if (group.denies) {
+				denied = true;
+			} else if (rule.pattern == nullptr && expressible[rule.group]
+					   && (group.paths.empty() || syscall.file_rights != 0)) {
+				allowed[i][rule.group] = true;
+				shadowed[i] = shadowed[i] || denied;
+			} else {
+				other = true;
+			}
+		}
+		// 32-bit syscalls and syscalls missing from the definition are
+		// printed by number
+		std::string undefined
+			= "syscall(" + std::to_string(syscall.number) + ", ";
+		for (const char *name : {kUndefined32, kUndefined}) {
+			if (name == kUndefined && syscall.paths)
+				continue;
+			for (const PatternIndex::Rule &rule : index.rules(name)) {
+				if (rule.pattern == nullptr || groups[rule.group].denies)
+					continue;
+				const std::string &prefix = rule.pattern->prefix();
+				size_t common = std::min(prefix.size(), undefined.size());
+				if (name == kUndefined32
+					|| prefix.compare(0, common, undefined, 0, common) == 0)
+					other = true;
+			}
+		}
+		if (other)
+			handled &= ~syscall.rights;
+	}
+	if ((handled & kRefer) == 0)
+		return;
+
+	std::vector<uint64_t> granted(groups.size());
+	for (size_t i = 0; i < kSyscallCount; i++)
+		for (size_t g = 0; g < groups.size(); g++)
+			if (allowed[i][g])
+				granted[g] |= kSyscalls[i].rights & handled;
+
+	for (size_t i = 0; i < kSyscallCount; i++) {
+		const SyscallRights &syscall = kSyscalls[i];
+		uint64_t rights = syscall.rights & supported;
+		if (!syscall.offloadable || rights == 0 || (rights & ~handled) != 0
+			|| shadowed[i])
+			continue;
+		bool exact = true;
+		for (size_t g = 0; g < groups.size(); g++)
+			if ((granted[g] & rights) != 0 && !allowed[i][g])
+				exact = false;
+		if (exact)
+			syscalls_.push_back({syscall.name, syscall.flags_arg});
+	}
+	if (syscalls_.empty())
+		return;
+
+	handled_ = handled;
+	for (size_t g = 0; g < groups.size(); g++) {
+		if (granted[g] == 0)
+			continue;
+		for (const std::string &prefix : groups[g].prefixes)
+			rules_.emplace_back(prefix, granted[g]);
+		if ((granted[g] & kFileRights) != 0)
+			for (const std::string &path : groups[g].paths)
+				rules_.emplace_back(path, granted[g] & kFileRights);
+	}
+}
+
+int LandlockRuleset::abi() noexcept {
+	long version = ::syscall(SYS_landlock_create_ruleset, nullptr, 0,
+							 LANDLOCK_CREATE_RULESET_VERSION);
+	return version < 0 ? 0 : static_cast<int>(version);
+}
+
+Utils::Fd LandlockRuleset::create() const {
+	::landlock_ruleset_attr attr = {};
+	attr.handled_access_fs = handled_;
+	Utils::Fd ruleset(check(static_cast<int>(::syscall(
+		SYS_landlock_create_ruleset, &attr, sizeof(attr), 0))));
+	for (const auto &[path, rights] : rules_) {
+		int fd = ::open(path.c_str(), O_PATH | O_CLOEXEC);
+		if (fd < 0)
+			throw std::system_error(errno, std::system_category(),
+									"Cannot open \"" + path + '\"');
+		Utils::Fd file(fd);
+		::landlock_path_beneath_attr beneath = {};
+		beneath.allowed_access = rights;
+		beneath.parent_fd = file;
+		check(::syscall(SYS_landlock_add_rule, static_cast<int>(ruleset),
+						LANDLOCK_RULE_PATH_BENEATH, &beneath, 0));
+	}
+	return ruleset;
+}
+
+void LandlockRuleset::restrict_self(int ruleset) {
+	check(::syscall(SYS_landlock_restrict_self, ruleset, 0));
+}
+
+}  // namespace GravelBox
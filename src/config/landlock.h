@@ -0,0 +1,148 @@
+#ifndef LANDLOCK_H_
+#define LANDLOCK_H_
+
+#include "pattern_index.h"
+#include <utils.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace GravelBox {
+
+/**
+ * The part of a configuration that the kernel can enforce with Landlock.
+ *
+ * Landlock restricts filesystem access rights (read a file, make a directory,
+ * remove a file, ...) to the trees below some directories. A path set of an
+ * "allow" action group maps onto such rules: its prefixes become trees, and
+ * the rights are those needed by the syscalls the group allows. A syscall is
+ * offloaded to the kernel, i.e. no longer traced, if Landlock then allows it
+ * exactly where the configuration does:
+ *
+ * - every rule that may allow it is the path set of an "allow" group whose
+ *   prefixes are existing directories and whose paths are existing files,
+ * - no "deny" rule for it comes before such a group,
+ * - every group granting one of its rights allows it, and
+ * - all of its rights are handled by the ruleset.
+ *
+ * A right is only handled, i.e. denied outside the rules, if every rule that
+ * may allow a syscall needing it is such a path set. The other syscalls keep
+ * being traced, and the kernel never denies what the configuration allows
+ * them, apart from the differences listed in the README.
+ *
+ * The ruleset is immutable after construction and compared by value, so a
+ * reloaded configuration can be checked against the one the target runs
+ * under.
+ */
+class LandlockRuleset {
+  public:
+	/**
+	 * An action group, as seen by the analysis.
+	 */
+	struct Group {
+		/**
+		 * Whether the action is "allow".
+		 */
+		bool allows;
+
+		/**
+		 * Whether the action is "deny".
+		 */
+		bool denies;
+
+		/**
+		 * Whether the group has networks.
+		 */
+		bool networks;
+
+		/**
+		 * The exact paths and the prefixes of the path set.
+		 */
+		std::vector<std::string> paths, prefixes;
+	};
+
+	/**
+	 * A syscall that the kernel restricts like the configuration.
+	 */
+	struct Syscall {
+		/**
+		 * The syscall name.
+		 */
+		std::string name;
+
+		/**
+		 * The index of its open flags argument, or -1. Opens with `O_PATH`
+		 * need no access right, so they are still traced.
+		 */
+		int flags_arg;
+
+		bool operator==(const Syscall &other) const noexcept {
+			return name == other.name && flags_arg == other.flags_arg;
+		}
+	};
+
+	/**
+	 * Analyze the rules of a configuration.
+	 *
+	 * @param index the rules of the action groups.
+	 * @param groups the action groups, in configuration order.
+	 * @param default_denies whether the default action is "deny".
+	 */
+	LandlockRuleset(const PatternIndex &index, const std::vector<Group> &groups,
+					bool default_denies);
+
+	/**
+	 * Return the Landlock ABI version of the kernel.
+	 *
+	 * @return int the version, or 0 if Landlock is not available.
+	 */
+	static int abi() noexcept;
+
+	/**
+	 * Return the syscalls that the ruleset restricts like the configuration.
+	 * Nothing is enforced if empty.
+	 *
+	 * @return const std::vector<Syscall>& the syscalls.
+	 */
+	const std::vector<Syscall> &syscalls() const noexcept { return syscalls_; }
+
+	/**
+	 * Create the ruleset in the kernel. Creating it does not restrict the
+	 * calling process.
+	 *
+	 * @return Utils::Fd the close-on-exec ruleset fd.
+	 * @throw std::system_error if a path cannot be opened or a rule is
+	 * rejected.
+	 */
+	Utils::Fd create() const;
+
+	/**
+	 * Restrict the calling thread, and the programs it executes, with a
+	 * ruleset. The thread must have `no_new_privs` set.
+	 *
+	 * @param ruleset the ruleset fd from `create`.
+	 * @throw std::system_error on failure.
+	 */
+	static void restrict_self(int ruleset);
+
+	bool operator==(const LandlockRuleset &other) const noexcept {
+		return handled_ == other.handled_ && rules_ == other.rules_
+			   && syscalls_ == other.syscalls_;
+	}
+
+	bool operator!=(const LandlockRuleset &other) const noexcept {
+		return !(*this == other);
+	}
+
+  private:
+	uint64_t handled_ = 0;
+	// the trees and files, with the rights granted below them
+	std::vector<std::pair<std::string, uint64_t>> rules_;
+	std::vector<Syscall> syscalls_;
+};
+
+}  // namespace GravelBox
+
+#endif  // LANDLOCK_H_
@@ -0,0 +1,176 @@
+#include "network_set.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace GravelBox {
+
+constexpr uint8_t kInet6MappedPrefix[12]
+	= {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+/**
+ * Return a bit of an address, counting from the most significant bit.
+ */
+static inline size_t bit(const std::array<uint8_t, 16> &key,
+						 size_t i) noexcept {
+	return (key[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/**
+ * Return the number of leading bits that two addresses have in common, up to
+ * `len`.
+ */
+static size_t common_bits(const std::array<uint8_t, 16> &a,
+						  const std::array<uint8_t, 16> &b,
+						  size_t len) noexcept {
+	size_t i = 0;
+	while (i < len && bit(a, i) == bit(b, i))
+		i++;
+	return i;
+}
+
+/**
+ * Parse a non-negative decimal number no greater than `max`.
+ */
+static unsigned long parse_number(const std::string &s, unsigned long max,
+								  const std::string &what) {
+	size_t end = 0;
+	unsigned long n = 0;
+	try {
+		if (s.empty() || s[0] == '-' || s[0] == '+')
+			throw std::invalid_argument(s);
+		n = std::stoul(s, &end);
+	} catch (const std::logic_error &) { end = 0; }
+	if (end == 0 || end != s.size() || n > max)
+		throw std::invalid_argument("invalid " + what + " \"" + s + '\"');
+	return n;
+}
+
+NetworkSet::NetworkSet(const std::vector<std::string> &networks,
+					   const std::vector<std::string> &ports) {
+	for (const std::string &network : networks) {
+		size_t slash = network.find('/');
+		std::string ip = network.substr(0, slash);
+		Address key{};
+		bool v6 = ip.find(':') != std::string::npos;
+		if (::inet_pton(v6 ? AF_INET6 : AF_INET, ip.c_str(), key.data()) != 1)
+			throw std::invalid_argument("invalid network \"" + network + '\"');
+		size_t max = v6 ? 128 : 32;
+		size_t len = slash == std::string::npos
+						 ? max
+						 : parse_number(network.substr(slash + 1), max,
+										"network \"" + network
+											+ "\" prefix length");
+		insert(v6 ? inet6_ : inet_, key, len);
+	}
+
+	for (const std::string &range : ports) {
+		size_t dash = range.find('-');
+		auto low = static_cast<uint16_t>(
+			parse_number(range.substr(0, dash), 65535, "port"));
+		auto high = dash == std::string::npos
+						? low
+						: static_cast<uint16_t>(parse_number(
+							range.substr(dash + 1), 65535, "port"));
+		if (low > high)
+			throw std::invalid_argument("invalid port range \"" + range
+										+ '\"');
+		ports_.emplace_back(low, high);
+	}
+	// merge overlapping ranges, so a lookup is a binary search
+	std::sort(ports_.begin(), ports_.end());
+	std::vector<std::pair<uint16_t, uint16_t>> merged;
+	for (const auto &range : ports_) {
+		if (!merged.empty() && range.first <= merged.back().second)
+			merged.back().second = std::max(merged.back().second, range.second);
+		else
+			merged.push_back(range);
+	}
+	ports_ = std::move(merged);
+}
+
+void NetworkSet::insert(Node &root, const Address &key, size_t len) {
+	Node *node = &root;
+	while (!node->covered) {
+		if (node->len == len) {
+			node->covered = true;
+			// everything below is covered by this network
+			node->children[0].reset();
+			node->children[1].reset();
+			return;
+		}
+		std::unique_ptr<Node> &child = node->children[bit(key, node->len)];
+		if (child == nullptr) {
+			child = std::make_unique<Node>();
+			child->key = key;
+			child->len = len;
+			child->covered = true;
+			return;
+		}
+		size_t common = common_bits(key, child->key, std::min(len, child->len));
+		if (common < child->len) {
+			// split the edge after the common bits
+			auto upper = std::make_unique<Node>();
+			upper->key = key;
+			upper->len = common;
+			size_t lower_bit = bit(child->key, common);
+			upper->children[lower_bit] = std::move(child);
+			child = std::move(upper);
+		}
+		node = child.get();
+	}
+}
+
+bool NetworkSet::covers(const Node &root, const Address &key) noexcept {
+	const Node *node = &root;
+	while (!node->covered) {
+		if (node->len == 128)
+			return false;
+		const Node *child = node->children[bit(key, node->len)].get();
+		if (child == nullptr
+			|| common_bits(key, child->key, child->len) < child->len)
+			return false;
+		node = child;
+	}
+	return true;
+}
+
+bool NetworkSet::has_port(uint16_t port) const noexcept {
+	if (ports_.empty())
+		return true;
+	auto it = std::upper_bound(
+		ports_.begin(), ports_.end(), port,
+		[](uint16_t p, const std::pair<uint16_t, uint16_t> &range) {
+			return p < range.first;
+		});
+	return it != ports_.begin() && port <= std::prev(it)->second;
+}
+
+bool NetworkSet::contains(const SockAddr &address) const noexcept {
+	if (!has_port(address.port))
+		return false;
+	if (address.family == AF_INET)
+		return covers(inet_, address.addr);
+	if (address.family != AF_INET6)
+		return false;
+	if (std::memcmp(address.addr.data(), kInet6MappedPrefix,
+					sizeof(kInet6MappedPrefix))
+		== 0) {
+		Address inet{};
+		std::memcpy(inet.data(), address.addr.data() + 12, 4);
+		if (covers(inet_, inet))
+			return true;
+	}
+	return covers(inet6_, address.addr);
+}
+
+}  // namespace GravelBox
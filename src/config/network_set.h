@@ -0,0 +1,78 @@
+#ifndef NETWORK_SET_H_
+#define NETWORK_SET_H_
+
+#include <parser/rendering.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace GravelBox {
+
+/**
+ * A set of IPv4 and IPv6 socket addresses, given as CIDR networks and port
+ * ranges.
+ *
+ * Networks are stored in one radix tree per address family, which is a
+ * binary trie where chains of single-child nodes are compressed into one
+ * edge. A lookup costs O(address length) regardless of the number of
+ * networks. IPv4-mapped IPv6 addresses (`::ffff:a.b.c.d`) are looked up as
+ * IPv4 addresses. A `NetworkSet` is immutable after construction, so lookups
+ * are thread-safe.
+ */
+class NetworkSet {
+  public:
+	/**
+	 * Construct a NetworkSet.
+	 *
+	 * @param networks the networks, e.g. "10.0.0.0/8", "::1" or
+	 * "2001:db8::/32". Host bits are ignored.
+	 * @param ports the port ranges, e.g. "443" or "8000-8999". All ports if
+	 * empty.
+	 * @throw std::invalid_argument if a network or port range is invalid.
+	 */
+	NetworkSet(const std::vector<std::string> &networks,
+			   const std::vector<std::string> &ports);
+
+	NetworkSet(const NetworkSet &) = delete;
+	NetworkSet &operator=(const NetworkSet &) = delete;
+
+	/**
+	 * Check if a socket address is in the set.
+	 *
+	 * @param address the address.
+	 * @return true if the address is in one of the networks and its port is
+	 * in one of the port ranges.
+	 */
+	bool contains(const SockAddr &address) const noexcept;
+
+  private:
+	using Address = std::array<uint8_t, 16>;
+
+	/**
+	 * A radix tree node, holding the first `len` bits of `key`.
+	 */
+	struct Node {
+		Address key{};
+		size_t len = 0;
+		// a network ends here
+		bool covered = false;
+		std::unique_ptr<Node> children[2];
+	};
+
+	Node inet_;
+	Node inet6_;
+	// sorted and disjoint
+	std::vector<std::pair<uint16_t, uint16_t>> ports_;
+
+	static void insert(Node &root, const Address &key, size_t len);
+	static bool covers(const Node &root, const Address &key) noexcept;
+	bool has_port(uint16_t port) const noexcept;
+};
+
+}  // namespace GravelBox
+
+#endif  // NETWORK_SET_H_
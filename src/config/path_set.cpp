@@ -0,0 +1,180 @@
+#include "path_set.h"
+
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace GravelBox {
+
+// about 1% false positives
+constexpr size_t kBloomBitsPerPath = 10;
+constexpr size_t kBloomHashes = 7;
+
+/**
+ * Split an absolute path into components, skipping empty and "." components.
+ */
+static std::vector<std::string_view> split(std::string_view path) {
+	if (path.empty() || path.front() != '/')
+		throw std::invalid_argument("path \"" + std::string(path)
+									+ "\" is not absolute");
+	std::vector<std::string_view> components;
+	std::string_view rest = path;
+	while (!rest.empty()) {
+		size_t end = rest.find('/');
+		std::string_view component = rest.substr(0, end);
+		rest.remove_prefix(end == std::string_view::npos ? rest.size()
+														 : end + 1);
+		if (component.empty() || component == ".")
+			continue;
+		if (component == "..")
+			throw std::invalid_argument("path \"" + std::string(path)
+										+ "\" contains \"..\"");
+		components.push_back(component);
+	}
+	return components;
+}
+
+/**
+ * Two independent hashes of a path for double hashing. The second hash is
+ * odd, so the probes cover the whole filter.
+ */
+static std::pair<uint64_t, uint64_t> hash(std::string_view path) noexcept {
+	uint64_t fnv = 0xcbf29ce484222325;
+	for (char c : path) {
+		fnv ^= static_cast<uint8_t>(c);
+		fnv *= 0x100000001b3;
+	}
+	return {std::hash<std::string_view>()(path), fnv | 1};
+}
+
+PathSet::BloomFilter::BloomFilter(size_t size) {
+	size_t bits = 64;
+	while (bits < size * kBloomBitsPerPath)
+		bits *= 2;
+	bits_.resize(bits / 64);
+	mask_ = bits - 1;
+}
+
+void PathSet::BloomFilter::add(std::string_view path) noexcept {
+	auto [h1, h2] = hash(path);
+	for (size_t i = 0; i < kBloomHashes; i++) {
+		uint64_t bit = (h1 + i * h2) & mask_;
+		bits_[bit / 64] |= uint64_t(1) << (bit % 64);
+	}
+}
+
+bool PathSet::BloomFilter::may_contain(std::string_view path) const noexcept {
+	auto [h1, h2] = hash(path);
+	for (size_t i = 0; i < kBloomHashes; i++) {
+		uint64_t bit = (h1 + i * h2) & mask_;
+		if ((bits_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+			return false;
+	}
+	return true;
+}
+
+PathSet::PathSet(const std::vector<std::string> &paths,
+				 const std::vector<std::string> &prefixes)
+	: bloom_(paths.size()) {
+	paths_.reserve(paths.size());
+	for (const std::string &path : paths) {
+		std::string normalized;
+		for (std::string_view component : split(path)) {
+			normalized.push_back('/');
+			normalized.append(component);
+		}
+		paths_.push_back(normalized.empty() ? "/" : std::move(normalized));
+	}
+	for (const std::string &path : paths_) {
+		exact_.insert(path);
+		bloom_.add(path);
+	}
+	for (const std::string &prefix : prefixes)
+		add_prefix(split(prefix));
+}
+
+void PathSet::add_prefix(const std::vector<std::string_view> &components) {
+	Node *node = &root_;
+	size_t i = 0;
+	while (i < components.size() && !node->covered) {
+		auto it = node->children.find(components[i]);
+		if (it == node->children.end()) {
+			auto child = std::make_unique<Node>();
+			child->first = components[i];
+			child->rest.assign(components.begin() + i + 1, components.end());
+			child->covered = true;
+			std::string_view key = child->first;
+			node->children.emplace(key, std::move(child));
+			return;
+		}
+		Node *child = it->second.get();
+		i++;
+		size_t j = 0;
+		while (j < child->rest.size() && i < components.size()
+			   && child->rest[j] == components[i]) {
+			i++;
+			j++;
+		}
+		if (j < child->rest.size()) {
+			// split the edge after the common components; the key views into
+			// the child, so remove it before changing the label
+			std::unique_ptr<Node> lower = std::move(it->second);
+			node->children.erase(it);
+			auto upper = std::make_unique<Node>();
+			upper->first = std::move(lower->first);
+			upper->rest.assign(std::make_move_iterator(lower->rest.begin()),
+							   std::make_move_iterator(lower->rest.begin() + j));
+			lower->first = std::move(lower->rest[j]);
+			lower->rest.erase(lower->rest.begin(), lower->rest.begin() + j + 1);
+			std::string_view lower_key = lower->first;
+			upper->children.emplace(lower_key, std::move(lower));
+			child = upper.get();
+			std::string_view upper_key = upper->first;
+			node->children.emplace(upper_key, std::move(upper));
+		}
+		node = child;
+	}
+	node->covered = true;
+	// everything below is covered by this prefix
+	node->children.clear();
+}
+
+bool PathSet::contains(std::string_view path) const noexcept {
+	if (!exact_.empty() && bloom_.may_contain(path) && exact_.count(path) > 0)
+		return true;
+
+	std::string_view rest = path;
+	auto next = [&rest](std::string_view &component) {
+		while (!rest.empty() && rest.front() == '/')
+			rest.remove_prefix(1);
+		if (rest.empty())
+			return false;
+		size_t end = rest.find('/');
+		component = rest.substr(0, end);
+		rest.remove_prefix(component.size());
+		return true;
+	};
+
+	const Node *node = &root_;
+	std::string_view component;
+	while (!node->covered) {
+		if (!next(component))
+			return false;
+		auto it = node->children.find(component);
+		if (it == node->children.end())
+			return false;
+		node = it->second.get();
+		for (const std::string &label : node->rest)
+			if (!next(component) || component != label)
+				return false;
+	}
+	return true;
+}
+
+}  // namespace GravelBox
@@ -0,0 +1,92 @@
+#ifndef PATH_SET_H_
+#define PATH_SET_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace GravelBox {
+
+/**
+ * A set of absolute paths, given as exact paths and as prefixes that cover a
+ * directory and everything below it.
+ *
+ * Prefixes are stored in a prefix trie over path components, where chains of
+ * single-child nodes are compressed into one edge. Exact paths are stored in a
+ * hash set behind a Bloom filter, so most paths that are not in the set never
+ * probe the hash set. A lookup costs O(path length) regardless of the set
+ * size.
+ *
+ * Paths are matched by components, so the prefix "/home/user" covers
+ * "/home/user/notes.txt" but not "/home/username". A `PathSet` is immutable
+ * after construction, so lookups are thread-safe.
+ */
+class PathSet {
+  public:
+	/**
+	 * Construct a PathSet.
+	 *
+	 * @param paths the exact paths.
+	 * @param prefixes the prefixes.
+	 * @throw std::invalid_argument if a path is relative or contains "..".
+	 */
+	PathSet(const std::vector<std::string> &paths,
+			const std::vector<std::string> &prefixes);
+
+	PathSet(const PathSet &) = delete;
+	PathSet &operator=(const PathSet &) = delete;
+
+	/**
+	 * Check if a path is in the set.
+	 *
+	 * @param path an absolute path without empty, "." and ".." components, as
+	 * printed by the parser.
+	 * @return true if the path is one of the exact paths, or is covered by one
+	 * of the prefixes.
+	 */
+	bool contains(std::string_view path) const noexcept;
+
+  private:
+	/**
+	 * A trie node, and the edge from its parent.
+	 * The edge is labeled with `first` followed by `rest`.
+	 */
+	struct Node {
+		std::string first;
+		std::vector<std::string> rest;
+		// a prefix ends here
+		bool covered = false;
+		// keyed by the `first` component of the child
+		std::unordered_map<std::string_view, std::unique_ptr<Node>> children;
+	};
+
+	/**
+	 * A Bloom filter over the exact paths.
+	 */
+	class BloomFilter {
+	  public:
+		explicit BloomFilter(size_t size);
+		void add(std::string_view path) noexcept;
+		bool may_contain(std::string_view path) const noexcept;
+
+	  private:
+		std::vector<uint64_t> bits_;
+		uint64_t mask_;
+	};
+
+	Node root_;
+	// `exact_` views into `paths_`
+	std::vector<std::string> paths_;
+	std::unordered_set<std::string_view> exact_;
+	BloomFilter bloom_;
+
+	void add_prefix(const std::vector<std::string_view> &components);
+};
+
+}  // namespace GravelBox
+
+#endif  // PATH_SET_H_
@@ -0,0 +1,186 @@
+#include "pattern_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace GravelBox {
+
+constexpr auto kRegexFlags = std::regex_constants::optimize;
+
+/**
+ * Return the end of the bracket expression starting at `i`.
+ */
+static size_t skip_bracket(const std::string &p, size_t i) {
+	// unlike POSIX, a leading ']' ends an ECMAScript bracket expression
+	for (i++; i < p.size() && p[i] != ']'; i++)
+		if (p[i] == '\\')
+			i++;
+	return std::min(i + 1, p.size());
+}
+
+/**
+ * Return the end of the group or bracket expression starting at `i`.
+ */
+static size_t skip_nested(const std::string &p, size_t i) {
+	if (p[i] == '[')
+		return skip_bracket(p, i);
+	size_t depth = 0;
+	while (i < p.size()) {
+		if (p[i] == '\\') {
+			i += 2;
+		} else if (p[i] == '[') {
+			i = skip_bracket(p, i);
+		} else {
+			if (p[i] == '(')
+				depth++;
+			else if (p[i] == ')' && --depth == 0)
+				return i + 1;
+			i++;
+		}
+	}
+	return p.size();
+}
+
+/**
+ * Extract the literal prefix and the literal substrings of a regex that every
+ * match contains. Only the top level is analyzed; groups, bracket expressions
+ * and character classes end a literal run. Nothing is extracted if there is a
+ * top-level alternation, or an escape that is not understood.
+ */
+static void extract_literals(const std::string &p, std::string &prefix,
+							 std::vector<std::string> &substrings) {
+	for (size_t i = 0; i < p.size(); i++) {
+		if (p[i] == '\\')
+			i++;
+		else if (p[i] == '(' || p[i] == '[')
+			i = skip_nested(p, i) - 1;
+		else if (p[i] == '|')
+			return;
+	}
+
+	std::string run;
+	bool at_start = true;
+	auto flush = [&]() {
+		if (at_start)
+			prefix = run;
+		else if (!run.empty())
+			substrings.push_back(run);
+		run.clear();
+		at_start = false;
+	};
+
+	size_t i = 0;
+	while (i < p.size()) {
+		bool literal = true;
+		char c = p[i];
+		size_t next = i + 1;
+		if (c == '\\') {
+			if (next == p.size())
+				break;
+			c = p[next++];
+			if (std::isalnum(static_cast<unsigned char>(c))) {
+				if (std::strchr("dDwWsSbB", c) == nullptr)
+					break;
+				literal = false;
+			}
+		} else if (c == '(' || c == '[') {
+			next = skip_nested(p, i);
+			literal = false;
+		} else if (std::strchr(".^$*+?{|)", c) != nullptr) {
+			literal = false;
+		}
+
+		// a quantified literal may be absent, or repeated
+		bool required = true;
+		if (next < p.size() && std::strchr("*+?{", p[next]) != nullptr) {
+			required = p[next] == '+'
+					   || (p[next] == '{' && next + 1 < p.size()
+						   && p[next + 1] >= '1' && p[next + 1] <= '9');
+			next = p[next] == '{' ? p.find('}', next) : next;
+			next = next == std::string::npos ? p.size() : next + 1;
+			if (next < p.size() && p[next] == '?')
+				next++;
+			// a repeated quantifier may repeat zero times
+			if (next < p.size() && std::strchr("*+?{", p[next]) != nullptr)
+				break;
+			if (literal && required)
+				run.push_back(c);
+			literal = false;
+		}
+		if (literal)
+			run.push_back(c);
+		else
+			flush();
+		i = next;
+	}
+	flush();
+}
+
+PatternIndex::Pattern::Pattern(const std::string &pattern)
+	: regex_(pattern, kRegexFlags) {
+	extract_literals(pattern, prefix_, substrings_);
+	size_t paren = prefix_.find('(');
+	if (paren != std::string::npos && paren > 0) {
+		name_ = prefix_.substr(0, paren);
+		for (char c : name_)
+			if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+				name_.clear();
+	}
+}
+
+bool PatternIndex::Pattern::matches(std::string_view syscall) const noexcept {
+	if (syscall.compare(0, prefix_.size(), prefix_) != 0)
+		return false;
+	for (const std::string &s : substrings_)
+		if (::memmem(syscall.data(), syscall.size(), s.data(), s.size())
+			== nullptr)
+			return false;
+	return std::regex_match(syscall.begin(), syscall.end(), regex_,
+							std::regex_constants::match_any);
+}
+
+void PatternIndex::add_pattern(size_t group, const std::string &pattern) {
+	const Pattern *p = patterns_.emplace_back(std::make_unique<Pattern>(pattern))
+						   .get();
+	Entry &entry = entries_.emplace_back(Entry{{group, p}, {}});
+	if (!p->name().empty())
+		entry.names.insert(p->name());
+}
+
+void PatternIndex::add_sets(size_t group,
+							const std::unordered_set<std::string> &syscalls) {
+	entries_.push_back(Entry{{group, nullptr}, syscalls});
+}
+
+void PatternIndex::build() {
+	by_name_.clear();
+	any_.clear();
+	for (const Entry &entry : entries_)
+		for (const std::string &name : entry.names)
+			by_name_.emplace(name, std::vector<Rule>());
+	for (const Entry &entry : entries_) {
+		if (entry.names.empty()) {
+			any_.push_back(entry.rule);
+			for (auto &[name, rules] : by_name_)
+				rules.push_back(entry.rule);
+		} else {
+			for (const std::string &name : entry.names)
+				by_name_[name].push_back(entry.rule);
+		}
+	}
+}
+
+const std::vector<PatternIndex::Rule> &PatternIndex::rules(
+	std::string_view syscall) const noexcept {
+	auto it = by_name_.find(syscall.substr(0, syscall.find('(')));
+	return it == by_name_.end() ? any_ : it->second;
+}
+
+}  // namespace GravelBox
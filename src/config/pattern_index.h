@@ -0,0 +1,144 @@
+#ifndef PATTERN_INDEX_H_
+#define PATTERN_INDEX_H_
+
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace GravelBox {
+
+/**
+ * The rules of the action groups of a configuration, indexed by syscall name.
+ *
+ * A rule is either a pattern, or the path and network sets of a group.
+ * Patterns that start with a literal syscall name followed by `\(`, e.g.
+ * `openat\(.*\)`, and sets restricted to some syscalls only apply to those
+ * syscalls; the other rules apply to all. Looking up a syscall returns the
+ * rules that may match it in configuration order, so the first matching rule
+ * still wins.
+ *
+ * Before running its regex, a pattern checks its literal prefix and the
+ * literal substrings that every match contains, so most syscalls are rejected
+ * without running the regex. A `PatternIndex` is immutable after `build`, so
+ * lookups are thread-safe.
+ */
+class PatternIndex {
+  public:
+	/**
+	 * A compiled pattern and its required literals.
+	 */
+	class Pattern {
+	  public:
+		/**
+		 * Compile a pattern.
+		 *
+		 * @param pattern the ECMAScript regex, which must match a whole
+		 * syscall.
+		 * @throw std::regex_error if the regex is invalid.
+		 */
+		explicit Pattern(const std::string &pattern);
+
+		/**
+		 * Check if the pattern matches a syscall.
+		 *
+		 * @param syscall the string representation of the syscall.
+		 * @return true if the regex matches the whole syscall.
+		 */
+		bool matches(std::string_view syscall) const noexcept;
+
+		/**
+		 * Return the literal text that every match starts with.
+		 *
+		 * @return const std::string& the prefix, e.g. "openat(".
+		 */
+		const std::string &prefix() const noexcept { return prefix_; }
+
+		/**
+		 * Return the syscall name the pattern is restricted to.
+		 *
+		 * @return const std::string& the name, or empty if the pattern may
+		 * match any syscall.
+		 */
+		const std::string &name() const noexcept { return name_; }
+
+	  private:
+		std::regex regex_;
+		// every match starts with the prefix and contains the substrings
+		std::string prefix_;
+		std::vector<std::string> substrings_;
+		std::string name_;
+	};
+
+	/**
+	 * A rule of an action group.
+	 */
+	struct Rule {
+		/**
+		 * The index of the action group.
+		 */
+		size_t group;
+
+		/**
+		 * The pattern, or `nullptr` for the path and network sets of the
+		 * group.
+		 */
+		const Pattern *pattern;
+	};
+
+	PatternIndex() = default;
+	PatternIndex(const PatternIndex &) = delete;
+	PatternIndex &operator=(const PatternIndex &) = delete;
+
+	/**
+	 * Add a pattern of an action group. Rules must be added in configuration
+	 * order.
+	 *
+	 * @param group the index of the action group.
+	 * @param pattern the regex.
+	 * @throw std::regex_error if the regex is invalid.
+	 */
+	void add_pattern(size_t group, const std::string &pattern);
+
+	/**
+	 * Add the path and network sets of an action group. Rules must be added
+	 * in configuration order.
+	 *
+	 * @param group the index of the action group.
+	 * @param syscalls the syscall names the sets apply to, or empty for all.
+	 */
+	void add_sets(size_t group, const std::unordered_set<std::string> &syscalls);
+
+	/**
+	 * Build the index once all rules are added.
+	 */
+	void build();
+
+	/**
+	 * Return the rules that may match a syscall.
+	 *
+	 * @param syscall the string representation of the syscall.
+	 * @return const std::vector<Rule>& the rules in configuration order.
+	 */
+	const std::vector<Rule> &rules(std::string_view syscall) const noexcept;
+
+  private:
+	struct Entry {
+		Rule rule;
+		// syscall names the rule applies to, or empty for all
+		std::unordered_set<std::string> names;
+	};
+
+	std::vector<std::unique_ptr<Pattern>> patterns_;
+	std::vector<Entry> entries_;
+	// keys view into the names of the entries
+	std::unordered_map<std::string_view, std::vector<Rule>> by_name_;
+	std::vector<Rule> any_;
+};
+
+}  // namespace GravelBox
+
+#endif  // PATTERN_INDEX_H_
@@ -0,0 +1,142 @@
+#include "reloading_config.h"
+#include <exceptions.h>
+#include <utils.h>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+
+namespace GravelBox {
+
+// the signature is usually written right after the configuration
+constexpr int kSettleMs = 200;
+
+ReloadingConfig::Stamp::Stamp(const std::string &path) noexcept {
+	struct ::stat st;
+	if (::stat(path.c_str(), &st) < 0)
+		return;
+	dev = st.st_dev;
+	ino = st.st_ino;
+	mtime_ns = st.st_mtim.tv_sec * int64_t(1000000000) + st.st_mtim.tv_nsec;
+	size = st.st_size;
+}
+
+bool ReloadingConfig::Stamp::operator==(const Stamp &other) const noexcept {
+	return dev == other.dev && ino == other.ino && mtime_ns == other.mtime_ns
+		   && size == other.size;
+}
+
+ReloadingConfig::ReloadingConfig(std::unique_ptr<FileConfig> config)
+	: initial_(std::move(config)), current_(initial_),
+	  config_stamp_(initial_->path()),
+	  signature_stamp_(initial_->signature()) {}
+
+ReloadingConfig::~ReloadingConfig() {
+	if (watcher_.joinable()) {
+		uint64_t one = 1;
+		Utils::check(::write(stop_, &one, sizeof(one)));
+		watcher_.join();
+	}
+}
+
+void ReloadingConfig::watch() {
+	assert(!watcher_.joinable());
+	inotify_
+		= Utils::Fd(Utils::check(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)));
+	for (const std::string &path : {initial_->path(), initial_->signature()}) {
+		size_t slash = path.rfind('/');
+		std::string dir = slash == std::string::npos ? "."
+						  : slash == 0				 ? "/"
+													 : path.substr(0, slash);
+		// watch the directory, since editors replace files by renaming
+		int wd = Utils::check(::inotify_add_watch(
+			inotify_, dir.c_str(),
+			IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR));
+		watches_.emplace_back(wd, path.substr(slash + 1));
+	}
+	stop_ = Utils::Fd(Utils::check(::eventfd(0, EFD_CLOEXEC)));
+	reload_if_changed();
+	watcher_ = std::thread(&ReloadingConfig::watch_files, this);
+}
+
+void ReloadingConfig::watch_files() noexcept {
+	::pollfd fds[] = {{inotify_, POLLIN, 0}, {stop_, POLLIN, 0}};
+	bool changed = false;
+	while (true) {
+		int ready = ::poll(fds, 2, changed ? kSettleMs : -1);
+		if (ready < 0 && errno != EINTR)
+			return;
+		if (fds[1].revents != 0)
+			return;
+		if (ready > 0) {
+			changed |= read_events();
+		} else if (ready == 0) {
+			changed = false;
+			reload_if_changed();
+		}
+	}
+}
+
+bool ReloadingConfig::read_events() noexcept {
+	alignas(::inotify_event) char buf[4096];
+	bool relevant = false;
+	ssize_t len;
+	while ((len = ::read(inotify_, buf, sizeof(buf))) > 0) {
+		for (ssize_t i = 0; i < len;) {
+			auto event = reinterpret_cast<const ::inotify_event *>(buf + i);
+			i += sizeof(::inotify_event) + event->len;
+			if (event->len == 0)
+				continue;
+			for (const auto &[wd, name] : watches_)
+				if (event->wd == wd && name == event->name)
+					relevant = true;
+		}
+	}
+	return relevant;
+}
+
+void ReloadingConfig::reload_if_changed() noexcept {
+	Stamp config_stamp(initial_->path());
+	Stamp signature_stamp(initial_->signature());
+	if (config_stamp == config_stamp_ && signature_stamp == signature_stamp_)
+		return;
+	// a failed reload is retried on the next change of either file
+	config_stamp_ = config_stamp;
+	signature_stamp_ = signature_stamp;
+	try {
+		std::shared_ptr<const FileConfig> config = current()->reload();
+		if (config == nullptr) {
+			std::cerr << "Configuration not reloaded: incorrect signature"
+					  << std::endl;
+			return;
+		}
+		const LandlockRuleset *landlock = initial_->landlock();
+		if (landlock != nullptr && !landlock->syscalls().empty()
+			&& (config->landlock() == nullptr
+				|| *config->landlock() != *landlock)) {
+			std::cerr << "Configuration not reloaded: the rules enforced by "
+						 "Landlock changed"
+					  << std::endl;
+			return;
+		}
+		std::atomic_store(&current_, std::move(config));
+		std::cerr << "Configuration reloaded" << std::endl;
+	} catch (const ConfigException &ce) {
+		std::cerr << "Configuration not reloaded: " << ce.what() << std::endl;
+	} catch (const std::system_error &se) {
+		std::cerr << "Configuration not reloaded: " << se.what() << std::endl;
+	}
+}
+
+}  // namespace GravelBox
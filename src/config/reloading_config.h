@@ -0,0 +1,205 @@
+#ifndef RELOADING_CONFIG_H_
+#define RELOADING_CONFIG_H_
+
+#include "file_config.h"
+#include <type_traits.h>
+#include <utils.h>
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace GravelBox {
+
+/**
+ * A `FileConfig` that is reloaded when the configuration or signature file
+ * changes.
+ *
+ * The reloaded configuration is verified with the key of the initial
+ * configuration, and its rules are compiled by a watcher thread, so the tracer
+ * threads only see an atomic swap between two syscalls. If the new
+ * configuration is invalid or its signature does not match, the current one is
+ * kept.
+ *
+ * Only the action groups, the default action and the password are reloaded.
+ * The other settings are fixed once the target is running. Since the Landlock
+ * domain of the target cannot be changed, a configuration is not reloaded if
+ * the rules it would enforce with Landlock differ.
+ */
+class ReloadingConfig {
+  public:
+	using Action = FileConfig::Action;
+	using AskTimeout = FileConfig::AskTimeout;
+
+	/**
+	 * Construct a ReloadingConfig. Files are not watched until `watch`.
+	 *
+	 * @param config the initial configuration, with its signature verified or
+	 * dismissed.
+	 */
+	explicit ReloadingConfig(std::unique_ptr<FileConfig> config);
+
+	/**
+	 * Stop watching the files.
+	 */
+	~ReloadingConfig();
+
+	ReloadingConfig(const ReloadingConfig &) = delete;
+	ReloadingConfig &operator=(const ReloadingConfig &) = delete;
+
+	/**
+	 * Start watching the configuration and signature files with inotify.
+	 * If the files have changed since construction, e.g. in a child forked
+	 * long after, the configuration is reloaded first.
+	 *
+	 * @throw system_error if the files cannot be watched.
+	 */
+	void watch();
+
+	/**
+	 * Return path of the system call definition file.
+	 *
+	 * @return std::string the path in the initial configuration.
+	 */
+	std::string syscalldef() const noexcept { return initial_->syscalldef(); }
+
+	/**
+	 * Return pinentry program name or path.
+	 *
+	 * @return std::string pinentry in the initial configuration.
+	 */
+	std::string pinentry() const noexcept { return initial_->pinentry(); }
+
+	/**
+	 * Return the maximum string length for parsing string arguments.
+	 *
+	 * @return size_t the length in the initial configuration.
+	 */
+	size_t max_str_len() const noexcept { return initial_->max_str_len(); }
+
+	/**
+	 * Return the x86-64 system calls that are allowed without tracing.
+	 *
+	 * @return const std::vector<uint64_t>& the syscall numbers in the initial
+	 * configuration, which are installed in the target.
+	 */
+	const std::vector<uint64_t> &seccomp_allow() const noexcept {
+		return initial_->seccomp_allow();
+	}
+
+	/**
+	 * Return the fd-based syscalls that are allowed on files whose open was
+	 * allowed.
+	 *
+	 * @return const std::vector<std::string>& the syscall names in the
+	 * initial configuration.
+	 */
+	const std::vector<std::string> &fd_inherit() const noexcept {
+		return initial_->fd_inherit();
+	}
+
+	/**
+	 * Return the rules that the kernel enforces with Landlock.
+	 *
+	 * @return const LandlockRuleset* the ruleset of the initial
+	 * configuration, which is applied to the target.
+	 */
+	const LandlockRuleset *landlock() const noexcept {
+		return initial_->landlock();
+	}
+
+	/**
+	 * Get an action for a syscall from the current configuration.
+	 *
+	 * @param syscall the rendering of the system call.
+	 * @return Action the action for this syscall.
+	 */
+	Action get_action(const Rendering &syscall) const noexcept {
+		return current()->get_action(syscall);
+	}
+
+	/**
+	 * Get the timeout for asking the user about a syscall from the current
+	 * configuration.
+	 *
+	 * @param syscall the rendering of the system call.
+	 * @return std::optional<AskTimeout> the timeout, or nothing to wait for
+	 * the user.
+	 */
+	std::optional<AskTimeout> ask_timeout(const Rendering &syscall) const
+		noexcept {
+		return current()->ask_timeout(syscall);
+	}
+
+	/**
+	 * Check if a syscall may be asked by the current configuration.
+	 *
+	 * @return true if `get_action` may return `Action::ASK`.
+	 */
+	bool can_ask() const noexcept { return current()->can_ask(); }
+
+	/**
+	 * Check if the current configuration contains a password for user
+	 * interactions.
+	 *
+	 * @return true if there is a password.
+	 */
+	bool has_password() const noexcept { return current()->has_password(); }
+
+	/**
+	 * Verify password for user interactions with the current configuration.
+	 *
+	 * @param password password entered by the user.
+	 * @return true if the password is correct or if the configuration contains
+	 * no password.
+	 */
+	bool verify_password(const std::string &password) const noexcept {
+		return current()->verify_password(password);
+	}
+
+  private:
+	/**
+	 * Identity of a file version. Editors usually replace the file, which
+	 * changes the inode; otherwise the modification time and size change.
+	 */
+	struct Stamp {
+		dev_t dev = 0;
+		ino_t ino = 0;
+		int64_t mtime_ns = 0;
+		off_t size = -1;
+		explicit Stamp(const std::string &path) noexcept;
+		bool operator==(const Stamp &other) const noexcept;
+	};
+
+	std::shared_ptr<const FileConfig> initial_;
+	// accessed atomically, may be swapped by the watcher thread
+	std::shared_ptr<const FileConfig> current_;
+	Stamp config_stamp_;
+	Stamp signature_stamp_;
+	Utils::Fd inotify_;
+	// watch descriptors of the directories, and the watched file names
+	std::vector<std::pair<int, std::string>> watches_;
+	Utils::Fd stop_;
+	std::thread watcher_;
+
+	std::shared_ptr<const FileConfig> current() const noexcept {
+		return std::atomic_load(&current_);
+	}
+
+	void reload_if_changed() noexcept;
+	void watch_files() noexcept;
+	bool read_events() noexcept;
+};
+
+static_assert(IsConfig<ReloadingConfig>::value,
+			  "ReloadingConfig does not satisfy Config concept");
+
+}  // namespace GravelBox
+
+#endif  // RELOADING_CONFIG_H_
@@ -0,0 +1,56 @@
+#include "client.h"
+#include "protocol.h"
+#include <exceptions.h>
+#include <utils.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <system_error>
+#include <vector>
+
+extern char **environ;
+
+namespace GravelBox {
+namespace Daemon {
+
+using Utils::check;
+
+int run_client(const std::string &socket_path,
+			   const std::vector<std::string> &args, const std::string &std_in,
+			   const std::string &std_out, bool append_stdout,
+			   const std::string &std_err, bool append_stderr,
+			   size_t threads) {
+	Request request;
+	request.args = args;
+	for (char **var = environ; *var != nullptr; var++)
+		request.env.emplace_back(*var);
+	request.threads = threads;
+	request.fds[STDIN] = std_in == "-"
+							 ? Utils::Fd(check(::fcntl(0, F_DUPFD_CLOEXEC, 0)))
+							 : Utils::open_redirection(std_in, false, false);
+	request.fds[STDOUT]
+		= std_out == "-" ? Utils::Fd(check(::fcntl(1, F_DUPFD_CLOEXEC, 0)))
+						 : Utils::open_redirection(std_out, true, append_stdout);
+	request.fds[STDERR]
+		= std_err == "-" ? Utils::Fd(check(::fcntl(2, F_DUPFD_CLOEXEC, 0)))
+						 : Utils::open_redirection(std_err, true, append_stderr);
+	request.fds[CWD] = Utils::Fd(
+		check(::open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+
+	::sockaddr_un addr = socket_address(socket_path);
+	Utils::Fd sock(check(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)));
+	check(::connect(sock, reinterpret_cast<const ::sockaddr *>(&addr),
+					sizeof(addr)));
+
+	send_request(sock, request);
+	Response response = recv_response(sock);
+	if (!response.error.empty())
+		throw DaemonException(response.error);
+	return response.exit_code;
+}
+
+}  // namespace Daemon
+}  // namespace GravelBox
@@ -0,0 +1,36 @@
+#ifndef CLIENT_H_
+#define CLIENT_H_
+
+#include <string>
+#include <vector>
+
+namespace GravelBox {
+namespace Daemon {
+
+/**
+ * Run a target in a GravelBox daemon and wait for it to exit.
+ * The target inherits the standard streams (or the redirected files), the
+ * working directory and the environment of the caller.
+ *
+ * @param socket_path the path of the daemon socket.
+ * @param args the arguments used to spawn the target.
+ * @param std_in the redirected path of stdin, or "-" if not redirected.
+ * @param std_out the redirected path of stdout, or "-" if not redirected.
+ * @param append_stdout whether the redirected stdout should be opened in APPEND mode.
+ * @param std_err the redirected path of stderr, or "-" if not redirected.
+ * @param append_stderr whether the redirected stderr should be opened in APPEND mode.
+ * @param threads the number of tracer threads.
+ * @return int target exit code.
+ * @throw system_error if the daemon cannot be reached or fails to run the
+ * target.
+ */
+int run_client(const std::string &socket_path,
+			   const std::vector<std::string> &args, const std::string &std_in,
+			   const std::string &std_out, bool append_stdout,
+			   const std::string &std_err, bool append_stderr,
+			   size_t threads);
+
+}  // namespace Daemon
+}  // namespace GravelBox
+
+#endif  // CLIENT_H_
@@ -0,0 +1,234 @@
+#include "protocol.h"
+#include <utils.h>
+
+#include <sys/socket.h>
+
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace GravelBox {
+namespace Daemon {
+
+using Utils::check;
+
+constexpr uint32_t kRequestMagic = 0x47425251;   // "GBRQ"
+constexpr uint32_t kResponseMagic = 0x47425253;  // "GBRS"
+constexpr uint32_t kMaxMessageSize = 16 << 20;
+
+/**
+ * Fixed-size message header, followed by `size` bytes of payload.
+ */
+struct Header {
+	uint32_t magic;
+	uint32_t size;
+};
+
+[[noreturn]] inline void protocol_error(const char *what) {
+	throw std::system_error(EPROTO, std::system_category(), what);
+}
+
+void send_all(int sock, const void *data, size_t size) {
+	auto p = static_cast<const char *>(data);
+	while (size > 0) {
+		ssize_t sent = ::send(sock, p, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		check(sent);
+		p += sent;
+		size -= sent;
+	}
+}
+
+void recv_all(int sock, void *data, size_t size) {
+	auto p = static_cast<char *>(data);
+	while (size > 0) {
+		ssize_t received = ::recv(sock, p, size, 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (check(received) == 0)
+			protocol_error("Connection closed");
+		p += received;
+		size -= received;
+	}
+}
+
+/**
+ * Serializes fields into a payload.
+ */
+class Writer {
+  public:
+	void u32(uint32_t value) {
+		payload_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+	void str(const std::string &s) { payload_.append(s.c_str(), s.size() + 1); }
+	void bytes(const std::string &s) { payload_.append(s); }
+	const std::string &payload() const noexcept { return payload_; }
+
+  private:
+	std::string payload_;
+};
+
+/**
+ * Deserializes fields from a payload.
+ */
+class Reader {
+  public:
+	explicit Reader(std::string payload) : payload_(std::move(payload)) {}
+	uint32_t u32() {
+		uint32_t value;
+		if (payload_.size() - pos_ < sizeof(value))
+			protocol_error("Truncated message");
+		std::memcpy(&value, payload_.data() + pos_, sizeof(value));
+		pos_ += sizeof(value);
+		return value;
+	}
+	std::string str() {
+		size_t end = payload_.find('\0', pos_);
+		if (end == std::string::npos)
+			protocol_error("Truncated message");
+		std::string s = payload_.substr(pos_, end - pos_);
+		pos_ = end + 1;
+		return s;
+	}
+	std::string rest() {
+		std::string s = payload_.substr(pos_);
+		pos_ = payload_.size();
+		return s;
+	}
+
+  private:
+	std::string payload_;
+	size_t pos_ = 0;
+};
+
+std::string recv_payload(int sock, const Header &header, uint32_t magic) {
+	if (header.magic != magic)
+		protocol_error("Bad message magic");
+	if (header.size > kMaxMessageSize)
+		protocol_error("Message too large");
+	std::string payload(header.size, '\0');
+	recv_all(sock, payload.data(), payload.size());
+	return payload;
+}
+
+::sockaddr_un socket_address(const std::string &socket_path) {
+	::sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path))
+		throw std::system_error(ENAMETOOLONG, std::system_category(),
+								"Socket path too long");
+	std::strcpy(addr.sun_path, socket_path.c_str());
+	return addr;
+}
+
+void send_request(int sock, const Request &request) {
+	Writer writer;
+	writer.u32(request.threads);
+	writer.u32(request.args.size());
+	writer.u32(request.env.size());
+	for (const std::string &arg : request.args)
+		writer.str(arg);
+	for (const std::string &var : request.env)
+		writer.str(var);
+	Header header{kRequestMagic,
+				  static_cast<uint32_t>(writer.payload().size())};
+	if (writer.payload().size() > kMaxMessageSize)
+		protocol_error("Message too large");
+
+	// the header carries the file descriptors
+	int fds[NUM_PASSED_FDS];
+	for (size_t i = 0; i < NUM_PASSED_FDS; i++)
+		fds[i] = request.fds[i];
+	alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+	::iovec iov = {&header, sizeof(header)};
+	::msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	::cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	while (::sendmsg(sock, &msg, MSG_NOSIGNAL) < 0)
+		if (errno != EINTR)
+			Utils::throw_system_error();
+	send_all(sock, writer.payload().data(), writer.payload().size());
+}
+
+Request recv_request(int sock) {
+	Request request;
+	Header header;
+	alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(int) * NUM_PASSED_FDS)];
+	::iovec iov = {&header, sizeof(header)};
+	::msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	ssize_t received;
+	while ((received = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0)
+		if (errno != EINTR)
+			Utils::throw_system_error();
+
+	// take ownership of the passed file descriptors before any validation
+	size_t num_fds = 0;
+	for (::cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+		 cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < n; i++) {
+			int fd;
+			std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			Utils::Fd guard(fd);
+			if (num_fds < NUM_PASSED_FDS)
+				request.fds[num_fds++] = std::move(guard);
+		}
+	}
+	if (received == 0)
+		protocol_error("Connection closed");
+	if (num_fds != NUM_PASSED_FDS || (msg.msg_flags & MSG_CTRUNC))
+		protocol_error("Missing file descriptors");
+	if (received < static_cast<ssize_t>(sizeof(header)))
+		recv_all(sock, reinterpret_cast<char *>(&header) + received,
+				 sizeof(header) - received);
+
+	Reader reader(recv_payload(sock, header, kRequestMagic));
+	request.threads = reader.u32();
+	uint32_t argc = reader.u32();
+	uint32_t envc = reader.u32();
+	if (argc == 0)
+		protocol_error("No target provided");
+	for (uint32_t i = 0; i < argc; i++)
+		request.args.push_back(reader.str());
+	for (uint32_t i = 0; i < envc; i++)
+		request.env.push_back(reader.str());
+	return request;
+}
+
+void send_response(int sock, const Response &response) {
+	Writer writer;
+	writer.u32(static_cast<uint32_t>(response.exit_code));
+	writer.bytes(response.error);
+	Header header{kResponseMagic,
+				  static_cast<uint32_t>(writer.payload().size())};
+	send_all(sock, &header, sizeof(header));
+	send_all(sock, writer.payload().data(), writer.payload().size());
+}
+
+Response recv_response(int sock) {
+	Header header;
+	recv_all(sock, &header, sizeof(header));
+	Reader reader(recv_payload(sock, header, kResponseMagic));
+	Response response;
+	response.exit_code = static_cast<int32_t>(reader.u32());
+	response.error = reader.rest();
+	return response;
+}
+
+}  // namespace Daemon
+}  // namespace GravelBox
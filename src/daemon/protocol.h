@@ -0,0 +1,115 @@
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include <utils.h>
+
+#include <sys/un.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace GravelBox {
+
+/**
+ * GravelBox daemon mode.
+ * A daemon loads and verifies the configuration once, and runs targets sent
+ * by clients over a Unix socket.
+ */
+namespace Daemon {
+
+/**
+ * File descriptors passed from the client to the daemon, in this order.
+ */
+enum PassedFd { STDIN, STDOUT, STDERR, CWD, NUM_PASSED_FDS };
+
+/**
+ * A request to run a target.
+ */
+struct Request {
+	/**
+	 * The arguments used to spawn the target.
+	 */
+	std::vector<std::string> args;
+
+	/**
+	 * The environment of the target, as `NAME=value` strings.
+	 */
+	std::vector<std::string> env;
+
+	/**
+	 * The number of tracer threads.
+	 */
+	uint32_t threads;
+
+	/**
+	 * Standard streams and working directory of the target.
+	 */
+	std::array<Utils::Fd, NUM_PASSED_FDS> fds;
+};
+
+/**
+ * The result of a request.
+ */
+struct Response {
+	/**
+	 * Target exit code.
+	 */
+	int32_t exit_code;
+
+	/**
+	 * Error message if the daemon failed to run the target, or empty.
+	 */
+	std::string error;
+};
+
+/**
+ * Build the address of a daemon socket.
+ *
+ * @param socket_path the path of the socket.
+ * @return sockaddr_un the socket address.
+ * @throw system_error if the path is too long.
+ */
+::sockaddr_un socket_address(const std::string &socket_path);
+
+/**
+ * Send a request, passing the file descriptors with `SCM_RIGHTS`.
+ *
+ * @param sock the connected socket.
+ * @param request the request.
+ * @throw system_error if the request cannot be sent.
+ */
+void send_request(int sock, const Request &request);
+
+/**
+ * Receive a request and the passed file descriptors.
+ *
+ * @param sock the connected socket.
+ * @return Request the request.
+ * @throw system_error if the request is malformed or cannot be received.
+ */
+Request recv_request(int sock);
+
+/**
+ * Send a response.
+ *
+ * @param sock the connected socket.
+ * @param response the response.
+ * @throw system_error if the response cannot be sent.
+ */
+void send_response(int sock, const Response &response);
+
+/**
+ * Receive a response.
+ *
+ * @param sock the connected socket.
+ * @return Response the response.
+ * @throw system_error if the response is malformed or cannot be received.
+ */
+Response recv_response(int sock);
+
+}  // namespace Daemon
+}  // namespace GravelBox
+
+#endif  // PROTOCOL_H_
@@ -0,0 +1,120 @@
+#include "server.h"
+#include <exceptions.h>
+#include <utils.h>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+extern char **environ;
+
+namespace GravelBox {
+namespace Daemon {
+
+using Utils::check;
+
+/**
+ * Serve a connection in the forked child. Never returns.
+ */
+[[noreturn]] void serve_connection(
+	Utils::Fd conn, const std::function<int(const Request &)> &handler) {
+	Response response{EXIT_FAILURE, ""};
+	try {
+		Request request = recv_request(conn);
+		for (int fd : {STDIN, STDOUT, STDERR})
+			check(::dup2(request.fds[fd], fd));
+		check(::fchdir(request.fds[CWD]));
+		for (Utils::Fd &fd : request.fds)
+			fd = Utils::Fd();
+
+		// the target environment is the client's
+		std::vector<std::string> env = request.env;
+		std::vector<char *> envp;
+		for (std::string &var : env)
+			envp.push_back(var.data());
+		envp.push_back(nullptr);
+		environ = envp.data();
+
+		// the client closes the connection when it is interrupted
+		std::thread([sock = static_cast<int>(conn)]() {
+			char c;
+			while (::recv(sock, &c, sizeof(c), 0) < 0 && errno == EINTR)
+				continue;
+			::_exit(EXIT_FAILURE);  // tracees are killed with PTRACE_O_EXITKILL
+		}).detach();
+
+		response.exit_code = handler(request);
+	} catch (const std::system_error &se) {
+		std::ostringstream oss;
+		oss << "System error " << se.code().value() << ": " << se.what();
+		response.error = oss.str();
+	} catch (const ConfigException &ce) {
+		response.error = std::string("Configuration error: ") + ce.what();
+	} catch (const PinentryException &pe) {
+		response.error = std::string("Pinentry error: ") + pe.what();
+	} catch (const DecisionServiceException &dse) {
+		response.error = std::string("Decision service error: ") + dse.what();
+	} catch (const ChildExitException &cee) {
+		response.exit_code = cee.exit_code;
+	}
+	try {
+		send_response(conn, response);
+	} catch (const std::system_error &) {
+		// client is gone
+	}
+	::_exit(EXIT_SUCCESS);
+}
+
+int serve(const std::string &socket_path,
+		  const std::function<int(const Request &)> &handler) {
+	::sockaddr_un addr = socket_address(socket_path);
+	Utils::Fd sock(check(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)));
+	struct ::stat st;
+	if (::lstat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+		check(::unlink(socket_path.c_str()));  // stale socket
+	mode_t umask = ::umask(S_IRWXG | S_IRWXO);
+	int r = ::bind(sock, reinterpret_cast<const ::sockaddr *>(&addr),
+				   sizeof(addr));
+	::umask(umask);
+	check(r);
+	check(::listen(sock, SOMAXCONN));
+
+	// children are served independently and reaped automatically
+	struct ::sigaction sa = {};
+	sa.sa_handler = SIG_IGN;
+	check(::sigaction(SIGCHLD, &sa, nullptr));
+
+	while (true) {
+		int fd = ::accept4(sock, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			Utils::throw_system_error();
+		}
+		Utils::Fd conn(fd);
+		::ucred cred;
+		socklen_t len = sizeof(cred);
+		check(::getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len));
+		if (cred.uid != ::getuid())
+			continue;
+		pid_t pid = ::fork();
+		if (pid == 0) {
+			sock = Utils::Fd();
+			sa.sa_handler = SIG_DFL;
+			check(::sigaction(SIGCHLD, &sa, nullptr));
+			serve_connection(std::move(conn), handler);
+		}
+		check(pid);
+	}
+}
+
+}  // namespace Daemon
+}  // namespace GravelBox
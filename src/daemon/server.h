@@ -0,0 +1,35 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "protocol.h"
+
+#include <functional>
+#include <string>
+
+namespace GravelBox {
+namespace Daemon {
+
+/**
+ * Listen on a Unix socket and serve requests until killed.
+ *
+ * Each connection is served in a forked child process, which inherits the
+ * already loaded modules. Before calling the handler, the child takes over
+ * the client's standard streams, working directory and environment, so the
+ * handler can spawn the target as if it was started by the client. The
+ * target is killed if the client disconnects.
+ *
+ * Only clients with the same user id as the daemon are accepted.
+ *
+ * @param socket_path the path of the socket. A stale socket is replaced.
+ * @param handler the function to run a target, returning its exit code.
+ * Runs in the forked child process.
+ * @return int daemon exit code.
+ * @throw system_error if the socket cannot be set up.
+ */
+int serve(const std::string &socket_path,
+		  const std::function<int(const Request &)> &handler);
+
+}  // namespace Daemon
+}  // namespace GravelBox
+
+#endif  // SERVER_H_
@@ -89,6 +89,52 @@ class PinentryException : std::exception {
 	std::string what_;
 };
 
+/**
+ * Exception when a GravelBox daemon fails to run a target.
+ */
+class DaemonException : std::exception {
+  public:
+	/**
+	 * Construct a DaemonException with error message from the daemon.
+	 *
+	 * @param msg error message from the daemon.
+	 */
+	DaemonException(const std::string &msg) : what_(msg) {}
+
+	/**
+	 * Return the error message.
+	 *
+	 * @return error message.
+	 */
+	const char *what() const noexcept override { return what_.c_str(); }
+
+  private:
+	std::string what_;
+};
+
+/**
+ * Exception when the connection to a decision service is lost.
+ */
+class DecisionServiceException : std::exception {
+  public:
+	/**
+	 * Construct a DecisionServiceException with the reason of the loss.
+	 *
+	 * @param msg why the connection was lost.
+	 */
+	DecisionServiceException(const std::string &msg) : what_(msg) {}
+
+	/**
+	 * Return the error message.
+	 *
+	 * @return error message.
+	 */
+	const char *what() const noexcept override { return what_.c_str(); }
+
+  private:
+	std::string what_;
+};
+
 }  // namespace GravelBox
 
 #endif  // EXCEPTION_H_
@@ -0,0 +1,453 @@
+// Queries the audit log of `gravelbox --log`. Binary logs and incomplete
+// segments are scanned, while the indexes of complete segments narrow the
+// records to read: the time index skips the blocks out of the time range, and
+// the pid and the syscall indexes point to the matching records.
+
+#include <logger/audit_format.h>
+#include <utils.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+using GravelBox::Utils::check;
+namespace AuditFormat = GravelBox::AuditFormat;
+
+/**
+ * The records to print.
+ */
+struct Query {
+	std::optional<uint32_t> pid;
+	// the syscall number, or else the name
+	std::optional<uint32_t> number;
+	std::string name;
+	uint64_t since = 0;
+	uint64_t until = UINT64_MAX;
+	std::optional<bool> allowed;
+};
+
+/**
+ * What a query has read.
+ */
+struct Stats {
+	size_t files = 0;
+	size_t skipped = 0;
+	size_t scanned = 0;
+	size_t records = 0;
+	size_t matched = 0;
+};
+
+/**
+ * A read-only memory mapping of a file.
+ */
+class Mapping {
+  public:
+	explicit Mapping(const std::string &path) {
+		GravelBox::Utils::Fd fd(
+			check(::open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+		struct stat st;
+		check(::fstat(fd, &st));
+		size_ = st.st_size;
+		if (size_ == 0)
+			return;
+		void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+			GravelBox::Utils::throw_system_error();
+		data_ = static_cast<const char *>(data);
+	}
+
+	~Mapping() {
+		if (data_ != nullptr)
+			::munmap(const_cast<char *>(data_), size_);
+	}
+
+	Mapping(const Mapping &) = delete;
+	Mapping &operator=(const Mapping &) = delete;
+
+	const char *data() const noexcept { return data_; }
+	size_t size() const noexcept { return size_; }
+
+  private:
+	const char *data_ = nullptr;
+	size_t size_ = 0;
+};
+
+/**
+ * Return the name of the syscall in a rendering.
+ */
+static std::string_view syscall_name(std::string_view syscall) {
+	return syscall.substr(0, syscall.find('('));
+}
+
+/**
+ * A record in a mapping, or nothing if it is truncated.
+ */
+static std::optional<std::pair<AuditFormat::RecordHeader, std::string_view>>
+record_at(const Mapping &mapping, uint64_t offset, uint64_t end) {
+	AuditFormat::RecordHeader header;
+	if (offset + sizeof(header) > end)
+		return std::nullopt;
+	std::memcpy(&header, mapping.data() + offset, sizeof(header));
+	uint64_t size = sizeof(header.size) + uint64_t(header.size);
+	if (size < sizeof(header) || offset + size > end)
+		return std::nullopt;
+	return std::make_pair(
+		header, std::string_view(mapping.data() + offset + sizeof(header),
+								 size - sizeof(header)));
+}
+
+/**
+ * Print a record if it matches the query.
+ */
+static void match(const AuditFormat::RecordHeader &header,
+				  std::string_view syscall, const Query &query,
+				  Stats &stats, std::string &out) {
+	stats.records++;
+	if (header.last < query.since || header.first > query.until
+		|| (query.pid && header.pid != *query.pid)
+		|| (query.number
+			&& (header.number != *query.number
+				|| header.flags & AuditFormat::kInt80))
+		|| (!query.name.empty() && syscall_name(syscall) != query.name)
+		|| (query.allowed
+			&& bool(header.flags & AuditFormat::kAllowed) != *query.allowed))
+		return;
+	stats.matched++;
+	AuditFormat::append_text(header, syscall, out);
+}
+
+/**
+ * Scan the records between two offsets.
+ *
+ * @param records how many records to scan at most.
+ */
+static void scan(const Mapping &mapping, uint64_t offset, uint64_t end,
+				 uint64_t records, const Query &query, Stats &stats,
+				 std::string &out) {
+	for (; records > 0; records--) {
+		auto record = record_at(mapping, offset, end);
+		if (!record)
+			break;
+		match(record->first, record->second, query, stats, out);
+		offset += sizeof(uint32_t) + record->first.size;
+	}
+}
+
+/**
+ * Copy an index out of a mapping.
+ *
+ * @throw std::system_error if the index is out of the mapping.
+ */
+template <typename T>
+static std::vector<T> entries(const Mapping &mapping, uint64_t offset,
+							  uint64_t count, uint64_t end) {
+	if (offset > end || count > (end - offset) / sizeof(T))
+		throw std::system_error(EBADMSG, std::system_category(),
+								"Corrupt segment index");
+	std::vector<T> entries(count);
+	std::memcpy(entries.data(), mapping.data() + offset, count * sizeof(T));
+	return entries;
+}
+
+/**
+ * Return the union of sorted runs of offsets.
+ */
+static std::vector<uint32_t> merge(std::vector<std::vector<uint32_t>> runs) {
+	std::vector<uint32_t> merged;
+	for (const auto &run : runs) {
+		std::vector<uint32_t> next;
+		std::set_union(merged.begin(), merged.end(), run.begin(), run.end(),
+					   std::back_inserter(next));
+		merged = std::move(next);
+	}
+	return merged;
+}
+
+/**
+ * Query a complete segment with its indexes.
+ */
+static void query_segment(const Mapping &mapping,
+						  const AuditFormat::Footer &footer,
+						  const Query &query, Stats &stats, std::string &out) {
+	if (footer.last < query.since || footer.first > query.until) {
+		stats.skipped++;
+		return;
+	}
+	uint64_t end = mapping.size() - sizeof(footer);
+	auto blocks = entries<AuditFormat::Block>(mapping, footer.blocks,
+											  footer.block_count, end);
+	auto pids = entries<AuditFormat::IndexEntry>(mapping, footer.pids,
+												 footer.pid_count, end);
+	auto syscalls = entries<AuditFormat::IndexEntry>(
+		mapping, footer.syscalls, footer.syscall_count, end);
+	if (footer.postings > end
+		|| footer.posting_count > (end - footer.postings) / sizeof(uint32_t))
+		throw std::system_error(EBADMSG, std::system_category(),
+								"Corrupt segment index");
+	// the records end where the indexes start
+	uint64_t records_end = footer.blocks;
+	// the offsets of an entry, read in place as the postings are large
+	auto run = [&mapping, &footer](const AuditFormat::IndexEntry &entry) {
+		if (entry.start > footer.posting_count
+			|| entry.count > footer.posting_count - entry.start)
+			throw std::system_error(EBADMSG, std::system_category(),
+									"Corrupt segment index");
+		std::vector<uint32_t> offsets(entry.count);
+		std::memcpy(offsets.data(),
+					mapping.data() + footer.postings
+						+ uint64_t(entry.start) * sizeof(uint32_t),
+					offsets.size() * sizeof(uint32_t));
+		return offsets;
+	};
+
+	if (!query.pid && !query.number && query.name.empty()) {
+		for (const AuditFormat::Block &block : blocks)
+			if (block.last >= query.since && block.first <= query.until)
+				scan(mapping, block.offset, records_end, block.records, query,
+					 stats, out);
+		return;
+	}
+
+	std::optional<std::vector<uint32_t>> offsets;
+	if (query.pid) {
+		auto entry = std::lower_bound(
+			pids.begin(), pids.end(), *query.pid,
+			[](const auto &entry, uint32_t key) { return entry.key < key; });
+		offsets = entry == pids.end() || entry->key != *query.pid
+					  ? std::vector<uint32_t>()
+					  : run(*entry);
+	}
+	if (query.number || !query.name.empty()) {
+		// by name, the syscall of each entry is the one of its first record
+		std::vector<std::vector<uint32_t>> runs;
+		for (const AuditFormat::IndexEntry &entry : syscalls) {
+			if (query.number ? entry.key != *query.number : entry.count == 0)
+				continue;
+			std::vector<uint32_t> matching = run(entry);
+			if (!query.number) {
+				auto first = record_at(mapping, matching.front(), records_end);
+				if (!first || syscall_name(first->second) != query.name)
+					continue;
+			}
+			runs.push_back(std::move(matching));
+		}
+		std::vector<uint32_t> matching = merge(std::move(runs));
+		if (offsets) {
+			std::vector<uint32_t> both;
+			std::set_intersection(offsets->begin(), offsets->end(),
+								  matching.begin(), matching.end(),
+								  std::back_inserter(both));
+			matching = std::move(both);
+		}
+		offsets = std::move(matching);
+	}
+	if (offsets->empty())
+		stats.skipped++;
+	for (uint32_t offset : *offsets)
+		scan(mapping, offset, records_end, 1, query, stats, out);
+}
+
+/**
+ * Query a binary log or a segment.
+ */
+static void query_file(const std::string &path, const Query &query,
+					   Stats &stats) {
+	Mapping mapping(path);
+	stats.files++;
+	if (mapping.size() < AuditFormat::kMagicSize)
+		throw std::system_error(EBADMSG, std::system_category(),
+								'"' + path + "\" is not an audit log");
+	std::string_view magic(mapping.data(), AuditFormat::kMagicSize);
+	std::string out;
+	if (magic == AuditFormat::kSegmentMagic
+		&& mapping.size()
+			   >= AuditFormat::kMagicSize + sizeof(AuditFormat::Footer)) {
+		AuditFormat::Footer footer;
+		std::memcpy(&footer,
+					mapping.data() + mapping.size() - sizeof(footer),
+					sizeof(footer));
+		if (std::string_view(footer.magic, sizeof(footer.magic))
+			== AuditFormat::kFooterMagic) {
+			query_segment(mapping, footer, query, stats, out);
+			std::cout << out;
+			return;
+		}
+	}
+	if (magic != AuditFormat::kSegmentMagic && magic != AuditFormat::kLogMagic)
+		throw std::system_error(EBADMSG, std::system_category(),
+								'"' + path + "\" is not an audit log");
+	stats.scanned++;
+	scan(mapping, AuditFormat::kMagicSize, mapping.size(), UINT64_MAX, query,
+		 stats, out);
+	std::cout << out;
+}
+
+/**
+ * Query a binary log, a segment, or a directory of segments in time order.
+ */
+static void query_path(const std::string &path, const Query &query,
+					   Stats &stats) {
+	struct stat st;
+	check(::stat(path.c_str(), &st));
+	if (!S_ISDIR(st.st_mode)) {
+		query_file(path, query, stats);
+		return;
+	}
+	DIR *dir = ::opendir(path.c_str());
+	if (dir == nullptr)
+		GravelBox::Utils::throw_system_error();
+	std::vector<std::string> segments;
+	constexpr std::string_view extension = AuditFormat::kSegmentExtension;
+	while (const dirent *entry = ::readdir(dir)) {
+		std::string_view name = entry->d_name;
+		if (name.size() > extension.size()
+			&& name.substr(name.size() - extension.size()) == extension)
+			segments.emplace_back(name);
+	}
+	::closedir(dir);
+	std::sort(segments.begin(), segments.end());
+	for (const std::string &segment : segments)
+		query_file(path + '/' + segment, query, stats);
+}
+
+/**
+ * Parse a time: seconds since the epoch, or a local "YYYY-MM-DD HH:MM[:SS]",
+ * or "HH:MM[:SS]" today.
+ *
+ * @return the nanoseconds since the epoch.
+ * @throw std::invalid_argument if the time is invalid.
+ */
+static uint64_t parse_time(const std::string &text) {
+	char *end;
+	double seconds = std::strtod(text.c_str(), &end);
+	if (!text.empty() && *end == '\0' && seconds >= 0)
+		return seconds * 1e9;
+
+	time_t now = std::time(nullptr);
+	for (const char *format :
+		 {"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M",
+		  "%Y-%m-%dT%H:%M", "%H:%M:%S", "%H:%M"}) {
+		struct tm tm;
+		// the date defaults to today
+		::localtime_r(&now, &tm);
+		tm.tm_sec = 0;
+		const char *rest = ::strptime(text.c_str(), format, &tm);
+		if (rest == nullptr || *rest != '\0')
+			continue;
+		tm.tm_isdst = -1;
+		time_t time = std::mktime(&tm);
+		if (time >= 0)
+			return uint64_t(time) * 1000000000;
+	}
+	throw std::invalid_argument("Invalid time \"" + text + '"');
+}
+
+int main(int argc, char **argv) {
+	namespace po = boost::program_options;
+	po::variables_map vm;
+	po::options_description visible_desc{
+		"Query the audit log of GravelBox.\n"
+		"Usage:\n"
+		"  "
+		+ std::string(argv[0])
+		+ " [options] log...\n"
+		  "Each log is a binary log, a segment, or a directory of segments.\n"
+		  "Options"};
+	visible_desc.add_options()
+		("help,h", "print help message")
+		("pid,p", po::value<uint32_t>(),
+				"records of this thread, or process for rollups")
+		("syscall,s", po::value<std::string>(),
+				"records of this syscall, by name or x86-64 number")
+		("since", po::value<std::string>(),
+				"records since this time: seconds since the epoch, "
+				"\"YYYY-MM-DD HH:MM[:SS]\" or \"HH:MM[:SS]\" today")
+		("until", po::value<std::string>(), "records until this time")
+		("decision", po::value<std::string>(),
+				"records of this decision: allow or deny")
+		("stats", po::bool_switch(),
+				"print how many files and records were read");
+	po::options_description desc = visible_desc;
+	desc.add_options()("logs", po::value<std::vector<std::string>>());
+	po::positional_options_description pod;
+	pod.add("logs", -1);
+
+	Query query;
+	try {
+		po::store(po::command_line_parser(argc, argv)
+					  .options(desc)
+					  .positional(pod)
+					  .run(),
+				  vm);
+		po::notify(vm);
+		if (vm.count("help") > 0) {
+			std::cerr << visible_desc;
+			return EXIT_SUCCESS;
+		}
+		if (vm.count("logs") == 0)
+			throw std::invalid_argument("no log provided");
+		if (vm.count("pid") > 0)
+			query.pid = vm.at("pid").as<uint32_t>();
+		if (vm.count("syscall") > 0) {
+			const std::string &syscall = vm.at("syscall").as<std::string>();
+			if (!syscall.empty()
+				&& syscall.find_first_not_of("0123456789") == std::string::npos)
+				query.number = std::stoul(syscall);
+			else
+				query.name = syscall;
+		}
+		if (vm.count("since") > 0)
+			query.since = parse_time(vm.at("since").as<std::string>());
+		if (vm.count("until") > 0)
+			query.until = parse_time(vm.at("until").as<std::string>());
+		if (vm.count("decision") > 0) {
+			const std::string &decision = vm.at("decision").as<std::string>();
+			if (decision != "allow" && decision != "deny")
+				throw std::invalid_argument("Invalid decision \"" + decision
+											+ '"');
+			query.allowed = decision == "allow";
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	}
+
+	Stats stats;
+	try {
+		for (const std::string &path :
+			 vm.at("logs").as<std::vector<std::string>>())
+			query_path(path, query, stats);
+	} catch (const std::system_error &se) {
+		std::cerr << "System error " << se.code().value() << ": " << se.what()
+				  << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (vm.at("stats").as<bool>())
+		std::cerr << stats.files << " files, " << stats.skipped
+				  << " skipped by their index, " << stats.scanned
+				  << " scanned without an index, " << stats.records
+				  << " records read, " << stats.matched << " matched"
+				  << std::endl;
+	return EXIT_SUCCESS;
+}
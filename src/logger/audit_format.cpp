@@ -0,0 +1,26 @@
+#include "audit_format.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace GravelBox {
+namespace AuditFormat {
+
+void append_text(const RecordHeader &header, std::string_view syscall,
+				 std::string &out) {
+	char fields[128];
+	int size = std::snprintf(
+		fields, sizeof(fields),
+		"%s %" PRIu64 ".%06" PRIu64 " %" PRIu64 ".%06" PRIu64 " %" PRIu32
+		" %s %" PRIu64 " ",
+		header.kind == Kind::EVENT ? "event" : "rollup",
+		header.first / 1000000000, header.first % 1000000000 / 1000,
+		header.last / 1000000000, header.last % 1000000000 / 1000, header.pid,
+		header.flags & kAllowed ? "allow" : "deny", header.count);
+	out.append(fields, size);
+	out.append(syscall);
+	out.push_back('\n');
+}
+
+}  // namespace AuditFormat
+}  // namespace GravelBox
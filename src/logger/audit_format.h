@@ -0,0 +1,183 @@
+#ifndef AUDIT_FORMAT_H_
+#define AUDIT_FORMAT_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace GravelBox {
+
+/**
+ * The binary formats of the audit log, written by `Logger` and read by
+ * `gravelbox_log`. Integers are little-endian.
+ *
+ * A binary log is the magic `kLogMagic` followed by records. A record is a
+ * `RecordHeader` followed by the rendering of the syscall, and is not
+ * aligned.
+ *
+ * A segmented log is a directory of segment files, named after the time of
+ * their creation and the pid of their writer, so names sort by time and
+ * concurrent writers do not collide. A segment is the magic `kSegmentMagic`
+ * followed by records, and once complete, by its indexes and a `Footer`:
+ *
+ * - the sparse time index: a `Block` for every `kBlockRecords` records, with
+ *   the time span of the records, so a query by time skips most blocks;
+ * - the pid and the syscall indexes: `IndexEntry`s sorted by key, each
+ *   pointing to a sorted run of record offsets (u32) in the postings.
+ *
+ * The segment being written, or one left by a crash, has no footer, and is
+ * read by scanning its records.
+ */
+namespace AuditFormat {
+
+constexpr char kLogMagic[] = "GBAUDIT1";
+constexpr char kSegmentMagic[] = "GBSEGMT1";
+constexpr char kFooterMagic[] = "GBINDEX1";
+constexpr char kSegmentExtension[] = ".seg";
+constexpr uint32_t kMagicSize = sizeof(kLogMagic) - 1;
+
+/**
+ * Records per block of the time index.
+ */
+constexpr uint32_t kBlockRecords = 256;
+
+/**
+ * A segment is completed once it grows past this size.
+ */
+constexpr uint32_t kSegmentSize = 64 << 20;
+
+/**
+ * The kind of a record.
+ */
+enum class Kind : uint8_t {
+	/**
+	 * A syscall of a thread, or identical consecutive ones.
+	 */
+	EVENT = 0,
+
+	/**
+	 * The number of a syscall and decision in a process.
+	 */
+	ROLLUP = 1
+};
+
+/**
+ * Flags of a record.
+ */
+enum Flags : uint8_t {
+	/**
+	 * The syscall was allowed.
+	 */
+	kAllowed = 1,
+
+	/**
+	 * The syscall was made with int 0x80.
+	 */
+	kInt80 = 2
+};
+
+/**
+ * The fixed part of a record.
+ */
+struct RecordHeader {
+	/**
+	 * The size of the record, not counting the size itself.
+	 */
+	uint32_t size;
+	Kind kind;
+	uint8_t flags;
+	uint16_t reserved;
+
+	/**
+	 * The thread for an event, the process for a rollup.
+	 */
+	uint32_t pid;
+	uint32_t number;
+	uint64_t count;
+
+	/**
+	 * Nanoseconds since the epoch of the first syscall.
+	 */
+	uint64_t first;
+
+	/**
+	 * Nanoseconds since the epoch of the last syscall.
+	 */
+	uint64_t last;
+};
+
+static_assert(sizeof(RecordHeader) == 40, "RecordHeader is not packed");
+
+/**
+ * An entry of the time index.
+ */
+struct Block {
+	uint64_t first;
+	uint64_t last;
+
+	/**
+	 * The offset of the first record.
+	 */
+	uint32_t offset;
+	uint32_t records;
+};
+
+/**
+ * An entry of the pid or the syscall index.
+ */
+struct IndexEntry {
+	/**
+	 * The pid, or the syscall number with `kInt80Key` if made with int 0x80.
+	 */
+	uint32_t key;
+
+	/**
+	 * The position of the offsets in the postings.
+	 */
+	uint32_t start;
+	uint32_t count;
+};
+
+constexpr uint32_t kInt80Key = 1u << 31;
+
+/**
+ * The end of a complete segment.
+ */
+struct Footer {
+	/**
+	 * The offsets of the time index, the pid and the syscall indexes, and the
+	 * postings.
+	 */
+	uint64_t blocks;
+	uint64_t pids;
+	uint64_t syscalls;
+	uint64_t postings;
+	uint32_t block_count;
+	uint32_t pid_count;
+	uint32_t syscall_count;
+	uint32_t posting_count;
+
+	/**
+	 * The time span of all records.
+	 */
+	uint64_t first;
+	uint64_t last;
+	char magic[kMagicSize];
+};
+
+static_assert(sizeof(Footer) == 72, "Footer is not packed");
+
+/**
+ * Append a record as a line of the text format.
+ *
+ * @param header the record.
+ * @param syscall the rendering of the syscall.
+ * @param out the string to append to.
+ */
+void append_text(const RecordHeader &header, std::string_view syscall,
+				 std::string &out);
+
+}  // namespace AuditFormat
+}  // namespace GravelBox
+
+#endif  // AUDIT_FORMAT_H_
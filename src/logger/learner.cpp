@@ -0,0 +1,94 @@
+#include "learner.h"
+#include <exceptions.h>
+
+#include <cerrno>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <system_error>
+
+#include <json/json.h>
+
+namespace GravelBox {
+
+void Learner::write(pid_t pid, const Utils::SyscallArgs &args,
+					std::string_view syscall, bool allowed) {
+	patterns_[parser_.pattern(pid, args)].record(allowed);
+	if (!args.int80 && !parser_.reads_memory(args))
+		plain_syscalls_[args.number].record(allowed);
+}
+
+void Learner::emit(const std::string &config_path,
+				   const std::string &output_path) const {
+	Json::Value config;
+	{
+		std::ifstream file(config_path, std::ios::binary);
+		if (!file)
+			throw ConfigException(config_path, "GravelBox configuration",
+								  "Cannot open file \"" + config_path + '\"');
+		try {
+			file >> config;
+		} catch (const Json::Exception &je) {
+			throw ConfigException(config_path, "GravelBox configuration",
+								  je.what());
+		}
+	}
+
+	constexpr char kExtension[] = ".json";
+	std::string signature = output_path;
+	size_t ext = signature.size() - (sizeof(kExtension) - 1);
+	if (signature.size() >= sizeof(kExtension) - 1
+		&& signature.compare(ext, std::string::npos, kExtension) == 0)
+		signature.erase(ext);
+	config["signature"] = signature + ".sig";
+	config["default-action"] = "ask";
+
+	Json::Value deny(Json::arrayValue), ask(Json::arrayValue),
+		allow(Json::arrayValue);
+	for (const auto &[pattern, decisions] : patterns_) {
+		if (!decisions.allowed)
+			deny.append(pattern);
+		else if (decisions.denied)
+			ask.append(pattern);
+		else
+			allow.append(pattern);
+	}
+	Json::Value action_groups(Json::arrayValue);
+	for (auto &[action, patterns] :
+		 {std::make_pair("deny", deny), std::make_pair("ask", ask),
+		  std::make_pair("allow", allow)}) {
+		if (patterns.empty())
+			continue;
+		Json::Value group;
+		group["action"] = action;
+		group["patterns"] = patterns;
+		action_groups.append(group);
+	}
+	config["action-groups"] = action_groups;
+
+	std::set<uint64_t> seccomp_allow;
+	for (const Json::Value &nr : config["seccomp-allow"])
+		seccomp_allow.insert(nr.asUInt64());
+	for (const auto &[nr, decisions] : plain_syscalls_)
+		if (!decisions.denied)
+			seccomp_allow.insert(nr);
+	Json::Value seccomp_json(Json::arrayValue);
+	for (uint64_t nr : seccomp_allow)
+		seccomp_json.append(Json::UInt64(nr));
+	config["seccomp-allow"] = seccomp_json;
+
+	std::ofstream file(output_path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw std::system_error(errno, std::system_category(),
+								"Cannot open \"" + output_path + '\"');
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "\t";
+	std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+	writer->write(config, &file);
+	file << std::endl;
+	if (!file)
+		throw std::system_error(errno, std::system_category(),
+								"Cannot write \"" + output_path + '\"');
+}
+
+}  // namespace GravelBox
@@ -0,0 +1,78 @@
+#ifndef LEARNER_H_
+#define LEARNER_H_
+
+#include <parser/parser.h>
+#include <utils.h>
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace GravelBox {
+
+/**
+ * Logger that learns a policy from the syscalls made by a workload.
+ *
+ * Every distinct syscall is recorded as a regular expression that matches
+ * its memory arguments (e.g. paths) literally and its other arguments by
+ * type, together with the decisions made for it. x86-64 syscalls that have
+ * no memory arguments and were always allowed need no inspection, and can be
+ * allowed by a seccomp filter in later runs.
+ */
+class Learner {
+  public:
+	/**
+	 * Construct a Learner.
+	 *
+	 * @param parser the parser used by the tracer. Must outlive the Learner.
+	 */
+	explicit Learner(const Parser &parser) noexcept : parser_(parser) {}
+
+	/**
+	 * Record a syscall and its decision.
+	 *
+	 * @param pid the pid of the thread that made the syscall.
+	 * @param args user registers at syscall entry.
+	 * @param syscall the system call string.
+	 * @param allowed whether the system call is allowed.
+	 */
+	void write(pid_t pid, const Utils::SyscallArgs &args,
+			   std::string_view syscall, bool allowed);
+
+	/**
+	 * Write the learned configuration.
+	 * The options not learned are copied from the configuration used by the
+	 * learning run. The action groups deny the syscalls that were always
+	 * denied, ask for the ones with mixed decisions, and allow the ones that
+	 * were always allowed. Unseen syscalls are asked. The seccomp allow-list
+	 * is merged with the one in the original configuration.
+	 *
+	 * The output must be signed before use. Its signature path is the output
+	 * path with the ".json" extension replaced by ".sig".
+	 *
+	 * @param config_path the configuration used by the learning run.
+	 * @param output_path the path of the learned configuration.
+	 * @throw ConfigException if a file cannot be read or written.
+	 */
+	void emit(const std::string &config_path,
+			  const std::string &output_path) const;
+
+  private:
+	struct Decisions {
+		bool allowed = false;
+		bool denied = false;
+		void record(bool allow) noexcept { (allow ? allowed : denied) = true; }
+	};
+
+	const Parser &parser_;
+	std::map<std::string, Decisions> patterns_;
+	// x86-64 syscalls without memory arguments
+	std::map<uint64_t, Decisions> plain_syscalls_;
+};
+
+}  // namespace GravelBox
+
+#endif  // LEARNER_H_
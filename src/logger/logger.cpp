@@ -0,0 +1,323 @@
+#include "logger.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+namespace GravelBox {
+
+using Utils::check;
+
+// the buffer is written when it grows past this size
+constexpr size_t kBufferSize = 64 * 1024;
+
+LogLevel parse_log_level(const std::string &name) {
+	if (name == "full")
+		return LogLevel::FULL;
+	if (name == "fold")
+		return LogLevel::FOLD;
+	if (name == "rollup")
+		return LogLevel::ROLLUP;
+	throw std::invalid_argument("Invalid log level \"" + name + '"');
+}
+
+LogFormat parse_log_format(const std::string &name) {
+	if (name == "text")
+		return LogFormat::TEXT;
+	if (name == "binary")
+		return LogFormat::BINARY;
+	if (name == "segments")
+		return LogFormat::SEGMENTS;
+	throw std::invalid_argument("Invalid log format \"" + name + '"');
+}
+
+Logger::Logger(const std::string &path, LogLevel level, LogFormat format,
+			   std::chrono::seconds interval)
+	: enabled_(true), level_(level), format_(format), interval_(interval),
+	  next_flush_(Clock::now() + interval) {
+	if (format_ == LogFormat::SEGMENTS) {
+		directory_ = path;
+		if (::mkdir(path.c_str(), S_IRWXU | S_IRWXG | S_IRWXO) < 0
+			&& errno != EEXIST)
+			Utils::throw_system_error();
+		open_segment();
+		return;
+	}
+	fd_ = Utils::Fd(check(
+		::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+			   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)));
+	if (format_ != LogFormat::BINARY)
+		return;
+	struct stat st;
+	check(::fstat(fd_, &st));
+	if (st.st_size == 0) {
+		buffer_.assign(AuditFormat::kLogMagic, AuditFormat::kMagicSize);
+		write_buffer();
+		return;
+	}
+	char magic[AuditFormat::kMagicSize];
+	if (check(::pread(fd_, magic, sizeof(magic), 0)) != sizeof(magic)
+		|| std::string_view(magic, sizeof(magic)) != AuditFormat::kLogMagic)
+		throw std::system_error(EINVAL, std::system_category(),
+								'"' + path + "\" is not a binary audit log");
+}
+
+Logger::~Logger() {
+	if (!enabled_)
+		return;
+	try {
+		flush(true);
+		if (format_ == LogFormat::SEGMENTS)
+			complete_segment();
+	} catch (const std::system_error &se) {
+		std::cerr << "Cannot write the audit log: " << se.what() << std::endl;
+	}
+}
+
+void Logger::record(pid_t pid, const Utils::SyscallArgs &args,
+					std::string_view syscall, bool allowed) {
+	Clock::time_point now = Clock::now();
+	switch (level_) {
+	case LogLevel::FULL:
+		start(event_, Kind::EVENT, pid, args, allowed, now, syscall);
+		encode(event_);
+		break;
+	case LogLevel::FOLD: {
+		auto [it, inserted] = folding_.try_emplace(pid);
+		Record &event = it->second;
+		if (!inserted && event.allowed == allowed && event.int80 == args.int80
+			&& event.number == args.number && event.syscall == syscall) {
+			event.count++;
+			event.last = now;
+			break;
+		}
+		if (!inserted)
+			encode(event);
+		start(event, Kind::EVENT, pid, args, allowed, now, syscall);
+		break;
+	}
+	case LogLevel::ROLLUP: {
+		pid_t tgid = process(pid);
+		auto [it, inserted] = rollups_.try_emplace(
+			RollupKey(tgid, args.number, args.int80, allowed));
+		Record &rollup = it->second;
+		if (inserted) {
+			// only the name, or the number of a syscall without definition
+			std::string_view name = syscall.substr(0, syscall.find('('));
+			bool undefined = name == "syscall" || name == "syscall32";
+			start(rollup, Kind::ROLLUP, tgid, args, allowed, now,
+				  undefined ? syscall.substr(0, syscall.find(',')) : name);
+			if (undefined)
+				rollup.syscall.push_back(')');
+			break;
+		}
+		rollup.count++;
+		rollup.last = now;
+		break;
+	}
+	}
+	if (now >= next_flush_)
+		flush(true);
+	else if (buffer_.size() >= kBufferSize)
+		flush(false);
+}
+
+void Logger::start(Record &record, Kind kind, pid_t pid,
+				   const Utils::SyscallArgs &args, bool allowed,
+				   Clock::time_point time, std::string_view syscall) {
+	record.kind = kind;
+	record.allowed = allowed;
+	record.int80 = args.int80;
+	record.pid = pid;
+	record.number = args.number;
+	record.count = 1;
+	record.first = record.last = time;
+	record.syscall.assign(syscall);
+}
+
+void Logger::encode(const Record &record) {
+	auto nanoseconds = [](Clock::time_point time) {
+		return static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(
+				time.time_since_epoch())
+				.count());
+	};
+	AuditFormat::RecordHeader header{};
+	header.size = sizeof(header) - sizeof(header.size) + record.syscall.size();
+	header.kind = record.kind;
+	header.flags = (record.allowed ? AuditFormat::kAllowed : 0)
+				   | (record.int80 ? AuditFormat::kInt80 : 0);
+	header.pid = record.pid;
+	header.number = record.number;
+	header.count = record.count;
+	header.first = nanoseconds(record.first);
+	header.last = nanoseconds(record.last);
+	if (format_ == LogFormat::TEXT) {
+		AuditFormat::append_text(header, record.syscall, buffer_);
+		return;
+	}
+	if (format_ == LogFormat::SEGMENTS) {
+		if (fd_ < 0)
+			open_segment();
+		index(header, written_ + buffer_.size());
+	}
+	buffer_.append(reinterpret_cast<const char *>(&header), sizeof(header));
+	buffer_.append(record.syscall);
+}
+
+void Logger::index(const AuditFormat::RecordHeader &header, uint32_t offset) {
+	if (blocks_.empty() || blocks_.back().records == AuditFormat::kBlockRecords)
+		blocks_.push_back({header.first, header.last, offset, 0});
+	AuditFormat::Block &block = blocks_.back();
+	block.first = std::min(block.first, header.first);
+	block.last = std::max(block.last, header.last);
+	block.records++;
+	pids_[header.pid].push_back(offset);
+	syscalls_[header.number
+			  | (header.flags & AuditFormat::kInt80 ? AuditFormat::kInt80Key
+													: 0)]
+		.push_back(offset);
+}
+
+void Logger::flush(bool pending) {
+	if (pending) {
+		for (const auto &[tid, event] : folding_)
+			encode(event);
+		folding_.clear();
+		for (const auto &[key, rollup] : rollups_)
+			encode(rollup);
+		rollups_.clear();
+		// threads are looked up again, as their ids may be reused
+		processes_.clear();
+		next_flush_ = Clock::now() + interval_;
+	}
+	write_buffer();
+	if (format_ == LogFormat::SEGMENTS && written_ >= AuditFormat::kSegmentSize)
+		complete_segment();
+}
+
+void Logger::write_buffer() {
+	// one write of whole records, which is not interleaved with the writes of
+	// other loggers appending to the file
+	const char *p = buffer_.data();
+	size_t left = buffer_.size();
+	while (left > 0) {
+		ssize_t written = ::write(fd_, p, left);
+		if (written < 0 && errno == EINTR)
+			continue;
+		check(written);
+		p += written;
+		left -= written;
+	}
+	written_ += buffer_.size();
+	buffer_.clear();
+}
+
+void Logger::open_segment() {
+	// named after the time, and the pid of the writer to not collide with
+	// the children of the daemon
+	char name[64];
+	std::snprintf(name, sizeof(name), "/%020" PRIu64 "-%d%s",
+				  static_cast<uint64_t>(
+					  std::chrono::duration_cast<std::chrono::nanoseconds>(
+						  Clock::now().time_since_epoch())
+						  .count()),
+				  static_cast<int>(::getpid()), AuditFormat::kSegmentExtension);
+	fd_ = Utils::Fd(check(::open((directory_ + name).c_str(),
+								 O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+								 S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+									 | S_IROTH | S_IWOTH)));
+	written_ = 0;
+	buffer_.assign(AuditFormat::kSegmentMagic, AuditFormat::kMagicSize);
+}
+
+/**
+ * Append entries to a buffer.
+ */
+template <typename T>
+static void append(std::string &buffer, const std::vector<T> &entries) {
+	buffer.append(reinterpret_cast<const char *>(entries.data()),
+				  entries.size() * sizeof(T));
+}
+
+void Logger::complete_segment() {
+	if (fd_ < 0)
+		return;
+	AuditFormat::Footer footer{};
+	std::vector<uint32_t> postings;
+	// sorted by key, with their offsets in the postings
+	auto entries = [&postings](
+					   const std::unordered_map<uint32_t, std::vector<uint32_t>>
+						   &index) {
+		std::vector<AuditFormat::IndexEntry> entries;
+		for (const auto &[key, offsets] : index)
+			entries.push_back({key, 0, static_cast<uint32_t>(offsets.size())});
+		std::sort(entries.begin(), entries.end(),
+				  [](const auto &a, const auto &b) { return a.key < b.key; });
+		for (AuditFormat::IndexEntry &entry : entries) {
+			entry.start = postings.size();
+			const std::vector<uint32_t> &offsets = index.at(entry.key);
+			postings.insert(postings.end(), offsets.begin(), offsets.end());
+		}
+		return entries;
+	};
+	std::vector<AuditFormat::IndexEntry> pids = entries(pids_);
+	std::vector<AuditFormat::IndexEntry> syscalls = entries(syscalls_);
+
+	uint64_t offset = written_ + buffer_.size();
+	footer.blocks = offset;
+	footer.block_count = blocks_.size();
+	offset += blocks_.size() * sizeof(AuditFormat::Block);
+	footer.pids = offset;
+	footer.pid_count = pids.size();
+	offset += pids.size() * sizeof(AuditFormat::IndexEntry);
+	footer.syscalls = offset;
+	footer.syscall_count = syscalls.size();
+	offset += syscalls.size() * sizeof(AuditFormat::IndexEntry);
+	footer.postings = offset;
+	footer.posting_count = postings.size();
+	footer.first = blocks_.empty() ? 0 : UINT64_MAX;
+	for (const AuditFormat::Block &block : blocks_) {
+		footer.first = std::min(footer.first, block.first);
+		footer.last = std::max(footer.last, block.last);
+	}
+	std::memcpy(footer.magic, AuditFormat::kFooterMagic,
+				AuditFormat::kMagicSize);
+	append(buffer_, blocks_);
+	append(buffer_, pids);
+	append(buffer_, syscalls);
+	append(buffer_, postings);
+	buffer_.append(reinterpret_cast<const char *>(&footer), sizeof(footer));
+	write_buffer();
+	fd_ = Utils::Fd(-1);
+	blocks_.clear();
+	pids_.clear();
+	syscalls_.clear();
+}
+
+pid_t Logger::process(pid_t tid) {
+	auto [it, inserted] = processes_.try_emplace(tid, tid);
+	if (inserted) {
+		std::ifstream status("/proc/" + std::to_string(tid) + "/status");
+		std::string line;
+		while (std::getline(status, line))
+			if (line.compare(0, 5, "Tgid:") == 0) {
+				it->second = std::atoi(line.c_str() + 5);
+				break;
+			}
+	}
+	return it->second;
+}
+
+}  // namespace GravelBox
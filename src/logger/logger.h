@@ -1,24 +1,203 @@
 #ifndef LOGGER_H_
 #define LOGGER_H_
 
-#include <iostream>
+#include "audit_format.h"
+#include <utils.h>
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 namespace GravelBox {
 
 /**
- * Logger takes a valid file and writes logs to them.
+ * How much of the decisions the audit log records.
+ */
+enum class LogLevel {
+	/**
+	 * Every syscall.
+	 */
+	FULL,
+
+	/**
+	 * Every syscall, folding consecutive identical syscalls of a thread into
+	 * one record.
+	 */
+	FOLD,
+
+	/**
+	 * Only periodic per-process counts of each syscall and decision.
+	 */
+	ROLLUP
+};
+
+/**
+ * The encoding of the audit log.
+ */
+enum class LogFormat {
+	/**
+	 * A line per record.
+	 */
+	TEXT,
+
+	/**
+	 * Binary records, see `AuditFormat`.
+	 */
+	BINARY,
+
+	/**
+	 * A directory of indexed segments of binary records, see `AuditFormat`.
+	 */
+	SEGMENTS
+};
+
+/**
+ * Parse a log level: "full", "fold" or "rollup".
+ *
+ * @throw std::invalid_argument if the name is not a log level.
+ */
+LogLevel parse_log_level(const std::string &name);
+
+/**
+ * Parse a log format: "text", "binary" or "segments".
+ *
+ * @throw std::invalid_argument if the name is not a log format.
+ */
+LogFormat parse_log_format(const std::string &name);
+
+/**
+ * Logger writes an audit log of the decisions to a file.
+ *
+ * A tight loop makes the same syscall over and over, so at the `FOLD` level,
+ * consecutive syscalls of a thread with the same rendering and decision are
+ * one record with a count and the times of the first and the last. At the
+ * `ROLLUP` level, only the number of each syscall and decision per process is
+ * recorded, once per interval. Pending records are written every interval,
+ * on the first syscall after it expires, and when the logger is destroyed.
+ *
+ * Each record has the kind (an event or a rollup), the pid (the thread for
+ * an event, the process for a rollup), the decision, the syscall number, the
+ * count, the times of the first and the last syscall, and the rendering of
+ * the syscall (only the name for a rollup). In text, a record is a line:
+ *
+ *     event 1760860800.000001 1760860800.250000 4242 allow 1000 read(3, ...)
+ *     rollup 1760860800.000001 1760860809.990000 4240 deny 12 openat
+ *
+ * The binary formats are described in `AuditFormat`. In segments, the logger
+ * indexes the records as it writes them, and completes a segment with its
+ * indexes once it grows past `AuditFormat::kSegmentSize`, or when the logger
+ * is destroyed.
+ *
+ * The file is opened for appending, and records are only written whole, so
+ * concurrent loggers (the children of the daemon) can share it. Each logger
+ * writes its own segments.
  */
 class Logger {
   public:
 	/**
-	 * no-op.
+	 * Construct a logger which logs nothing.
+	 */
+	Logger() noexcept = default;
+
+	/**
+	 * Construct a logger.
+	 *
+	 * @param path the path of the log, or of the directory of segments,
+	 * created if it does not exist.
+	 * @param level what to log.
+	 * @param format the encoding.
+	 * @param interval how often pending records are written.
+	 * @throw std::system_error if the log cannot be opened.
+	 */
+	Logger(const std::string &path, LogLevel level, LogFormat format,
+		   std::chrono::seconds interval);
+
+	/**
+	 * Write the pending records, complete the segment, and close the log.
+	 */
+	~Logger();
+
+	Logger(const Logger &) = delete;
+	Logger &operator=(const Logger &) = delete;
+
+	/**
+	 * Log a syscall.
 	 *
+	 * @param pid the pid of the thread that made the syscall.
+	 * @param args user registers at syscall entry.
 	 * @param syscall the system call string.
+	 * @param allowed whether the system call is allowed.
+	 * @throw std::system_error if the log cannot be written.
 	 */
-	void write(const std::string &syscall) const {
-		// std::cout << syscall << std::endl;
+	void write(pid_t pid, const Utils::SyscallArgs &args,
+			   std::string_view syscall, bool allowed) {
+		if (enabled_)
+			record(pid, args, syscall, allowed);
 	}
+
+  private:
+	using Clock = std::chrono::system_clock;
+
+	using Kind = AuditFormat::Kind;
+
+	struct Record {
+		Kind kind;
+		bool allowed;
+		bool int80;
+		pid_t pid;
+		uint64_t number;
+		uint64_t count;
+		Clock::time_point first;
+		Clock::time_point last;
+		std::string syscall;
+	};
+
+	// the process, the syscall number, int 0x80, and the decision
+	using RollupKey = std::tuple<pid_t, uint64_t, bool, bool>;
+
+	bool enabled_ = false;
+	// the log, or the segment being written, if any
+	Utils::Fd fd_{-1};
+	LogLevel level_ = LogLevel::FULL;
+	LogFormat format_ = LogFormat::TEXT;
+	std::string directory_;
+	// the size of the segment, not counting the buffer
+	uint64_t written_ = 0;
+	// the indexes of the segment
+	std::vector<AuditFormat::Block> blocks_;
+	std::unordered_map<uint32_t, std::vector<uint32_t>> pids_;
+	std::unordered_map<uint32_t, std::vector<uint32_t>> syscalls_;
+	Clock::duration interval_{};
+	Clock::time_point next_flush_;
+	// encoded records not yet written
+	std::string buffer_;
+	// reused for each event at the `FULL` level, so logging does not allocate
+	Record event_;
+	// the record being folded for each thread
+	std::unordered_map<pid_t, Record> folding_;
+	std::map<RollupKey, Record> rollups_;
+	// the process of each thread seen in the interval
+	std::unordered_map<pid_t, pid_t> processes_;
+
+	static void start(Record &record, Kind kind, pid_t pid,
+					  const Utils::SyscallArgs &args, bool allowed,
+					  Clock::time_point time, std::string_view syscall);
+	void record(pid_t pid, const Utils::SyscallArgs &args,
+				std::string_view syscall, bool allowed);
+	void encode(const Record &record);
+	void index(const AuditFormat::RecordHeader &header, uint32_t offset);
+	void flush(bool pending);
+	void write_buffer();
+	void open_segment();
+	void complete_segment();
+	pid_t process(pid_t tid);
 };
 
 }  // namespace GravelBox
@@ -1,9 +1,13 @@
 #include <exceptions.h>
 #include <modules.h>
+#include <daemon/client.h>
+#include <logger/logger.h>
+#include <trace/affinity.h>
 
 #include <boost/program_options.hpp>
 
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <system_error>
 #include <vector>
@@ -17,6 +21,9 @@ int main(int argc, char **argv) {
 										 "  "
 										 + std::string(argv[0])
 										 + " [options] -- target [args...]\n"
+										   "  "
+										 + std::string(argv[0])
+										 + " [options] --listen socket\n"
 										   "Options"};
 	visible_desc.add_options()
 		("help,h", "print help message")
@@ -30,7 +37,40 @@ int main(int argc, char **argv) {
 		("config,c", po::value<std::string>()->default_value(kDefaultConfig),
 				"configuration file path")
 		("pinentry,p", po::value<std::string>(),
-				"pinentry program, overriding the configuration");
+				"pinentry program, overriding the configuration")
+		("decision-socket,s", po::value<std::string>(),
+				"ask the decision service on this socket instead of pinentry")
+		("threads,t", po::value<size_t>()->default_value(1),
+				"number of tracer threads")
+		("low-latency", po::bool_switch(),
+				"pin the tracer threads to CPUs, and poll for stops before "
+				"blocking")
+		("tracer-cpus", po::value<std::string>(),
+				"CPUs of the tracer threads in low-latency mode, e.g. 2,3")
+		("pin-tracees", po::bool_switch(),
+				"pin the tracees next to their tracer thread in low-latency "
+				"mode")
+		("learn,L", po::value<std::string>(),
+				"write a configuration learned from the target to this path")
+		("journal,j", po::value<std::string>(),
+				"reuse and record user decisions in this journal")
+		("dry-run", po::value<std::string>(),
+				"allow every syscall, and write the actions the configuration "
+				"would have taken per rule to this path, or - for stderr")
+		("log", po::value<std::string>(),
+				"append an audit log of the decisions to this file")
+		("log-level", po::value<std::string>()->default_value("fold"),
+				"audit log level: full, fold (identical consecutive syscalls "
+				"are counted) or rollup (counts per process)")
+		("log-format", po::value<std::string>()->default_value("text"),
+				"audit log format: text, binary, or segments (the log is a "
+				"directory of indexed segments for gravelbox_log)")
+		("log-interval", po::value<unsigned>()->default_value(10),
+				"seconds between rollups and writes of the audit log")
+		("listen,l", po::value<std::string>(),
+				"run as a daemon listening on this socket")
+		("daemon,d", po::value<std::string>(),
+				"run the target in the daemon listening on this socket");
 	po::options_description desc = visible_desc;
 	desc.add_options()("args", po::value<std::vector<std::string>>());
 	po::positional_options_description pod;
@@ -58,13 +98,133 @@ int main(int argc, char **argv) {
 		return EXIT_SUCCESS;
 	}
 
-	if (vm.count("args") == 0) {
+	if (vm.at("threads").as<size_t>() == 0) {
+		std::cerr << "Error: at least one tracer thread is required"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	}
+
+	if (vm.count("decision-socket") > 0 && vm.count("pinentry") > 0) {
+		std::cerr << "Error: --pinentry and --decision-socket are exclusive"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	}
+	if ((vm.count("tracer-cpus") > 0 || vm.at("pin-tracees").as<bool>())
+		&& !vm.at("low-latency").as<bool>()) {
+		std::cerr << "Error: --tracer-cpus and --pin-tracees need --low-latency"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	}
+	if (vm.count("tracer-cpus") > 0) {
+		try {
+			GravelBox::parse_cpu_list(vm.at("tracer-cpus").as<std::string>());
+		} catch (const std::invalid_argument &e) {
+			std::cerr << "Error: " << e.what() << std::endl;
+			std::cerr << visible_desc;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((!vm["log-level"].defaulted() || !vm["log-format"].defaulted()
+		 || !vm["log-interval"].defaulted())
+		&& vm.count("log") == 0) {
+		std::cerr << "Error: --log-level, --log-format and --log-interval need "
+					 "--log"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	}
+	if (vm.count("log") > 0) {
+		try {
+			GravelBox::parse_log_level(vm.at("log-level").as<std::string>());
+			GravelBox::parse_log_format(vm.at("log-format").as<std::string>());
+		} catch (const std::invalid_argument &e) {
+			std::cerr << "Error: " << e.what() << std::endl;
+			std::cerr << visible_desc;
+			return EXIT_FAILURE;
+		}
+		if (vm.at("log-interval").as<unsigned>() == 0) {
+			std::cerr << "Error: the log interval must be at least a second"
+					  << std::endl;
+			std::cerr << visible_desc;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (vm.count("listen") > 0) {
+		if (vm.count("args") > 0 || vm.count("daemon") > 0
+			|| vm.count("learn") > 0 || vm.count("journal") > 0
+			|| vm.count("dry-run") > 0) {
+			std::cerr << "Error: a daemon does not take a target" << std::endl;
+			std::cerr << visible_desc;
+			return EXIT_FAILURE;
+		}
+	} else if (vm.count("dry-run") > 0
+			   && (vm.count("learn") > 0 || vm.count("journal") > 0)) {
+		std::cerr << "Error: a dry run does not learn or journal decisions"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	} else if (vm.count("dry-run") > 0 && vm.count("daemon") > 0) {
+		std::cerr << "Error: cannot dry run a target run by the daemon"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	} else if (vm.count("learn") > 0 && vm.count("log") > 0) {
+		std::cerr << "Error: --learn and --log are exclusive" << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	} else if (vm.count("log") > 0 && vm.count("daemon") > 0) {
+		std::cerr << "Error: the audit log of the daemon is set when it starts"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	} else if (vm.count("learn") > 0 && vm.count("daemon") > 0) {
+		std::cerr << "Error: cannot learn from a target run by the daemon"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	} else if (vm.at("low-latency").as<bool>() && vm.count("daemon") > 0) {
+		std::cerr << "Error: the low-latency mode of the daemon is set when it "
+					 "starts"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	} else if (vm.count("decision-socket") > 0 && vm.count("daemon") > 0) {
+		std::cerr << "Error: the decision service of the daemon is set when it "
+					 "starts"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	} else if (vm.count("journal") > 0 && vm.count("daemon") > 0) {
+		std::cerr << "Error: cannot journal a target run by the daemon"
+				  << std::endl;
+		std::cerr << visible_desc;
+		return EXIT_FAILURE;
+	} else if (vm.count("args") == 0) {
 		std::cerr << "Error: no target provided" << std::endl;
 		std::cerr << visible_desc;
 		return EXIT_FAILURE;
 	}
 
 	try {
+		if (vm.count("listen") > 0)
+			return GravelBox::serve(vm);
+		if (vm.count("daemon") > 0)
+			return GravelBox::Daemon::run_client(
+				vm.at("daemon").as<std::string>(),
+				vm.at("args").as<std::vector<std::string>>(),
+				vm.count("stdin") == 0 ? "-" : vm.at("stdin").as<std::string>(),
+				vm.count("stdout") == 0 ? "-"
+										: vm.at("stdout").as<std::string>(),
+				vm.at("append-stdout").as<bool>(),
+				vm.count("stderr") == 0 ? "-"
+										: vm.at("stderr").as<std::string>(),
+				vm.at("append-stderr").as<bool>(),
+				vm.at("threads").as<size_t>());
 		return GravelBox::run(vm);
 	} catch (const std::system_error &se) {
 		std::cerr << "System error " << se.code().value() << ": " << se.what()
@@ -73,6 +233,10 @@ int main(int argc, char **argv) {
 		std::cerr << "Configuration error: " << ce.what() << std::endl;
 	} catch (const GravelBox::PinentryException &pe) {
 		std::cerr << "Pinentry error: " << pe.what() << std::endl;
+	} catch (const GravelBox::DecisionServiceException &dse) {
+		std::cerr << "Decision service error: " << dse.what() << std::endl;
+	} catch (const GravelBox::DaemonException &de) {
+		std::cerr << "Daemon error: " << de.what() << std::endl;
 	} catch (const GravelBox::ChildExitException &cee) { return cee.exit_code; }
 	return EXIT_FAILURE;
 }
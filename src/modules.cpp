@@ -2,56 +2,258 @@
 #include <trace/tracer.h>
 #include <parser/parser.h>
 #include <config/file_config.h>
+#include <config/journal.h>
+#include <config/reloading_config.h>
 #include <logger/logger.h>
+#include <logger/learner.h>
 #include <ui/pinentry_ui.h>
+#include <ui/socket_ui.h>
+#include <daemon/server.h>
 
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <iostream>
 #include <memory>
+#include <string>
+#include <system_error>
 #include <vector>
 
 #include <boost/program_options.hpp>
 
 namespace GravelBox {
 
-int run(const boost::program_options::variables_map &vm) {
+/**
+ * Load the configuration and verify its signature.
+ *
+ * @param vm program options.
+ * @param ui the UI to ask for the signing key.
+ * @return the configuration, or `nullptr` if the user cancelled.
+ */
+template <typename UI>
+static std::unique_ptr<FileConfig> load_config(
+	const boost::program_options::variables_map &vm, UI &ui) {
 	auto config = std::make_unique<GravelBox::FileConfig>(
 		vm.at("config").as<std::string>());
 
-	std::unique_ptr<GravelBox::PinentryUI> ui;
-	if (vm.count("pinentry") > 0)
-		ui = std::make_unique<GravelBox::PinentryUI>(
-			vm.at("pinentry").as<std::string>());
 	if (vm.at("no-signature").as<bool>()) {
 		config->dismiss_signature();
 		config->remove_password();
 	} else {
 		constexpr auto message = "Enter the configuration file signing key.";
 		constexpr auto prompt = "key: ";
-		if (ui == nullptr)
-			ui = std::make_unique<GravelBox::PinentryUI>("pinentry");
-		PinentryUI::Password key = ui->ask_password(message, prompt, "");
+		typename UI::Password key = ui.ask_password(message, prompt, "");
 		if (!key)
-			return EXIT_FAILURE;
+			return nullptr;
 		while (!config->verify_signature(std::move(key.password))) {
-			key = ui->ask_password(
+			key = ui.ask_password(
 				message, prompt,
 				"Incorrect key, or the configuration has been changed.");
 			if (!key)
-				return EXIT_FAILURE;
+				return nullptr;
 		}
 	}
-	if (vm.count("pinentry") == 0)
-		ui = std::make_unique<GravelBox::PinentryUI>(config->pinentry());
+	return config;
+}
+
+/**
+ * Return the low-latency mode in the program options.
+ *
+ * @param vm program options.
+ */
+static LowLatency low_latency(const boost::program_options::variables_map &vm) {
+	LowLatency low_latency;
+	low_latency.enabled = vm.at("low-latency").as<bool>();
+	if (vm.count("tracer-cpus") > 0)
+		low_latency.tracer_cpus
+			= parse_cpu_list(vm.at("tracer-cpus").as<std::string>());
+	low_latency.pin_tracees = vm.at("pin-tracees").as<bool>();
+	return low_latency;
+}
+
+/**
+ * Return the audit logger in the program options, which logs nothing without
+ * a log path.
+ *
+ * @param vm program options.
+ */
+static std::unique_ptr<Logger> logger(
+	const boost::program_options::variables_map &vm) {
+	if (vm.count("log") == 0)
+		return std::make_unique<GravelBox::Logger>();
+	return std::make_unique<GravelBox::Logger>(
+		vm.at("log").as<std::string>(),
+		parse_log_level(vm.at("log-level").as<std::string>()),
+		parse_log_format(vm.at("log-format").as<std::string>()),
+		std::chrono::seconds(vm.at("log-interval").as<unsigned>()));
+}
+
+/**
+ * Run the target with the redirections, threads and low-latency mode in the
+ * program options.
+ *
+ * @param tracer the tracer.
+ * @param vm program options.
+ * @return the exit code of the target.
+ */
+template <typename Tracer>
+static int run_target(const Tracer &tracer,
+					  const boost::program_options::variables_map &vm) {
+	return tracer.run(
+		vm.at("args").as<std::vector<std::string>>(),
+		vm.count("stdin") == 0 ? "-" : vm.at("stdin").as<std::string>(),
+		vm.count("stdout") == 0 ? "-" : vm.at("stdout").as<std::string>(),
+		vm.at("append-stdout").as<bool>(),
+		vm.count("stderr") == 0 ? "-" : vm.at("stderr").as<std::string>(),
+		vm.at("append-stderr").as<bool>(), vm.at("threads").as<size_t>(),
+		low_latency(vm));
+}
+
+/**
+ * Run the target with a UI.
+ *
+ * @param vm program options.
+ * @param config the loaded configuration.
+ * @param ui the UI.
+ * @return the exit code of the target.
+ */
+/**
+ * Run the target in a dry run of the configuration, and write the summary to
+ * the path in the program options, or to stderr for "-".
+ *
+ * @param vm program options.
+ * @param config the loaded configuration.
+ * @param ui the UI, which is never asked.
+ * @return the exit code of the target.
+ */
+template <typename UI>
+static int dry_run(const boost::program_options::variables_map &vm,
+				   std::unique_ptr<FileConfig> config, std::unique_ptr<UI> ui) {
+	const std::string &path = vm.at("dry-run").as<std::string>();
+	std::ofstream file;
+	if (path != "-") {
+		file.open(path);
+		if (!file)
+			throw std::system_error(errno, std::system_category(),
+									"Cannot open \"" + path + '"');
+	}
 	auto parser = std::make_unique<GravelBox::Parser>(config->syscalldef());
-	auto logger = std::make_unique<GravelBox::Logger>();
+	// without syscall-exit-stops, paths are resolved from /proc each time
+	parser->cache_paths(false);
+	// the configuration is not reloaded, so each count belongs to one rule
 	GravelBox::Tracer tracer(std::move(parser), std::move(config),
-							 std::move(ui), std::move(logger));
-	return tracer.run(
+							 std::move(ui), logger(vm));
+	return tracer.dry_run(
 		vm.at("args").as<std::vector<std::string>>(),
 		vm.count("stdin") == 0 ? "-" : vm.at("stdin").as<std::string>(),
 		vm.count("stdout") == 0 ? "-" : vm.at("stdout").as<std::string>(),
 		vm.at("append-stdout").as<bool>(),
 		vm.count("stderr") == 0 ? "-" : vm.at("stderr").as<std::string>(),
-		vm.at("append-stderr").as<bool>());
+		vm.at("append-stderr").as<bool>(),
+		path != "-" ? static_cast<std::ostream &>(file) : std::cerr,
+		vm.at("threads").as<size_t>(), low_latency(vm));
+}
+
+template <typename UI>
+static int run_with_ui(const boost::program_options::variables_map &vm,
+					   std::unique_ptr<FileConfig> config,
+					   std::unique_ptr<UI> ui) {
+	if (vm.count("dry-run") > 0)
+		return dry_run(vm, std::move(config), std::move(ui));
+	auto parser = std::make_unique<GravelBox::Parser>(config->syscalldef());
+	std::unique_ptr<GravelBox::Journal> journal;
+	if (vm.count("journal") > 0)
+		journal = std::make_unique<GravelBox::Journal>(
+			vm.at("journal").as<std::string>(),
+			Journal::executable(
+				vm.at("args").as<std::vector<std::string>>().front()),
+			config->digest(), config->sign("GravelBox decision journal"));
+	auto reloading
+		= std::make_unique<GravelBox::ReloadingConfig>(std::move(config));
+	reloading->watch();
+	if (vm.count("learn") > 0) {
+		auto learner = std::make_unique<GravelBox::Learner>(*parser);
+		const GravelBox::Learner &learned = *learner;
+		GravelBox::Tracer tracer(std::move(parser), std::move(reloading),
+								 std::move(ui), std::move(learner),
+								 journal.get());
+		int exit_code = run_target(tracer, vm);
+		learned.emit(vm.at("config").as<std::string>(),
+					 vm.at("learn").as<std::string>());
+		return exit_code;
+	}
+	GravelBox::Tracer tracer(std::move(parser), std::move(reloading),
+							 std::move(ui), logger(vm), journal.get());
+	return run_target(tracer, vm);
+}
+
+int run(const boost::program_options::variables_map &vm) {
+	if (vm.count("decision-socket") > 0) {
+		// the service is also asked for the signing key
+		auto ui = std::make_unique<GravelBox::SocketUI>(
+			vm.at("decision-socket").as<std::string>());
+		auto config = load_config(vm, *ui);
+		if (config == nullptr)
+			return EXIT_FAILURE;
+		return run_with_ui(vm, std::move(config), std::move(ui));
+	}
+	auto ui = std::make_unique<GravelBox::PinentryUI>(
+		vm.count("pinentry") > 0 ? vm.at("pinentry").as<std::string>()
+								 : "pinentry");
+	auto config = load_config(vm, *ui);
+	if (config == nullptr)
+		return EXIT_FAILURE;
+	if (vm.count("pinentry") == 0)
+		ui = std::make_unique<GravelBox::PinentryUI>(config->pinentry());
+	// pinentry starts while the target starts, rather than on the first ask
+	if (config->can_ask() && vm.count("dry-run") == 0)
+		ui->prewarm();
+	return run_with_ui(vm, std::move(config), std::move(ui));
+}
+
+int serve(const boost::program_options::variables_map &vm) {
+	std::unique_ptr<FileConfig> config;
+	if (vm.count("decision-socket") > 0) {
+		GravelBox::SocketUI ui(vm.at("decision-socket").as<std::string>());
+		config = load_config(vm, ui);
+	} else {
+		GravelBox::PinentryUI ui(vm.count("pinentry") > 0
+									 ? vm.at("pinentry").as<std::string>()
+									 : "pinentry");
+		config = load_config(vm, ui);
+	}
+	if (config == nullptr)
+		return EXIT_FAILURE;
+	// each request launches pinentry on the terminal of the client, or
+	// connects to the decision service
+	std::string pinentry = vm.count("pinentry") > 0
+							   ? vm.at("pinentry").as<std::string>()
+							   : config->pinentry();
+	auto parser = std::make_unique<GravelBox::Parser>(config->syscalldef());
+	// the daemon stays single-threaded for fork, so only the children watch
+	// the files, reloading changes made since the daemon started
+	auto reloading
+		= std::make_unique<GravelBox::ReloadingConfig>(std::move(config));
+	return Daemon::serve(
+		vm.at("listen").as<std::string>(),
+		[&](const Daemon::Request &request) {
+			// runs in a forked child, which owns its copy of the modules
+			reloading->watch();
+			auto run_request = [&](auto ui) {
+				GravelBox::Tracer tracer(std::move(parser),
+										 std::move(reloading), std::move(ui),
+										 logger(vm));
+				return tracer.run(request.args, "-", "-", false, "-", false,
+								  request.threads, low_latency(vm));
+			};
+			if (vm.count("decision-socket") > 0)
+				return run_request(std::make_unique<GravelBox::SocketUI>(
+					vm.at("decision-socket").as<std::string>()));
+			auto ui = std::make_unique<GravelBox::PinentryUI>(pinentry);
+			if (reloading->can_ask())
+				ui->prewarm();
+			return run_request(std::move(ui));
+		});
 }
 
 }  // namespace GravelBox
@@ -15,6 +15,16 @@ namespace GravelBox {
  */
 int run(const boost::program_options::variables_map &vm);
 
+/**
+ * Run GravelBox as a daemon with the same modules as `run`.
+ * The configuration is loaded and verified once, and each request from a
+ * client is traced in a forked child process.
+ *
+ * @param vm program options.
+ * @return int program return value.
+ */
+int serve(const boost::program_options::variables_map &vm);
+
 }  // namespace GravelBox
 
 #endif  // MODULES_H_
@@ -1,95 +1,414 @@
 #include "argtypes.h"
+#include "escape.h"
 #include <utils.h>
 
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
+#include <sys/un.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
 #include <cstdint>
-#include <iomanip>
-#include <locale>
-#include <ostream>
+#include <cstring>
+#include <string>
+#include <string_view>
 
 namespace GravelBox {
 
 constexpr size_t kMaxStrLen = 32;
+constexpr size_t kPageSize = 4096;
+// the budgets of an array of strings: the strings, the bytes of a string, the
+// bytes of the first slice of a string, and the bytes of all strings
+constexpr size_t kMaxArrayStrings = 128;
+constexpr size_t kMaxArrayStrLen = 256;
+constexpr size_t kFirstSlice = 64;
+constexpr size_t kMaxArrayBytes = 8192;
 
-void UnknownType::write(std::ostream &os, uint64_t value) const {
-	os << "[0x" << std::hex << value << "]";
+/**
+ * Read target memory that may cross a page boundary.
+ *
+ * @param pid the thread.
+ * @param addr the address in the target.
+ * @param buf the buffer, of at most 1 page.
+ * @param len the number of bytes to read.
+ * @param bytes the number of bytes read, which is less than `len` if the
+ * second page is not readable.
+ * @return false if the first page is not readable.
+ */
+static bool read_memory(pid_t pid, uint64_t addr, char *buf, size_t len,
+						size_t &bytes) {
+	assert(len <= kPageSize);
+	::iovec local = {buf, len};
+	::iovec remote[2] = {{reinterpret_cast<void *>(addr), len}};
+	size_t num_remotes = 1;
+	if (addr / kPageSize != (addr + len - 1) / kPageSize) {
+		remote[0].iov_len = kPageSize - addr % kPageSize;
+		remote[1].iov_base
+			= reinterpret_cast<void *>((addr / kPageSize + 1) * kPageSize);
+		remote[1].iov_len = len - remote[0].iov_len;
+		num_remotes = 2;
+	}
+	try {
+		bytes = Utils::check(
+			::process_vm_readv(pid, &local, 1, remote, num_remotes, 0));
+	} catch (const std::system_error &se) {
+		if (se.code().value() == EFAULT)
+			return false;
+		throw se;
+	}
+	return true;
+}
+
+/**
+ * Read slices of target memory with one vectored read. Slices do not cross a
+ * page boundary, so each is read whole or not at all, and the read stops at
+ * the first slice that faults.
+ *
+ * @param pid the thread.
+ * @param local the buffers.
+ * @param remote the slices, as long as their buffers.
+ * @param count the number of slices.
+ * @return the number of slices read.
+ */
+static size_t read_slices(pid_t pid, const ::iovec *local,
+						  const ::iovec *remote, size_t count) {
+	if (count == 0)
+		return 0;
+	ssize_t bytes = ::process_vm_readv(pid, local, count, remote, count, 0);
+	if (bytes < 0) {
+		if (errno == EFAULT)
+			return 0;
+		Utils::throw_system_error();
+	}
+	size_t slices = 0;
+	for (; slices < count && size_t(bytes) >= remote[slices].iov_len; slices++)
+		bytes -= remote[slices].iov_len;
+	return slices;
+}
+
+/**
+ * Remove empty, "." and ".." components from an absolute path, in place.
+ * The normalized path is never longer, so components are moved forward.
+ */
+static void normalize(std::string &path) {
+	size_t len = 0;
+	size_t pos = 0;
+	while (pos < path.size()) {
+		while (pos < path.size() && path[pos] == '/')
+			pos++;
+		size_t begin = pos;
+		while (pos < path.size() && path[pos] != '/')
+			pos++;
+		std::string_view component(path.data() + begin, pos - begin);
+		if (component.empty() || component == ".")
+			continue;
+		if (component == "..") {
+			len = len == 0 ? 0 : path.rfind('/', len - 1);
+			continue;
+		}
+		path[len++] = '/';
+		std::memmove(&path[len], component.data(), component.size());
+		len += component.size();
+	}
+	path.resize(len == 0 ? 1 : len);
+	path[0] = '/';
+}
+
+/**
+ * Print a path argument, resolved against the working directory of the thread
+ * or a directory fd, and add it to the path arguments. A relative path that
+ * cannot be resolved is printed as is.
+ */
+static void write_path(Rendering &out, PathCache &cache, pid_t pid,
+					   int32_t dirfd, const char *str, size_t len) {
+	if (len == 0) {
+		out.text().append("\"\"");
+		return;
+	}
+	std::string &path = out.scratch();
+	path.clear();
+	if (str[0] != '/') {
+		bool resolved = dirfd == AT_FDCWD ? cache.cwd(pid, path)
+										  : cache.fd(pid, dirfd, path);
+		if (!resolved) {
+			write_quoted(out.text(), str, len);
+			return;
+		}
+		path.push_back('/');
+	}
+	path.append(str, len);
+	normalize(path);
+	out.add_path(path);
+	write_quoted(out.text(), path.data(), path.size());
+}
+
+const char *UnknownType::pattern() const noexcept {
+	return "\\[0x[0-9a-f]+\\]";
+}
+
+void UnknownType::write(Rendering &out, pid_t pid, uint64_t value) const {
+	out.text().append("[0x").hex(value).put(']');
+}
+
+const char *SInt32Type::pattern() const noexcept {
+	return "-?\\d+";
+}
+
+void SInt32Type::write(Rendering &out, pid_t pid, uint64_t value) const {
+	out.text().dec(static_cast<int32_t>(value));
+}
+
+const char *UInt32Type::pattern() const noexcept {
+	return "\\d+";
+}
+
+void UInt32Type::write(Rendering &out, pid_t pid, uint64_t value) const {
+	out.text().dec(static_cast<uint32_t>(value));
+}
+
+const char *SInt64Type::pattern() const noexcept {
+	return "-?\\d+";
 }
 
-void SInt32Type::write(std::ostream &os, uint64_t value) const {
-	os << std::dec << static_cast<int32_t>(value);
+void SInt64Type::write(Rendering &out, pid_t pid, uint64_t value) const {
+	out.text().dec(static_cast<int64_t>(value));
 }
 
-void UInt32Type::write(std::ostream &os, uint64_t value) const {
-	os << std::dec << static_cast<uint32_t>(value);
+const char *UInt64Type::pattern() const noexcept {
+	return "\\d+";
 }
 
-void SInt64Type::write(std::ostream &os, uint64_t value) const {
-	os << std::dec << static_cast<int64_t>(value);
+void UInt64Type::write(Rendering &out, pid_t pid, uint64_t value) const {
+	out.text().dec(value);
 }
 
-void UInt64Type::write(std::ostream &os, uint64_t value) const {
-	os << std::dec << static_cast<uint64_t>(value);
+const char *PtrType::pattern() const noexcept {
+	return "(NULL|0x[0-9a-f]+)";
 }
 
-void PtrType::write(std::ostream &os, uint64_t value) const {
+void PtrType::write(Rendering &out, pid_t pid, uint64_t value) const {
 	if (value == 0)
-		os << "NULL";
+		out.text().append("NULL");
 	else
-		os << "0x" << std::hex << value;
+		out.text().append("0x").hex(value);
 }
 
-void StrType::write(std::ostream &os, uint64_t value) const {
+const char *StrType::pattern() const noexcept {
+	return "(\".*\"(\\.\\.\\.)?|<fault>)";
+}
+
+void StrType::write(Rendering &out, pid_t pid, uint64_t value) const {
 	char buf[kMaxStrLen];
-	::iovec local = {buf, kMaxStrLen};
-	::iovec remote[2] = {{reinterpret_cast<void *>(value), kMaxStrLen}};
-	size_t num_remotes = 1;
-	if (value / 4096 != (value + kMaxStrLen - 1) / 4096) {
-		remote[0].iov_len = 4096 - value % 4096;
-		remote[1].iov_base
-			= reinterpret_cast<void *>((value / 4096 + 1) * 4096);
-		remote[1].iov_len = kMaxStrLen - remote[0].iov_len;
-		num_remotes = 2;
+	size_t bytes;
+	if (!read_memory(pid, value, buf, sizeof(buf), bytes)) {
+		out.text().append("<fault>");
+		return;
+	}
+	size_t len = write_quoted(out.text(), buf, bytes);
+	if (len == kMaxStrLen)
+		out.text().append("...");
+}
+
+const char *StrArrayType::pattern() const noexcept {
+	return "(NULL|<fault>|\\[.*\\])";
+}
+
+void StrArrayType::write(Rendering &out, pid_t pid, uint64_t value) const {
+	Buffer &text = out.text();
+	if (value == 0) {
+		text.append("NULL");
+		return;
 	}
+	// the pointers, and the NULL terminator
+	uint64_t pointers[kMaxArrayStrings + 1];
 	size_t bytes;
-	try {
-		bytes = Utils::check(
-			::process_vm_readv(target_, &local, 1, remote, num_remotes, 0));
-	} catch (const std::system_error &se) {
-		if (se.code().value() == EFAULT) {
-			os << "<fault>";
-			return;
+	if (!read_memory(pid, value, reinterpret_cast<char *>(pointers),
+					 sizeof(pointers), bytes)) {
+		text.append("<fault>");
+		return;
+	}
+	size_t count = 0;
+	while (count < bytes / sizeof(uint64_t) && pointers[count] != 0)
+		count++;
+	bool more = count == bytes / sizeof(uint64_t);
+	count = std::min(count, kMaxArrayStrings);
+
+	// each string is read into a slot of the scratch string: first a slice up
+	// to the end of its page, all in one read, then in a second read, the
+	// rest of the strings without a NUL terminator, and the strings after a
+	// slice that faulted
+	std::string &strings = out.scratch();
+	strings.resize(count * kMaxArrayStrLen);
+	::iovec local[kMaxArrayStrings], remote[kMaxArrayStrings];
+	size_t budget = kMaxArrayBytes;
+	size_t slices = 0;
+	for (; slices < count && budget > 0; slices++) {
+		uint64_t addr = pointers[slices];
+		size_t len
+			= std::min({kFirstSlice, kPageSize - addr % kPageSize, budget});
+		local[slices] = {&strings[slices * kMaxArrayStrLen], len};
+		remote[slices] = {reinterpret_cast<void *>(addr), len};
+		budget -= len;
+	}
+	more = more || slices < count;
+	count = slices;
+	size_t read = read_slices(pid, local, remote, count);
+	// the bytes read of each string
+	size_t lens[kMaxArrayStrings] = {};
+	for (size_t i = 0; i < read; i++)
+		lens[i] = remote[i].iov_len;
+
+	::iovec rest_local[kMaxArrayStrings], rest_remote[kMaxArrayStrings];
+	size_t rest_strings[kMaxArrayStrings];
+	size_t rest = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (i > read) {
+			rest_local[rest] = local[i];
+			rest_remote[rest] = remote[i];
+		} else if (i < read && budget > 0 && lens[i] < kMaxArrayStrLen
+				   && std::memchr(local[i].iov_base, '\0', lens[i])
+						  == nullptr) {
+			uint64_t addr = pointers[i] + lens[i];
+			size_t len = std::min({kMaxArrayStrLen - lens[i],
+								   kPageSize - addr % kPageSize, budget});
+			rest_local[rest] = {&strings[i * kMaxArrayStrLen + lens[i]], len};
+			rest_remote[rest] = {reinterpret_cast<void *>(addr), len};
+			budget -= len;
 		} else {
-			throw se;
+			continue;
 		}
+		rest_strings[rest++] = i;
 	}
-	os << '\"';
-	size_t i;
-	for (i = 0; i < bytes; i++) {
-		if (buf[i] == '\0')
-			break;
-		switch (buf[i]) {
-		case '\\':
-			os << "\\\\";
-			break;
-		case '\n':
-			os << "\\n";
+	size_t rest_read = read_slices(pid, rest_local, rest_remote, rest);
+	for (size_t i = 0; i < rest_read; i++)
+		lens[rest_strings[i]] += rest_remote[i].iov_len;
+
+	text.put('[');
+	for (size_t i = 0; i < count; i++) {
+		if (i > 0)
+			text.append(", ");
+		if (lens[i] == 0) {
+			text.append("<fault>");
+			continue;
+		}
+		if (write_quoted(text, &strings[i * kMaxArrayStrLen], lens[i])
+			== lens[i])
+			text.append("...");
+	}
+	if (more)
+		text.append(count > 0 ? ", ..." : "...");
+	text.put(']');
+}
+
+const char *PathType::pattern() const noexcept {
+	return "(\".*\"(\\.\\.\\.)?|<fault>)";
+}
+
+void PathType::write(Rendering &out, pid_t pid, uint64_t value) const {
+	write_at(out, pid, AT_FDCWD, value);
+}
+
+void PathType::write_at(Rendering &out, pid_t pid, int32_t dirfd,
+						uint64_t value) const {
+	char buf[PATH_MAX];
+	size_t bytes;
+	if (!read_memory(pid, value, buf, sizeof(buf), bytes)) {
+		out.text().append("<fault>");
+		return;
+	}
+	const void *nul = std::memchr(buf, '\0', bytes);
+	size_t len = nul == nullptr ? bytes : static_cast<const char *>(nul) - buf;
+	if (len == sizeof(buf)) {
+		// too long for the kernel, print as is
+		write_quoted(out.text(), buf, len);
+		out.text().append("...");
+		return;
+	}
+	write_path(out, cache_, pid, dirfd, buf, len);
+}
+
+const char *SockAddrType::pattern() const noexcept {
+	return "(NULL|<fault>|<invalid>|\\{.*\\})";
+}
+
+void SockAddrType::write(Rendering &out, pid_t pid, uint64_t value) const {
+	write_len(out, pid, value, sizeof(::sockaddr_storage));
+}
+
+void SockAddrType::write_len(Rendering &out, pid_t pid, uint64_t value,
+							 uint64_t len) const {
+	if (value == 0) {
+		out.text().append("NULL");
+		return;
+	}
+	::sockaddr_storage storage;
+	size_t bytes = 0;
+	if (len >= sizeof(::sa_family_t)
+		&& !read_memory(pid, value, reinterpret_cast<char *>(&storage),
+						std::min<uint64_t>(len, sizeof(storage)), bytes)) {
+		out.text().append("<fault>");
+		return;
+	}
+	Buffer &text = out.text();
+	if (bytes < sizeof(::sa_family_t)) {
+		text.append("<invalid>");
+		return;
+	}
+	switch (storage.ss_family) {
+	case AF_INET: {
+		if (bytes < sizeof(::sockaddr_in))
 			break;
-		case '\t':
-			os << "\\t";
+		const auto &in = reinterpret_cast<const ::sockaddr_in &>(storage);
+		SockAddr address{AF_INET, {}, ntohs(in.sin_port)};
+		std::memcpy(address.addr.data(), &in.sin_addr, sizeof(in.sin_addr));
+		out.add_address(address);
+		char ip[INET_ADDRSTRLEN];
+		::inet_ntop(AF_INET, &in.sin_addr, ip, sizeof(ip));
+		text.append("{AF_INET, ").append(ip).put(':').dec(address.port);
+		text.put('}');
+		return;
+	}
+	case AF_INET6: {
+		if (bytes < sizeof(::sockaddr_in6))
 			break;
-		default:
-			if (std::isprint(buf[i])) {
-				os << buf[i];
-			} else {
-				os << "\\x" << std::hex << std::setfill('0') << std::setw(2)
-				   << static_cast<uint16_t>(buf[i]);
-			}
+		const auto &in6 = reinterpret_cast<const ::sockaddr_in6 &>(storage);
+		SockAddr address{AF_INET6, {}, ntohs(in6.sin6_port)};
+		std::memcpy(address.addr.data(), &in6.sin6_addr,
+					sizeof(in6.sin6_addr));
+		out.add_address(address);
+		char ip[INET6_ADDRSTRLEN];
+		::inet_ntop(AF_INET6, &in6.sin6_addr, ip, sizeof(ip));
+		text.append("{AF_INET6, [").append(ip).append("]:");
+		text.dec(address.port).put('}');
+		return;
+	}
+	case AF_UNIX: {
+		const auto &un = reinterpret_cast<const ::sockaddr_un &>(storage);
+		size_t len = bytes - offsetof(::sockaddr_un, sun_path);
+		text.append("{AF_UNIX");
+		if (len > 0 && un.sun_path[0] == '\0') {
+			// abstract socket, not a path
+			text.append(", @");
+			write_quoted(text, un.sun_path + 1, len - 1);
+		} else if (len > 0) {
+			text.append(", ");
+			write_path(out, cache_, pid, AT_FDCWD, un.sun_path,
+					   ::strnlen(un.sun_path, len));
 		}
+		text.put('}');
+		return;
+	}
+	default:
+		text.append("{family ").dec(storage.ss_family).put('}');
+		return;
 	}
-	os << '\"';
-	if (i == kMaxStrLen)
-		os << "...";
+	text.append("<invalid>");
 }
 
 }  // namespace GravelBox
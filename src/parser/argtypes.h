@@ -1,40 +1,20 @@
 #ifndef ARGTYPES_H_
 #define ARGTYPES_H_
 
-#include <cstdint>
-#include <ostream>
-
-namespace GravelBox {
+#include "path_cache.h"
+#include "rendering.h"
 
-class ArgType;
+#include <sys/types.h>
 
-/**
- * An argument value with type info.
- * This class uses operator<< overload.
- */
-class Arg {
-	friend std::ostream &operator<<(std::ostream &os, const Arg &arg);
-	friend class ArgType;
+#include <cstdint>
 
-  private:
-	const ArgType &type_;
-	uint64_t value_;
-	Arg(const ArgType &type, uint64_t arg) : type_(type), value_(arg) {}
-};
+namespace GravelBox {
 
 /**
  * ABC for all argument types.
  */
 class ArgType {
   public:
-	/**
-	 * Convert the argument register value to an `Arg` object.
-	 *
-	 * @param arg argument register value.
-	 * @return Arg object.
-	 */
-	Arg operator()(uint64_t arg) const noexcept { return {*this, arg}; }
-
 	/**
 	 * Destroy the `ArgType` object
 	 */
@@ -43,94 +23,174 @@ class ArgType {
 	/**
 	 * Print an argument in this type.
 	 *
-	 * @param os the output stream.
+	 * @param out the rendering of the syscall.
+	 * @param pid the pid of the thread that made the syscall.
 	 * @param value argument register value.
 	 */
-	virtual void write(std::ostream &os, uint64_t value) const = 0;
-};
+	virtual void write(Rendering &out, pid_t pid, uint64_t value) const = 0;
 
-/**
- * Operator overload for argument output.
- *
- * @param os an output stream
- * @param arg an `ArgWriter` object
- * @return `os`
- */
-inline std::ostream &operator<<(std::ostream &os, const Arg &arg) {
-	arg.type_.write(os, arg.value_);
-	return os;
-}
+	/**
+	 * Return a regular expression matching any printed value of this type.
+	 *
+	 * @return the regular expression.
+	 */
+	virtual const char *pattern() const noexcept = 0;
+};
 
 /**
  * Unknown argument type.
  */
 struct UnknownType : public ArgType {
-	void write(std::ostream &os, uint64_t value) const override;
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
 };
 
 /**
  * Signed 32-bit integer type.
  */
 struct SInt32Type : public ArgType {
-	void write(std::ostream &os, uint64_t value) const override;
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
 };
 
 /**
  * Unsigned 32-bit integer type.
  */
 struct UInt32Type : public ArgType {
-	void write(std::ostream &os, uint64_t value) const override;
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
 };
 
 /**
  * Signed 64-bit integer type.
  */
 struct SInt64Type : public ArgType {
-	void write(std::ostream &os, uint64_t value) const override;
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
 };
 
 /**
  * Unsigned 64-bit integer type.
  */
 struct UInt64Type : public ArgType {
-	void write(std::ostream &os, uint64_t value) const override;
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
 };
 
+/**
+ * Directory fd type.
+ * Printed as a signed 32-bit integer. A following path argument of the same
+ * syscall is resolved against this directory.
+ */
+struct DirFdType : public SInt32Type {};
+
 /**
  * Pointer type.
  * Printed in hexadecimal.
  */
 struct PtrType : public ArgType {
-	void write(std::ostream &os, uint64_t value) const override;
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
 };
 
 /**
  * ABC of all types that requires memory reading.
+ * The memory is read from the thread passed to `write`, so a single instance
+ * can be shared by all tracer threads.
+ */
+class MemType : public ArgType {};
+
+/**
+ * String type.
+ * Print as string, which requires reading target memory.
+ */
+class StrType : public MemType {
+  public:
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
+};
+
+/**
+ * Array of strings type, e.g. the argv and envp of `execve`.
+ * Printed as `["ls", "-l"]`, which requires reading target memory: the
+ * pointer array, then all strings with one vectored read, and the strings
+ * that go on past their first slice with a second one. The number of
+ * strings and the bytes read are bounded; a longer string is followed by
+ * `...`, and a longer array ends with `...`.
  */
-class MemType : public ArgType {
+class StrArrayType : public MemType {
+  public:
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
+};
+
+/**
+ * Path type.
+ * Printed as an absolute path without "." and ".." components, which requires
+ * reading target memory. Relative paths are resolved against the working
+ * directory of the thread, or a directory fd. Paths are not truncated.
+ */
+class PathType : public MemType {
   public:
 	/**
-	 * Construct a MemType with target pid.
+	 * Construct a PathType.
 	 *
-	 * @param target the target pid.
+	 * @param cache the cache of working directories and directory fds.
 	 */
-	explicit MemType(const pid_t &target) : target_(target) {}
+	explicit PathType(PathCache &cache) noexcept : cache_(cache) {}
+
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
 
-  protected:
 	/**
-	 * Target pid.
+	 * Print a path relative to a directory fd. The resolved absolute path is
+	 * also added to the path arguments.
+	 *
+	 * @param out the rendering of the syscall.
+	 * @param pid the pid of the thread that made the syscall.
+	 * @param dirfd the directory fd, or `AT_FDCWD`.
+	 * @param value argument register value.
 	 */
-	const pid_t &target_;
+	void write_at(Rendering &out, pid_t pid, int32_t dirfd,
+				  uint64_t value) const;
+
+  private:
+	PathCache &cache_;
 };
 
 /**
- * String type.
- * Print as string, which requires reading target memory.
+ * Socket address type.
+ * Printed as `{AF_INET, 127.0.0.1:80}`, `{AF_INET6, [::1]:80}` or
+ * `{AF_UNIX, "/run/socket"}`, which requires reading target memory. The
+ * length of the address is the next parameter of the syscall. IPv4 and IPv6
+ * addresses are added to the socket address arguments, and Unix socket paths
+ * are resolved like `PathType` and added to the path arguments.
  */
-class StrType : public MemType {
+class SockAddrType : public MemType {
   public:
-	using MemType::MemType;
-	void write(std::ostream &os, uint64_t value) const override;
+	/**
+	 * Construct a SockAddrType.
+	 *
+	 * @param cache the cache of working directories.
+	 */
+	explicit SockAddrType(PathCache &cache) noexcept : cache_(cache) {}
+
+	void write(Rendering &out, pid_t pid, uint64_t value) const override;
+	const char *pattern() const noexcept override;
+
+	/**
+	 * Print a socket address of a given length.
+	 *
+	 * @param out the rendering of the syscall.
+	 * @param pid the pid of the thread that made the syscall.
+	 * @param value argument register value.
+	 * @param len the length argument.
+	 */
+	void write_len(Rendering &out, pid_t pid, uint64_t value,
+				   uint64_t len) const;
+
+  private:
+	PathCache &cache_;
 };
 
 }  // namespace GravelBox
@@ -1,14 +1,16 @@
 #ifndef DEBUG_PARSER_H_
 #define DEBUG_PARSER_H_
 
+#include "rendering.h"
 #include <type_traits.h>
 #include <utils.h>
 
 #include <sys/user.h>
 #include <sys/types.h>
 
-#include <sstream>
-#include <string>
+#include <cstdint>
+#include <optional>
+#include <string_view>
 
 namespace GravelBox {
 
@@ -21,28 +23,43 @@ class DebugParser {
 	/**
 	 * Parse syscall registers to debug strings.
 	 *
-	 * @param regs user registers at syscall entry.
+	 * @param pid the pid of the thread that made the syscall (unused).
+	 * @param args user registers at syscall entry.
+	 * @param out the rendering, cleared first. No paths are added.
 	 * @return a string representation of the syscall with arguments.
 	 */
-	std::string operator()(const Utils::SyscallArgs &args) const noexcept {
-		std::ostringstream oss;
-		oss << "syscall("
-			<< std::dec
-			<< args.number << ", "
-			<< std::hex
-			<< "0x" << args.args[0] << ", "
-			<< "0x" << args.args[1] << ", "
-			<< "0x" << args.args[2] << ", "
-			<< "0x" << args.args[3] << ", "
-			<< "0x" << args.args[4] << ", "
-			<< "0x" << args.args[5] << ')';
-		return oss.str();
+	std::string_view operator()(pid_t, const Utils::SyscallArgs &args,
+								Rendering &out) const noexcept {
+		out.clear();
+		out.text().append("syscall(").dec(args.number);
+		for (size_t i = 0; i < 6; i++)
+			out.text().append(", 0x").hex(args.args[i]);
+		out.text().put(')');
+		out.finish();
+		return out.str();
 	}
 
 	/**
-	 * no-op.
+	 * Look up a syscall number by name.
+	 *
+	 * @param name the syscall function name (unused).
+	 * @return `std::nullopt`, syscalls have no names.
+	 */
+	std::optional<uint64_t> number(const std::string &) const noexcept {
+		return std::nullopt;
+	}
+
+	/**
+	 * Check if paths are resolved.
+	 *
+	 * @return false, arguments are printed as numbers.
+	 */
+	bool resolves_paths() const noexcept { return false; }
+
+	/**
+	 * Ignore returned syscalls.
 	 */
-	void setpid(pid_t) const noexcept {}
+	void exited(pid_t, const Utils::SyscallArgs &, int64_t) noexcept {}
 };
 
 static_assert(IsParser<DebugParser>::value,
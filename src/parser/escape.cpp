@@ -0,0 +1,115 @@
+#include "escape.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace GravelBox {
+
+static inline bool clean(char c) noexcept {
+	return c >= 0x20 && c < 0x7f && c != '\\';
+}
+
+size_t clean_span_scalar(const char *str, size_t len) noexcept {
+	size_t i = 0;
+	while (i < len && clean(str[i]))
+		i++;
+	return i;
+}
+
+#ifdef __SSE2__
+
+// Bytes compare as signed, so bytes >= 0x80 are below 0x20 and not clean.
+
+static size_t clean_span_sse2(const char *str, size_t len) noexcept {
+	const __m128i low = _mm_set1_epi8(0x1f);
+	const __m128i high = _mm_set1_epi8(0x7f);
+	const __m128i backslash = _mm_set1_epi8('\\');
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i bytes
+			= _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i));
+		__m128i ok = _mm_andnot_si128(
+			_mm_cmpeq_epi8(bytes, backslash),
+			_mm_and_si128(_mm_cmpgt_epi8(bytes, low),
+						  _mm_cmplt_epi8(bytes, high)));
+		uint32_t dirty = ~_mm_movemask_epi8(ok) & 0xffff;
+		if (dirty != 0)
+			return i + __builtin_ctz(dirty);
+	}
+	return i + clean_span_scalar(str + i, len - i);
+}
+
+#ifdef __x86_64__
+__attribute__((target("avx2"))) static size_t
+clean_span_avx2(const char *str, size_t len) noexcept {
+	const __m256i low = _mm256_set1_epi8(0x1f);
+	const __m256i high = _mm256_set1_epi8(0x7f);
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i bytes
+			= _mm256_loadu_si256(reinterpret_cast<const __m256i *>(str + i));
+		__m256i ok = _mm256_andnot_si256(
+			_mm256_cmpeq_epi8(bytes, backslash),
+			_mm256_and_si256(_mm256_cmpgt_epi8(bytes, low),
+							 _mm256_cmpgt_epi8(high, bytes)));
+		uint32_t dirty = ~static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+		if (dirty != 0)
+			return i + __builtin_ctz(dirty);
+	}
+	return i + clean_span_sse2(str + i, len - i);
+}
+#endif  // __x86_64__
+
+#endif  // __SSE2__
+
+size_t clean_span(const char *str, size_t len) noexcept {
+#if defined(__SSE2__) && defined(__x86_64__)
+	static const auto impl
+		= __builtin_cpu_supports("avx2") ? clean_span_avx2 : clean_span_sse2;
+	return impl(str, len);
+#elif defined(__SSE2__)
+	return clean_span_sse2(str, len);
+#else
+	return clean_span_scalar(str, len);
+#endif
+}
+
+size_t write_quoted(Buffer &out, const char *str, size_t len) {
+	static constexpr char kHex[] = "0123456789abcdef";
+	out.put('\"');
+	size_t i = 0;
+	while (true) {
+		size_t run = clean_span(str + i, len - i);
+		out.append(std::string_view(str + i, run));
+		i += run;
+		if (i == len || str[i] == '\0')
+			break;
+		switch (str[i]) {
+		case '\\':
+			out.append("\\\\");
+			break;
+		case '\n':
+			out.append("\\n");
+			break;
+		case '\t':
+			out.append("\\t");
+			break;
+		default: {
+			auto byte = static_cast<uint8_t>(str[i]);
+			char escaped[] = {'\\', 'x', kHex[byte >> 4], kHex[byte & 0xf]};
+			out.append(std::string_view(escaped, sizeof(escaped)));
+		}
+		}
+		i++;
+	}
+	out.put('\"');
+	return i;
+}
+
+}  // namespace GravelBox
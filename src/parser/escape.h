@@ -0,0 +1,48 @@
+#ifndef ESCAPE_H_
+#define ESCAPE_H_
+
+#include "rendering.h"
+
+#include <cstddef>
+
+namespace GravelBox {
+
+/**
+ * Find the end of the leading run of bytes that are printed as is.
+ * The run ends at a NUL terminator, or at a byte that must be escaped: a
+ * backslash, or a byte outside of printable ASCII.
+ *
+ * Uses AVX2 if the CPU supports it, and SSE2 otherwise. The result is the same
+ * as `clean_span_scalar`.
+ *
+ * @param str the string.
+ * @param len the maximum number of bytes to scan.
+ * @return the length of the run, or `len` if there is no such byte.
+ */
+size_t clean_span(const char *str, size_t len) noexcept;
+
+/**
+ * Scalar implementation of `clean_span`.
+ *
+ * @param str the string.
+ * @param len the maximum number of bytes to scan.
+ * @return the length of the run, or `len` if there is no such byte.
+ */
+size_t clean_span_scalar(const char *str, size_t len) noexcept;
+
+/**
+ * Print a string in double quotes, up to a NUL terminator. Runs of printable
+ * bytes are copied in bulk; backslashes, newlines and tabs are escaped with a
+ * backslash, and other bytes are printed as `\xNN`.
+ *
+ * @param out the output buffer.
+ * @param str the string.
+ * @param len the maximum number of bytes to print.
+ * @return the number of bytes before the NUL terminator, or `len` if there
+ * is none.
+ */
+size_t write_quoted(Buffer &out, const char *str, size_t len);
+
+}  // namespace GravelBox
+
+#endif  // ESCAPE_H_
@@ -7,6 +7,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 #include <json/json.h>
 
@@ -17,7 +18,7 @@ namespace GravelBox {
 	throw ConfigException(path, "syscall definition", details);
 }
 
-Parser::Parser(const std::string &def) : str_(target_) {
+Parser::Parser(const std::string &def) {
 	try {
 		std::ifstream config(def, std::ios::binary);
 		if (!config)
@@ -40,6 +41,8 @@ Parser::Parser(const std::string &def) : str_(target_) {
 			sanitize(params.isArray(), "parameter definition is not an array");
 			for (const Json::Value &param : params) {
 				std::string param_str = param.asString();
+				if (param_str == "path" || param_str == "sockaddr*")
+					resolves_paths_ = true;
 				try {
 					syscalldef.add_param(argtypes_.at(param_str));
 				} catch (const std::out_of_range &e) {
@@ -55,17 +58,47 @@ Parser::Parser(const std::string &def) : str_(target_) {
 	} catch (const Json::Exception &je) { error(def, je.what()); }
 }
 
-std::string Parser::operator()(const Utils::SyscallArgs &args) const noexcept {
-	std::ostringstream oss;
-	if (args.int80 || syscall_map_.count(args.number) == 0) {
-		oss << (args.int80 ? "syscall32(" : "syscall(") << std::dec
-			<< args.number << ", " << std::hex;
+std::string_view Parser::operator()(pid_t pid,
+									const Utils::SyscallArgs &args,
+									Rendering &out) const noexcept {
+	out.clear();
+	auto it = args.int80 ? syscall_map_.end() : syscall_map_.find(args.number);
+	if (it == syscall_map_.end()) {
+		out.text().append(args.int80 ? "syscall32(" : "syscall(").dec(
+			args.number);
 		for (size_t i = 0; i < 6; i++)
-			oss << "0x" << args.args[i] << (i < 5 ? ", " : ")");
+			out.text().append(", 0x").hex(args.args[i]);
+		out.text().put(')');
 	} else {
-		syscall_map_.at(args.number).write(oss, args.args);
+		it->second.write(out, pid, args.args);
 	}
+	out.finish();
+	return out.str();
+}
+
+std::string Parser::pattern(pid_t pid, const Utils::SyscallArgs &args) const {
+	std::ostringstream oss;
+	if (args.int80 || syscall_map_.count(args.number) == 0)
+		oss << (args.int80 ? "syscall32\\(" : "syscall\\(") << std::dec
+			<< args.number << ", .*\\)";
+	else
+		syscall_map_.at(args.number).write_pattern(oss, pid, args.args);
 	return oss.str();
 }
 
+std::optional<uint64_t> Parser::number(const std::string &name) const
+	noexcept {
+	for (const auto &[number, def] : syscall_map_)
+		if (def.name() == name)
+			return number;
+	return std::nullopt;
+}
+
+bool Parser::reads_memory(const Utils::SyscallArgs &args) const noexcept {
+	if (args.int80)
+		return false;
+	auto it = syscall_map_.find(args.number);
+	return it != syscall_map_.end() && it->second.reads_memory();
+}
+
 }  // namespace GravelBox
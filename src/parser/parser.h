@@ -2,14 +2,19 @@
 #define PARSER_H_
 
 #include "argtypes.h"
+#include "path_cache.h"
+#include "rendering.h"
 #include "syscalldef.h"
 #include <type_traits.h>
 #include <utils.h>
 
 #include <sys/types.h>
 
+#include <cstdint>
 #include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 namespace GravelBox {
@@ -29,36 +34,102 @@ class Parser {
 
 	/**
 	 * Parse syscall registers to human readable strings.
+	 * The parser holds no per-target state, so it can be shared by all tracer
+	 * threads, each rendering into its own `Rendering`.
 	 *
+	 * @param pid the pid of the thread that made the syscall. The pid is used
+	 * to parse string arguments, which requires reading the target's memory.
 	 * @param args user registers at syscall entry.
-	 * @return a string representation of the syscall with arguments.
+	 * @param out the rendering, cleared first. The resolved path arguments are
+	 * added to it.
+	 * @return a string representation of the syscall with arguments, valid
+	 * until `out` is reused.
 	 */
-	std::string operator()(const Utils::SyscallArgs &args) const noexcept;
+	std::string_view operator()(pid_t pid, const Utils::SyscallArgs &args,
+								Rendering &out) const noexcept;
 
 	/**
-	 * Set the pid of the target.
-	 * The pid is used to parse string arguments, which requires reading the
-	 * target's memory.
+	 * Build a regular expression matching the string representation of the
+	 * syscall, and of any call to the same syscall that only differs in
+	 * arguments not read from memory.
 	 *
-	 * @param pid the pid of the target.
+	 * @param pid the pid of the thread that made the syscall.
+	 * @param args user registers at syscall entry.
+	 * @return the regular expression.
+	 */
+	std::string pattern(pid_t pid, const Utils::SyscallArgs &args) const;
+
+	/**
+	 * Check if the string representation of a syscall depends on target
+	 * memory.
+	 *
+	 * @param args user registers at syscall entry.
+	 * @return true if any argument of the syscall is read from memory.
+	 */
+	bool reads_memory(const Utils::SyscallArgs &args) const noexcept;
+
+	/**
+	 * Look up the x86-64 number of a syscall by name.
+	 *
+	 * @param name the syscall function name.
+	 * @return the syscall number, or `std::nullopt` if it is not defined.
+	 */
+	std::optional<uint64_t> number(const std::string &name) const noexcept;
+
+	/**
+	 * Check if any syscall has path parameters, which are resolved with the
+	 * cached working directory and directory fds of the tracees.
+	 *
+	 * @return true if the parser needs to see `exited` calls.
+	 */
+	bool resolves_paths() const noexcept {
+		return resolves_paths_ && path_cache_.enabled();
+	}
+
+	/**
+	 * Enable or disable the cache of the working directories and directory
+	 * fds, before the tracees start. Without it, paths are resolved by
+	 * reading `/proc` each time, and the parser needs no `exited` calls.
+	 *
+	 * @param cache whether to cache.
+	 */
+	void cache_paths(bool cache) noexcept { path_cache_.enable(cache); }
+
+	/**
+	 * Update the cached working directories and directory fds after a
+	 * syscall returns, or a tracee exits.
+	 *
+	 * @param pid the thread that made the syscall.
+	 * @param args user registers at syscall entry.
+	 * @param rval the return value of the syscall.
 	 */
-	void setpid(pid_t pid) { target_ = pid; }
+	void exited(pid_t pid, const Utils::SyscallArgs &args,
+				int64_t rval) noexcept {
+		path_cache_.exited(pid, args, rval);
+	}
 
   private:
-	pid_t target_;
 	UnknownType unknown_;
 	SInt32Type sint32_;
 	UInt32Type uint32_;
 	SInt64Type sint64_;
 	UInt64Type uint64_;
 	StrType str_;
+	StrArrayType str_array_;
 	PtrType ptr_;
+	PathCache path_cache_;
+	PathType path_{path_cache_};
+	DirFdType dirfd_;
+	SockAddrType sockaddr_{path_cache_};
 	const std::unordered_map<std::string, std::reference_wrapper<const ArgType>>
-		argtypes_{{"unknown", unknown_}, {"flags", uint64_},
-				  {"int32_t", sint32_},  {"uint32_t", uint32_},
-				  {"int64_t", sint64_},  {"uint64_t", uint64_},
-				  {"char*", str_},       {"void*", ptr_}};
+		argtypes_{{"unknown", unknown_},    {"flags", uint64_},
+				  {"int32_t", sint32_},     {"uint32_t", uint32_},
+				  {"int64_t", sint64_},     {"uint64_t", uint64_},
+				  {"char*", str_},          {"char**", str_array_},
+				  {"void*", ptr_},          {"path", path_},
+				  {"dirfd", dirfd_},        {"sockaddr*", sockaddr_}};
 	std::unordered_map<uint64_t, SyscallDef> syscall_map_;
+	bool resolves_paths_ = false;
 };
 
 static_assert(IsParser<Parser>::value, "Parser does not fulfill Parser");
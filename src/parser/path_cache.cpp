@@ -0,0 +1,127 @@
+#include "path_cache.h"
+
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace GravelBox {
+
+/**
+ * Read an absolute path from a symbolic link in `/proc`.
+ *
+ * @return the path, or an empty string if the link cannot be read or does not
+ * point to a path (e.g. "pipe:[1234]").
+ */
+static std::string read_path(const std::string &link) {
+	char path[PATH_MAX];
+	ssize_t len = ::readlink(link.c_str(), path, sizeof(path));
+	if (len <= 0 || path[0] != '/')
+		return {};
+	return std::string(path, len);
+}
+
+bool PathCache::cwd(pid_t pid, std::string &path) {
+	if (!enabled_) {
+		path = read_path("/proc/" + std::to_string(pid) + "/cwd");
+		return !path.empty();
+	}
+	uint64_t generation;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = processes_.find(pid);
+		if (it != processes_.end() && !it->second.cwd.empty()) {
+			path = it->second.cwd;
+			return true;
+		}
+		generation = generation_;
+	}
+	path = read_path("/proc/" + std::to_string(pid) + "/cwd");
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (generation == generation_)
+		processes_[pid].cwd = path;
+	return !path.empty();
+}
+
+bool PathCache::fd(pid_t pid, int32_t fd, std::string &path) {
+	if (!enabled_) {
+		path = read_path("/proc/" + std::to_string(pid) + "/fd/"
+						 + std::to_string(fd));
+		return !path.empty();
+	}
+	uint64_t generation;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = processes_.find(pid);
+		if (it != processes_.end()) {
+			auto cached = it->second.fds.find(fd);
+			if (cached != it->second.fds.end()) {
+				path = cached->second;
+				return true;
+			}
+		}
+		generation = generation_;
+	}
+	path = read_path("/proc/" + std::to_string(pid) + "/fd/"
+					 + std::to_string(fd));
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (generation == generation_ && !path.empty())
+		processes_[pid].fds[fd] = path;
+	return !path.empty();
+}
+
+void PathCache::exited(pid_t pid, const Utils::SyscallArgs &args,
+					   int64_t rval) noexcept {
+	if (args.int80)
+		return;
+	const auto &a = args.args;
+	std::lock_guard<std::mutex> lock(mutex_);
+	switch (args.number) {
+	case SYS_exit:
+	case SYS_exit_group:
+		processes_.erase(pid);
+		break;
+	case SYS_execve:
+	case SYS_execveat:
+		// close-on-exec fds are closed
+		if (rval == 0)
+			processes_.erase(pid);
+		break;
+	case SYS_chdir:
+	case SYS_fchdir:
+		if (rval == 0)
+			for (auto &process : processes_)
+				process.second.cwd.clear();
+		break;
+	case SYS_close:
+		forget_fd(a[0]);
+		break;
+	case SYS_close_range:
+		for (auto &process : processes_) {
+			auto &fds = process.second.fds;
+			for (auto it = fds.begin(); it != fds.end();)
+				if (static_cast<uint32_t>(it->first) >= a[0]
+					&& static_cast<uint32_t>(it->first) <= a[1])
+					it = fds.erase(it);
+				else
+					++it;
+		}
+		break;
+	case SYS_dup2:
+	case SYS_dup3:
+		if (rval >= 0)
+			forget_fd(a[1]);
+		break;
+	default:
+		// other syscalls that create fds take the lowest free fd, which
+		// was forgotten when it was closed
+		return;
+	}
+	generation_++;
+}
+
+void PathCache::forget_fd(int32_t fd) noexcept {
+	for (auto &process : processes_)
+		process.second.fds.erase(fd);
+}
+
+}  // namespace GravelBox
@@ -0,0 +1,89 @@
+#ifndef PATH_CACHE_H_
+#define PATH_CACHE_H_
+
+#include <utils.h>
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace GravelBox {
+
+/**
+ * Cache of the working directories and the directory fds of the tracees,
+ * read from `/proc/<pid>/cwd` and `/proc/<pid>/fd/<n>`.
+ *
+ * Entries are invalidated when a syscall that changes them returns. Threads
+ * may share their working directory or fds, so a change made by one thread
+ * invalidates the entries of all threads. A disabled cache reads `/proc` for
+ * every path, and needs no `exited` calls.
+ *
+ * All methods are thread-safe.
+ */
+class PathCache {
+  public:
+	/**
+	 * Enable or disable the cache, before the tracees start.
+	 *
+	 * @param enabled whether paths are cached.
+	 */
+	void enable(bool enabled) noexcept { enabled_ = enabled; }
+
+	/**
+	 * Check if paths are cached.
+	 *
+	 * @return true if the cache needs `exited` calls.
+	 */
+	bool enabled() const noexcept { return enabled_; }
+
+	/**
+	 * Get the working directory of a tracee.
+	 *
+	 * @param pid the thread.
+	 * @param path set to the absolute path. Its memory is reused.
+	 * @return false if the working directory cannot be read.
+	 */
+	bool cwd(pid_t pid, std::string &path);
+
+	/**
+	 * Get the path of an fd of a tracee.
+	 *
+	 * @param pid the thread.
+	 * @param fd the fd.
+	 * @param path set to the absolute path. Its memory is reused.
+	 * @return false if the fd does not refer to a path.
+	 */
+	bool fd(pid_t pid, int32_t fd, std::string &path);
+
+	/**
+	 * Invalidate the entries changed by a syscall after it returns.
+	 *
+	 * @param pid the thread that made the syscall.
+	 * @param args user registers at syscall entry.
+	 * @param rval the return value of the syscall.
+	 */
+	void exited(pid_t pid, const Utils::SyscallArgs &args,
+				int64_t rval) noexcept;
+
+  private:
+	struct Process {
+		std::string cwd;
+		std::unordered_map<int32_t, std::string> fds;
+	};
+
+	bool enabled_ = true;
+	std::mutex mutex_;
+	std::unordered_map<pid_t, Process> processes_;
+	// incremented on every invalidation, so that a path read concurrently
+	// with an invalidation is not cached
+	uint64_t generation_ = 0;
+
+	void forget_fd(int32_t fd) noexcept;
+};
+
+}  // namespace GravelBox
+
+#endif  // PATH_CACHE_H_
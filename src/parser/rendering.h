@@ -0,0 +1,216 @@
+#ifndef RENDERING_H_
+#define RENDERING_H_
+
+#include <array>
+#include <cassert>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace GravelBox {
+
+/**
+ * An append-only text buffer with integer formatting.
+ * Clearing the buffer keeps its memory, so a reused buffer stops allocating
+ * once it has grown to the longest text.
+ */
+class Buffer {
+  public:
+	/**
+	 * Append a character.
+	 *
+	 * @param c the character.
+	 * @return Buffer& this
+	 */
+	Buffer &put(char c) {
+		data_.push_back(c);
+		return *this;
+	}
+
+	/**
+	 * Append a string.
+	 *
+	 * @param s the string.
+	 * @return Buffer& this
+	 */
+	Buffer &append(std::string_view s) {
+		data_.append(s);
+		return *this;
+	}
+
+	/**
+	 * Append an integer in decimal.
+	 *
+	 * @tparam T an integer type.
+	 * @param value the integer.
+	 * @return Buffer& this
+	 */
+	template <typename T>
+	Buffer &dec(T value) {
+		static_assert(std::is_integral<T>::value, "dec takes an integer");
+		char digits[24];
+		auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+		assert(ec == std::errc());
+		data_.append(digits, end - digits);
+		return *this;
+	}
+
+	/**
+	 * Append an integer in lowercase hexadecimal, without prefix.
+	 *
+	 * @param value the integer.
+	 * @return Buffer& this
+	 */
+	Buffer &hex(uint64_t value) {
+		char digits[16];
+		auto [end, ec]
+			= std::to_chars(digits, digits + sizeof(digits), value, 16);
+		assert(ec == std::errc());
+		data_.append(digits, end - digits);
+		return *this;
+	}
+
+	/**
+	 * Return the text.
+	 *
+	 * @return std::string_view the text, valid until the buffer is changed.
+	 */
+	std::string_view view() const noexcept { return data_; }
+
+	/**
+	 * Remove the text, keeping the memory.
+	 */
+	void clear() noexcept { data_.clear(); }
+
+  private:
+	std::string data_;
+};
+
+/**
+ * An IPv4 or IPv6 socket address argument.
+ */
+struct SockAddr {
+	/**
+	 * `AF_INET` or `AF_INET6`.
+	 */
+	int family;
+
+	/**
+	 * The address in network byte order. IPv4 addresses use the first 4 bytes.
+	 */
+	std::array<uint8_t, 16> addr;
+
+	/**
+	 * The port in host byte order.
+	 */
+	uint16_t port;
+};
+
+/**
+ * The rendering of a syscall: its string representation, and its resolved
+ * path and socket address arguments.
+ *
+ * A tracer thread reuses one `Rendering` for all syscalls, and its memory is
+ * kept between syscalls, so rendering a syscall allocates nothing in the
+ * steady state. The views returned by a `Rendering` are valid until it is
+ * cleared.
+ */
+class Rendering {
+  public:
+	/**
+	 * Return the buffer of the string representation.
+	 *
+	 * @return Buffer& the buffer.
+	 */
+	Buffer &text() noexcept { return text_; }
+
+	/**
+	 * Return a scratch string for argument types, e.g. to resolve a path.
+	 * Its content is undefined between uses.
+	 *
+	 * @return std::string& the scratch string.
+	 */
+	std::string &scratch() noexcept { return scratch_; }
+
+	/**
+	 * Add a resolved path argument.
+	 *
+	 * @param path the absolute path.
+	 */
+	void add_path(std::string_view path) {
+		path_data_.append(path);
+		path_ends_.push_back(path_data_.size());
+	}
+
+	/**
+	 * Add an IPv4 or IPv6 socket address argument.
+	 *
+	 * @param address the address.
+	 */
+	void add_address(const SockAddr &address) {
+		addresses_.push_back(address);
+	}
+
+	/**
+	 * Build the views of the path arguments once all arguments are added.
+	 */
+	void finish() {
+		paths_.clear();
+		size_t begin = 0;
+		for (size_t end : path_ends_) {
+			paths_.emplace_back(path_data_.data() + begin, end - begin);
+			begin = end;
+		}
+	}
+
+	/**
+	 * Return the string representation.
+	 *
+	 * @return std::string_view the string.
+	 */
+	std::string_view str() const noexcept { return text_.view(); }
+
+	/**
+	 * Return the path arguments, after `finish`.
+	 *
+	 * @return const std::vector<std::string_view>& the paths.
+	 */
+	const std::vector<std::string_view> &paths() const noexcept {
+		return paths_;
+	}
+
+	/**
+	 * Return the IPv4 and IPv6 socket address arguments.
+	 *
+	 * @return const std::vector<SockAddr>& the addresses.
+	 */
+	const std::vector<SockAddr> &addresses() const noexcept {
+		return addresses_;
+	}
+
+	/**
+	 * Remove the rendering, keeping the memory.
+	 */
+	void clear() noexcept {
+		text_.clear();
+		path_data_.clear();
+		path_ends_.clear();
+		paths_.clear();
+		addresses_.clear();
+	}
+
+  private:
+	Buffer text_;
+	std::string scratch_;
+	std::string path_data_;
+	std::vector<size_t> path_ends_;
+	std::vector<std::string_view> paths_;
+	std::vector<SockAddr> addresses_;
+};
+
+}  // namespace GravelBox
+
+#endif  // RENDERING_H_
@@ -2,12 +2,19 @@
 #define SYSCALLDEF_H_
 
 #include "argtypes.h"
+#include "rendering.h"
+#include <utils.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
 
 #include <array>
 #include <cassert>
 #include <cstdint>
 #include <functional>
 #include <ostream>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -35,37 +42,118 @@ class SyscallDef {
 	 * @param def SyscallDef to be moved.
 	 */
 	SyscallDef(SyscallDef &&def)
-		: fname_(std::move(def.fname_)), argtypes_(std::move(def.argtypes_)) {}
+		: fname_(std::move(def.fname_)), argtypes_(std::move(def.argtypes_)),
+		  dirfds_(std::move(def.dirfds_)), dirfd_(def.dirfd_) {}
 
 	/**
 	 * Add a parameter type to the syscall.
+	 * A path parameter is resolved against the last directory fd parameter
+	 * before it, and a socket address parameter has the length given by the
+	 * parameter after it.
 	 *
 	 * @param type the next parameter type.
 	 */
-	void add_param(const ArgType &type) { argtypes_.emplace_back(type); }
+	void add_param(const ArgType &type) {
+		dirfds_.push_back(dirfd_);
+		if (dynamic_cast<const DirFdType *>(&type) != nullptr)
+			dirfd_ = argtypes_.size();
+		argtypes_.emplace_back(type);
+	}
+
+	/**
+	 * Return the syscall function name.
+	 *
+	 * @return const std::string& the function name.
+	 */
+	const std::string &name() const noexcept { return fname_; }
 
 	/**
 	 * Write the human readable string of the syscall.
 	 *
+	 * @param out the rendering of the syscall.
+	 * @param pid the pid of the thread that made the syscall.
+	 * @param args syscall argument registers.
+	 */
+	void write(Rendering &out, pid_t pid,
+			   const std::array<uint64_t, 6> &args) const {
+		assert(argtypes_.size() <= 6);
+		out.text().append(fname_).put('(');
+		for (size_t i = 0; i < argtypes_.size(); i++) {
+			if (i > 0)
+				out.text().append(", ");
+			write_arg(out, pid, args, i);
+		}
+		out.text().put(')');
+	}
+
+	/**
+	 * Write a regular expression matching the human readable string of the
+	 * syscall, and of any call that only differs in arguments not read from
+	 * memory. Arguments read from memory are matched literally.
+	 *
 	 * @param os output stream.
+	 * @param pid the pid of the thread that made the syscall.
 	 * @param args syscall argument registers.
 	 * @return `os`
 	 */
-	std::ostream &write(std::ostream &os,
-						const std::array<uint64_t, 6> &args) const {
+	std::ostream &write_pattern(std::ostream &os, pid_t pid,
+								const std::array<uint64_t, 6> &args) const {
 		assert(argtypes_.size() <= 6);
-		os << fname_ << '(';
+		os << fname_ << "\\(";
 		for (size_t i = 0; i < argtypes_.size(); i++) {
 			if (i > 0)
 				os << ", ";
-			os << argtypes_[i](args[i]);
+			const ArgType &type = argtypes_[i];
+			if (dynamic_cast<const MemType *>(&type) != nullptr) {
+				Rendering value;
+				write_arg(value, pid, args, i);
+				os << Utils::escape_regex(std::string(value.str()));
+			} else {
+				os << type.pattern();
+			}
 		}
-		return os << ')';
+		return os << "\\)";
+	}
+
+	/**
+	 * Check if any argument is read from memory.
+	 *
+	 * @return true if the human readable string depends on target memory.
+	 */
+	bool reads_memory() const noexcept {
+		for (const ArgType &type : argtypes_)
+			if (dynamic_cast<const MemType *>(&type) != nullptr)
+				return true;
+		return false;
 	}
 
   private:
+	static constexpr size_t kNoDirFd = -1;
+
 	std::string fname_;
 	std::vector<std::reference_wrapper<const ArgType>> argtypes_;
+	// index of the directory fd parameter for each parameter
+	std::vector<size_t> dirfds_;
+	size_t dirfd_ = kNoDirFd;
+
+	void write_arg(Rendering &out, pid_t pid,
+				   const std::array<uint64_t, 6> &args, size_t i) const {
+		const ArgType &type = argtypes_[i];
+		auto path = dynamic_cast<const PathType *>(&type);
+		if (path != nullptr)
+			path->write_at(out, pid,
+						   dirfds_[i] == kNoDirFd
+							   ? AT_FDCWD
+							   : static_cast<int32_t>(args[dirfds_[i]]),
+						   args[i]);
+		else if (auto addr = dynamic_cast<const SockAddrType *>(&type))
+			addr->write_len(out, pid, args[i],
+							i + 1 < argtypes_.size()
+								? args[i + 1]
+								: sizeof(::sockaddr_storage));
+		else
+			type.write(out, pid, args[i]);
+	}
 };
 
 }  // namespace GravelBox
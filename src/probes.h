@@ -0,0 +1,120 @@
+#ifndef PROBES_H_
+#define PROBES_H_
+
+// USDT (SystemTap-style) static probes, readable by perf, bpftrace and
+// SystemTap. The ELF notes are emitted directly, so neither <sys/sdt.h> nor a
+// special build is needed.
+//
+// A probe is a single `nop` until a tool attaches to it. Every probe has a
+// semaphore, which attached tools increment, so arguments that cost something
+// to compute (e.g. timestamps) are only computed while someone listens.
+//
+// All arguments are passed as signed 64-bit integers. For example:
+//
+//   bpftrace -e 'usdt:bin/gravelbox:gravelbox:parse { @[arg1] = hist(arg2); }'
+
+#include <time.h>
+
+#include <cstdint>
+
+/**
+ * Declare the semaphore of a probe.
+ */
+#define GRAVELBOX_PROBE_SEMAPHORE(name)                                       \
+	extern "C" {                                                              \
+	__attribute__((used, section(".probes"))) inline volatile unsigned short \
+		gravelbox_##name##_semaphore = 0;                                     \
+	}
+
+// the probes of the tracer, see the README for their arguments
+GRAVELBOX_PROBE_SEMAPHORE(syscall_enter)
+GRAVELBOX_PROBE_SEMAPHORE(parse)
+GRAVELBOX_PROBE_SEMAPHORE(config)
+GRAVELBOX_PROBE_SEMAPHORE(ask_start)
+GRAVELBOX_PROBE_SEMAPHORE(ask_done)
+GRAVELBOX_PROBE_SEMAPHORE(resume)
+GRAVELBOX_PROBE_SEMAPHORE(queued)
+GRAVELBOX_PROBE_SEMAPHORE(batch)
+
+/**
+ * Check whether a tool is attached to a probe.
+ */
+#define GRAVELBOX_PROBE_ENABLED(name) \
+	__builtin_expect(gravelbox_##name##_semaphore != 0, 0)
+
+// The note layout is the one of <sys/sdt.h>: the probe address, the base
+// address used to detect prelinking, the semaphore address, the provider, the
+// name and the argument formats.
+#define GRAVELBOX_PROBE_ASM(name, formats, ...)                    \
+	__asm__ __volatile__(                                          \
+		"990: nop\n"                                               \
+		".pushsection .note.stapsdt,\"?\",\"note\"\n"              \
+		".balign 4\n"                                              \
+		".4byte 992f-991f, 994f-993f, 3\n"                         \
+		"991: .asciz \"stapsdt\"\n"                                \
+		"992: .balign 4\n"                                         \
+		"993: .8byte 990b\n"                                       \
+		".8byte _.stapsdt.base\n"                                  \
+		".8byte gravelbox_" #name "_semaphore\n"                   \
+		".asciz \"gravelbox\"\n"                                   \
+		".asciz \"" #name "\"\n"                                   \
+		".asciz \"" formats "\"\n"                                 \
+		"994: .balign 4\n"                                         \
+		".popsection\n"                                            \
+		".ifndef _.stapsdt.base\n"                                 \
+		".pushsection .stapsdt.base,\"aG\",\"progbits\","          \
+		".stapsdt.base,comdat\n"                                   \
+		".weak _.stapsdt.base\n"                                   \
+		".hidden _.stapsdt.base\n"                                 \
+		"_.stapsdt.base: .space 1\n"                               \
+		".size _.stapsdt.base, 1\n"                                \
+		".popsection\n"                                            \
+		".endif\n" ::__VA_ARGS__)
+
+#define GRAVELBOX_PROBE_ARG(x) "nor"(static_cast<int64_t>(x))
+
+#define GRAVELBOX_PROBE2(name, a, b)                              \
+	GRAVELBOX_PROBE_ASM(name, "-8@%0 -8@%1", GRAVELBOX_PROBE_ARG(a), \
+						GRAVELBOX_PROBE_ARG(b))
+#define GRAVELBOX_PROBE3(name, a, b, c)                                 \
+	GRAVELBOX_PROBE_ASM(name, "-8@%0 -8@%1 -8@%2", GRAVELBOX_PROBE_ARG(a), \
+						GRAVELBOX_PROBE_ARG(b), GRAVELBOX_PROBE_ARG(c))
+#define GRAVELBOX_PROBE4(name, a, b, c, d)                                  \
+	GRAVELBOX_PROBE_ASM(name, "-8@%0 -8@%1 -8@%2 -8@%3",                   \
+						GRAVELBOX_PROBE_ARG(a), GRAVELBOX_PROBE_ARG(b),    \
+						GRAVELBOX_PROBE_ARG(c), GRAVELBOX_PROBE_ARG(d))
+
+namespace GravelBox {
+
+/**
+ * Timestamps for the elapsed time passed to probes.
+ */
+namespace Probes {
+
+/**
+ * Return a timestamp if a probe is enabled.
+ *
+ * @param enabled whether the probe is enabled.
+ * @return uint64_t the monotonic time in nanoseconds, or 0 if not enabled.
+ */
+inline uint64_t start(bool enabled) noexcept {
+	if (!enabled)
+		return 0;
+	timespec ts;
+	::clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Return the nanoseconds elapsed since a timestamp.
+ *
+ * @param start the timestamp from `start`, which must not be 0.
+ */
+inline int64_t elapsed(uint64_t start) noexcept {
+	return Probes::start(true) - start;
+}
+
+}  // namespace Probes
+}  // namespace GravelBox
+
+#endif  // PROBES_H_
@@ -0,0 +1,127 @@
+// A reference decision service, for testing `--decision-socket`. It allows
+// the syscalls matching a regular expression, denies the others, and answers
+// password requests with $GRAVELBOX_PASSWORD, cancelling them if that
+// password was rejected.
+
+#include <ui/decision_protocol.h>
+#include <utils.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+using GravelBox::Utils::check;
+using GravelBox::DecisionService::Message;
+using GravelBox::DecisionService::Type;
+
+static std::mutex output_mutex;
+
+/**
+ * Answer the requests of a connection, in order, until it is closed.
+ */
+static void serve(GravelBox::Utils::Fd conn, const std::regex &allow) {
+	const char *password = std::getenv("GRAVELBOX_PASSWORD");
+	try {
+		while (std::optional<Message> message
+			   = GravelBox::DecisionService::recv(conn)) {
+			Message reply{message->id, Type::REPLY, ""};
+			switch (message->type) {
+			case Type::ASK: {
+				if (message->payload.size() < sizeof(uint32_t))
+					throw std::system_error(EPROTO, std::system_category(),
+											"Truncated message");
+				std::string syscall = message->payload.substr(sizeof(uint32_t));
+				bool allowed = std::regex_match(syscall, allow);
+				reply.payload = std::string(1, allowed);
+				std::lock_guard<std::mutex> lock(output_mutex);
+				std::cout << (allowed ? "allow: " : "deny: ") << syscall
+						  << std::endl;
+				break;
+			}
+			case Type::PASSWORD:
+				// the password has no second chance after an error, which is
+				// the last field
+				if (password != nullptr && message->payload.size() >= 2
+					&& message->payload.compare(message->payload.size() - 2, 2,
+												std::string(2, '\0'))
+						   == 0)
+					reply.payload = std::string(1, true) + password;
+				else
+					reply.payload = std::string(1, false);
+				break;
+			default:
+				// a withdrawn request was already answered
+				continue;
+			}
+			GravelBox::DecisionService::send(conn, reply);
+		}
+	} catch (const std::exception &e) {
+		std::lock_guard<std::mutex> lock(output_mutex);
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2 && argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <socket> [allowed-regex]"
+				  << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::string socket_path = argv[1];
+	try {
+		std::regex allow(argc == 3 ? argv[2] : "$^");
+		::sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (socket_path.size() >= sizeof(addr.sun_path))
+			throw std::system_error(ENAMETOOLONG, std::system_category(),
+									"Socket path too long");
+		std::strcpy(addr.sun_path, socket_path.c_str());
+		GravelBox::Utils::Fd sock(
+			check(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)));
+		struct ::stat st;
+		if (::lstat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+			check(::unlink(socket_path.c_str()));  // stale socket
+		mode_t umask = ::umask(S_IRWXG | S_IRWXO);
+		int r = ::bind(sock, reinterpret_cast<const ::sockaddr *>(&addr),
+					   sizeof(addr));
+		::umask(umask);
+		check(r);
+		check(::listen(sock, SOMAXCONN));
+		while (true) {
+			int fd = ::accept4(sock, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd < 0) {
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				GravelBox::Utils::throw_system_error();
+			}
+			GravelBox::Utils::Fd conn(fd);
+			::ucred cred;
+			socklen_t len = sizeof(cred);
+			check(::getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len));
+			if (cred.uid != ::getuid())
+				continue;
+			std::thread(serve, std::move(conn), std::cref(allow)).detach();
+		}
+	} catch (const std::regex_error &e) {
+		std::cerr << "Invalid regex: " << e.what() << std::endl;
+	} catch (const std::system_error &se) {
+		std::cerr << "System error " << se.code().value() << ": " << se.what()
+				  << std::endl;
+	}
+	return EXIT_FAILURE;
+}
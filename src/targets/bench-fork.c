@@ -0,0 +1,43 @@
+#define _GNU_SOURCE
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Chains of fork and exec of this program: measures attaching to new tracees
+ * and the syscalls of process startup. Usage: bench-fork [processes]
+ */
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "--child") == 0)
+		return EXIT_SUCCESS;
+
+	size_t n = bench_arg(argc, argv, 1, 500);
+	struct bench b;
+	bench_init(&b, n);
+	for (size_t i = 0; i < n; i++) {
+		uint64_t start = bench_now();
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return EXIT_FAILURE;
+		}
+		if (pid == 0) {
+			execl("/proc/self/exe", argv[0], "--child", (char *)NULL);
+			perror("execl");
+			_exit(EXIT_FAILURE);
+		}
+		int status;
+		if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+			|| WEXITSTATUS(status) != EXIT_SUCCESS) {
+			fprintf(stderr, "Error: child %d failed\n", pid);
+			return EXIT_FAILURE;
+		}
+		bench_record(&b, bench_now() - start);
+	}
+	bench_report(&b, "fork");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+#define _GNU_SOURCE
+#include "bench.h"
+
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * A tight loop of getpid, the cheapest syscall: measures the fixed cost of a
+ * syscall stop. Usage: bench-getpid [iterations]
+ */
+int main(int argc, char **argv) {
+	size_t n = bench_arg(argc, argv, 1, 200000);
+	struct bench b;
+	bench_init(&b, n);
+	for (size_t i = 0; i < n; i++) {
+		uint64_t start = bench_now();
+		// glibc may cache getpid, so make the syscall directly
+		syscall(SYS_getpid);
+		bench_record(&b, bench_now() - start);
+	}
+	bench_report(&b, "getpid");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+#define _GNU_SOURCE
+#include "bench.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Threads copying blocks from /dev/zero to /dev/null: measures contention
+ * between tracees, and between tracer threads with --threads.
+ * Usage: bench-io [threads] [blocks per thread]
+ */
+
+#define BLOCK_SIZE 4096
+
+struct worker {
+	pthread_t thread;
+	size_t blocks;
+	int in;
+	int out;
+	struct bench bench;
+};
+
+static void *work(void *arg) {
+	struct worker *w = arg;
+	char block[BLOCK_SIZE];
+	for (size_t i = 0; i < w->blocks; i++) {
+		uint64_t start = bench_now();
+		if (read(w->in, block, sizeof(block)) < 0
+			|| write(w->out, block, sizeof(block)) < 0) {
+			perror("Error");
+			break;
+		}
+		bench_record(&w->bench, bench_now() - start);
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	size_t threads = bench_arg(argc, argv, 1, 4);
+	size_t blocks = bench_arg(argc, argv, 2, 50000);
+	struct worker *workers = calloc(threads, sizeof(struct worker));
+	if (workers == NULL) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < threads; i++) {
+		workers[i].blocks = blocks;
+		workers[i].in = open("/dev/zero", O_RDONLY);
+		workers[i].out = open("/dev/null", O_WRONLY);
+		if (workers[i].in < 0 || workers[i].out < 0) {
+			perror("Error");
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct bench b;
+	bench_init(&b, threads * blocks);
+	for (size_t i = 0; i < threads; i++) {
+		bench_init(&workers[i].bench, blocks);
+		if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0) {
+			perror("pthread_create");
+			return EXIT_FAILURE;
+		}
+	}
+	for (size_t i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		bench_merge(&b, &workers[i].bench);
+		close(workers[i].in);
+		close(workers[i].out);
+	}
+	bench_report(&b, "io");
+	free(workers);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+#define _GNU_SOURCE
+#include "bench.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * openat/close storms over many distinct paths: measures path rendering and
+ * rule matching. The files are created in a temporary directory, which is
+ * removed afterwards. Usage: bench-open [files] [rounds]
+ */
+int main(int argc, char **argv) {
+	size_t files = bench_arg(argc, argv, 1, 1000);
+	size_t rounds = bench_arg(argc, argv, 2, 20);
+	const char *tmp = getenv("TMPDIR");
+	char dir[PATH_MAX];
+	snprintf(dir, sizeof(dir), "%s/gravelbox-bench-XXXXXX", tmp ? tmp : "/tmp");
+	if (mkdtemp(dir) == NULL) {
+		perror(dir);
+		return EXIT_FAILURE;
+	}
+	char path[PATH_MAX];
+	for (size_t i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/file-%zu", dir, i);
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			perror(path);
+			return EXIT_FAILURE;
+		}
+		close(fd);
+	}
+
+	struct bench b;
+	bench_init(&b, files * rounds);
+	bool failure = false;
+	for (size_t r = 0; r < rounds && !failure; r++) {
+		for (size_t i = 0; i < files; i++) {
+			snprintf(path, sizeof(path), "%s/file-%zu", dir, i);
+			uint64_t start = bench_now();
+			int fd = openat(AT_FDCWD, path, O_RDONLY);
+			if (fd < 0) {
+				perror(path);
+				failure = true;
+				break;
+			}
+			close(fd);
+			bench_record(&b, bench_now() - start);
+		}
+	}
+	bench_report(&b, "open");
+
+	for (size_t i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/file-%zu", dir, i);
+		unlink(path);
+	}
+	rmdir(dir);
+	return failure ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/*
+ * Latency recording for the benchmark targets.
+ *
+ * A benchmark records the latency of every operation and prints one line:
+ *   <name> ops=<n> seconds=<s> ops_per_sec=<r> p50_us=<us> p99_us=<us>
+ *   p999_us=<us> max_us=<us>
+ * Timestamps come from the vDSO clock, so timing adds no syscalls to trace.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct bench {
+	uint64_t *samples;
+	size_t count;
+	size_t capacity;
+	uint64_t start;
+	uint64_t end;
+};
+
+static inline uint64_t bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static inline void bench_init(struct bench *b, size_t capacity) {
+	b->samples = malloc((capacity ? capacity : 1) * sizeof(uint64_t));
+	if (b->samples == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	b->count = 0;
+	b->capacity = capacity;
+	b->start = b->end = bench_now();
+}
+
+static inline void bench_record(struct bench *b, uint64_t ns) {
+	if (b->count < b->capacity)
+		b->samples[b->count++] = ns;
+}
+
+/* Append the samples of `other`, e.g. of another thread, and free them. */
+static inline void bench_merge(struct bench *b, struct bench *other) {
+	size_t n = other->count;
+	if (n > b->capacity - b->count)
+		n = b->capacity - b->count;
+	memcpy(b->samples + b->count, other->samples, n * sizeof(uint64_t));
+	b->count += n;
+	free(other->samples);
+	other->samples = NULL;
+}
+
+static int bench_compare(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static inline double bench_percentile(const struct bench *b, double p) {
+	if (b->count == 0)
+		return 0;
+	size_t i = (size_t)(p * (double)(b->count - 1) + 0.5);
+	return (double)b->samples[i] / 1000;
+}
+
+/* Stop the clock and print the report line. */
+static inline void bench_report(struct bench *b, const char *name) {
+	b->end = bench_now();
+	qsort(b->samples, b->count, sizeof(uint64_t), bench_compare);
+	double seconds = (double)(b->end - b->start) / 1e9;
+	printf("%s ops=%zu seconds=%.3f ops_per_sec=%.0f p50_us=%.2f p99_us=%.2f "
+		   "p999_us=%.2f max_us=%.2f\n",
+		   name, b->count, seconds, seconds > 0 ? b->count / seconds : 0,
+		   bench_percentile(b, 0.5), bench_percentile(b, 0.99),
+		   bench_percentile(b, 0.999), bench_percentile(b, 1));
+	free(b->samples);
+	b->samples = NULL;
+}
+
+/* Parse a positive count argument, or return `fallback` if absent. */
+static inline size_t bench_arg(int argc, char **argv, int i, size_t fallback) {
+	if (i >= argc)
+		return fallback;
+	char *end;
+	unsigned long long n = strtoull(argv[i], &end, 10);
+	if (*argv[i] == '\0' || *end != '\0' || n == 0) {
+		fprintf(stderr, "Error: invalid count \"%s\"\n", argv[i]);
+		exit(EXIT_FAILURE);
+	}
+	return (size_t)n;
+}
+
+#endif  // BENCH_H_
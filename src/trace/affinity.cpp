@@ -0,0 +1,165 @@
+#include "affinity.h"
+#include <utils.h>
+
+#include <sched.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace GravelBox {
+
+std::vector<int> parse_cpu_list(const std::string &list) {
+	auto number = [&list](size_t begin, size_t end) {
+		if (begin == end || end - begin > 4
+			|| !std::all_of(list.begin() + begin, list.begin() + end,
+							[](char c) { return c >= '0' && c <= '9'; }))
+			throw std::invalid_argument("Invalid CPU list \"" + list + '"');
+		return std::atoi(list.substr(begin, end - begin).c_str());
+	};
+	std::vector<int> cpus;
+	size_t end = list.find_last_not_of(" \n");
+	end = end == std::string::npos ? 0 : end + 1;
+	for (size_t begin = 0; begin < end;) {
+		size_t comma = std::min(list.find(',', begin), end);
+		size_t dash = std::min(list.find('-', begin), comma);
+		int first = number(begin, dash);
+		int last = dash == comma ? first : number(dash + 1, comma);
+		if (last < first)
+			throw std::invalid_argument("Invalid CPU list \"" + list + '"');
+		for (int cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+		begin = comma + 1;
+	}
+	if (cpus.empty())
+		throw std::invalid_argument("Invalid CPU list \"" + list + '"');
+	return cpus;
+}
+
+namespace TracerDetails {
+
+/**
+ * Return the CPUs the calling thread may run on.
+ */
+static std::vector<int> allowed_cpus() {
+	cpu_set_t set;
+	if (::sched_getaffinity(0, sizeof(set), &set) < 0)
+		Utils::throw_system_error();
+	std::vector<int> cpus;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &set))
+			cpus.push_back(cpu);
+	return cpus;
+}
+
+/**
+ * Return a CPU list from sysfs, or nothing if the kernel does not export it.
+ */
+static std::vector<int> sysfs_cpus(int cpu, const std::string &file) {
+	std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + '/'
+					 + file);
+	std::string list;
+	if (!std::getline(in, list))
+		return {};
+	try {
+		return parse_cpu_list(list);
+	} catch (const std::invalid_argument &) { return {}; }
+}
+
+/**
+ * Return the CPU nearest to another: an SMT sibling, or else a CPU sharing
+ * the last level cache, or else the CPU with the closest number.
+ *
+ * @param cpu the CPU.
+ * @param candidates the CPUs to choose from, not empty.
+ */
+static int nearest(int cpu, const std::vector<int> &candidates) {
+	std::vector<int> siblings
+		= sysfs_cpus(cpu, "topology/thread_siblings_list");
+	std::vector<int> cache = sysfs_cpus(cpu, "cache/index3/shared_cpu_list");
+	if (cache.empty())
+		cache = sysfs_cpus(cpu, "cache/index2/shared_cpu_list");
+	auto distance = [&](int other) {
+		auto has = [other](const std::vector<int> &cpus) {
+			return std::find(cpus.begin(), cpus.end(), other) != cpus.end();
+		};
+		return std::make_pair(has(siblings) ? 0 : has(cache) ? 1 : 2,
+							  std::abs(other - cpu));
+	};
+	return *std::min_element(
+		candidates.begin(), candidates.end(),
+		[&](int a, int b) { return distance(a) < distance(b); });
+}
+
+std::vector<Placement> place(size_t threads, const LowLatency &low_latency) {
+	std::vector<int> allowed = allowed_cpus();
+	for (int cpu : low_latency.tracer_cpus)
+		if (std::find(allowed.begin(), allowed.end(), cpu) == allowed.end())
+			throw std::system_error(EINVAL, std::system_category(),
+									"CPU " + std::to_string(cpu)
+										+ " is not available");
+
+	// tracer threads take the designated CPUs, or else the last free ones,
+	// sharing CPUs only if there are too few
+	const std::vector<int> &designated = low_latency.tracer_cpus;
+	std::vector<Placement> placements(threads);
+	std::vector<int> free = allowed;
+	for (size_t i = 0; i < threads; i++) {
+		int &tracer = placements[i].tracer;
+		if (!designated.empty())
+			tracer = designated[i % designated.size()];
+		else if (!free.empty())
+			tracer = free.back();
+		else
+			tracer = allowed[allowed.size() - 1 - i % allowed.size()];
+		free.erase(std::remove(free.begin(), free.end(), tracer), free.end());
+	}
+
+	// the tracees get the free CPU nearest to their tracer thread
+	for (Placement &placement : placements) {
+		std::vector<int> others = free;
+		if (others.empty())
+			for (int cpu : allowed)
+				if (cpu != placement.tracer)
+					others.push_back(cpu);
+		placement.tracees
+			= others.empty() ? placement.tracer
+							 : nearest(placement.tracer, others);
+		free.erase(std::remove(free.begin(), free.end(), placement.tracees),
+				   free.end());
+		placement.spins
+			= placement.tracees != placement.tracer
+			  && std::count_if(placements.begin(), placements.end(),
+							   [&placement](const Placement &other) {
+								   return other.tracer == placement.tracer;
+							   })
+					 == 1;
+		if (!low_latency.pin_tracees)
+			placement.tracees = -1;
+	}
+	return placements;
+}
+
+void pin_self(int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (::sched_setaffinity(0, sizeof(set), &set) < 0)
+		throw std::system_error(errno, std::system_category(),
+								"Cannot pin a tracer thread to CPU "
+									+ std::to_string(cpu));
+}
+
+void pin(pid_t tid, int cpu) noexcept {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	::sched_setaffinity(tid, sizeof(set), &set);
+}
+
+}  // namespace TracerDetails
+}  // namespace GravelBox
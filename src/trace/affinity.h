@@ -0,0 +1,93 @@
+#ifndef AFFINITY_H_
+#define AFFINITY_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace GravelBox {
+
+/**
+ * The low-latency mode of the tracer.
+ *
+ * Every ptrace stop wakes a tracer thread, usually on another CPU, and that
+ * wakeup dominates the cost of a short syscall. In low-latency mode, each
+ * tracer thread is pinned to a CPU of its own, and polls for stops for a
+ * short adaptive interval before blocking in `waitpid`. Its tracees may be
+ * pinned to a nearby CPU (an SMT sibling, or else a CPU sharing the last level
+ * cache), so the stops are handed over through a shared cache.
+ */
+struct LowLatency {
+	/**
+	 * Whether low-latency mode is on.
+	 */
+	bool enabled = false;
+
+	/**
+	 * The CPUs of the tracer threads, in order, or empty to choose them near
+	 * the target.
+	 */
+	std::vector<int> tracer_cpus;
+
+	/**
+	 * Whether the tracees are pinned near the CPU of their tracer thread.
+	 */
+	bool pin_tracees = false;
+};
+
+/**
+ * Parse a CPU list, e.g. "0-3,8".
+ *
+ * @param list the list, in the format of sysfs and `taskset -c`.
+ * @return std::vector<int> the CPUs, in order.
+ * @throw std::invalid_argument if the list is malformed.
+ */
+std::vector<int> parse_cpu_list(const std::string &list);
+
+namespace TracerDetails {
+
+/**
+ * The CPUs of a tracer thread and of its tracees.
+ */
+struct Placement {
+	int tracer = -1;     // -1 if not pinned
+	int tracees = -1;    // -1 if not pinned
+	bool spins = false;  // whether the tracer thread polls before blocking
+};
+
+/**
+ * Place the tracer threads on the CPUs the process may run on, as far as
+ * possible from CPU 0, where most interrupts and housekeeping land. The
+ * tracees of a tracer thread get the CPU nearest to it. A tracer thread only
+ * spins if it has a CPU of its own.
+ *
+ * @param threads the number of tracer threads.
+ * @param low_latency the options, which must be enabled.
+ * @return std::vector<Placement> the placement of each tracer thread.
+ * @throw std::system_error if a designated CPU is not available.
+ */
+std::vector<Placement> place(size_t threads, const LowLatency &low_latency);
+
+/**
+ * Pin the calling thread to a CPU.
+ *
+ * @param cpu the CPU.
+ * @throw std::system_error on failure.
+ */
+void pin_self(int cpu);
+
+/**
+ * Pin a tracee to a CPU. A tracee that vanished, or changed its credentials,
+ * is left as it is.
+ *
+ * @param tid the tracee.
+ * @param cpu the CPU.
+ */
+void pin(pid_t tid, int cpu) noexcept;
+
+}  // namespace TracerDetails
+}  // namespace GravelBox
+
+#endif  // AFFINITY_H_
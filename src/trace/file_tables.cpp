@@ -0,0 +1,190 @@
+#include "file_tables.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <cassert>
+
+namespace GravelBox {
+
+namespace TracerDetails {
+
+/**
+ * Return the `/proc` path of an fd of a tracee.
+ */
+static std::string proc_fd(pid_t tid, uint64_t fd) {
+	return "/proc/" + std::to_string(tid) + "/fd/" + std::to_string(fd);
+}
+
+bool FileTables::tracks(const Utils::SyscallArgs &args) noexcept {
+	if (args.int80)
+		return false;
+	switch (args.number) {
+	case SYS_open:
+	case SYS_creat:
+	case SYS_openat:
+	case SYS_openat2:
+	case SYS_socket:
+	case SYS_dup:
+	case SYS_dup2:
+	case SYS_dup3:
+	case SYS_close:
+		return true;
+	case SYS_fcntl:
+		return args.args[1] == F_DUPFD || args.args[1] == F_DUPFD_CLOEXEC;
+	default:
+		return false;
+	}
+}
+
+void FileTables::update(pid_t tid, const Utils::SyscallArgs &args,
+						int64_t rval) {
+	assert(tracks(args));
+	const auto &a = args.args;
+	if (args.number == SYS_close) {
+		// the fd is released even if close fails
+		close(tid, a[0]);
+		return;
+	}
+	if (rval < 0)
+		return;
+	switch (args.number) {
+	case SYS_open:
+		add(tid, rval, a[1] & O_CLOEXEC);
+		break;
+	case SYS_creat:
+		add(tid, rval, false);
+		break;
+	case SYS_openat:
+		add(tid, rval, a[2] & O_CLOEXEC);
+		break;
+	case SYS_openat2:
+		// the flags are in target memory, assume the fd is dropped on exec
+		add(tid, rval, true);
+		break;
+	case SYS_socket:
+		add(tid, rval, a[1] & SOCK_CLOEXEC);
+		break;
+	case SYS_dup:
+		dup(tid, a[0], rval, false);
+		break;
+	case SYS_dup2:
+		dup(tid, a[0], a[1], false);
+		break;
+	case SYS_dup3:
+		dup(tid, a[0], a[1], a[2] & O_CLOEXEC);
+		break;
+	case SYS_fcntl:
+		dup(tid, a[0], rval, a[1] == F_DUPFD_CLOEXEC);
+		break;
+	}
+}
+
+bool FileTables::allowed(pid_t tid, uint64_t fd) {
+	dev_t dev;
+	ino_t ino;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto table = tables_.find(tid);
+		if (table == tables_.end())
+			return false;
+		auto file = table->second->find(fd);
+		if (file == table->second->end())
+			return false;
+		dev = file->second.dev;
+		ino = file->second.ino;
+	}
+	struct stat st;
+	if (::stat(proc_fd(tid, fd).c_str(), &st) == 0 && st.st_dev == dev
+		&& st.st_ino == ino)
+		return true;
+	// closed or replaced by a syscall that is not tracked
+	close(tid, fd);
+	return false;
+}
+
+std::string FileTables::path(pid_t tid, uint64_t fd) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto table = tables_.find(tid);
+	if (table == tables_.end())
+		return {};
+	auto file = table->second->find(fd);
+	return file == table->second->end() ? std::string() : file->second.path;
+}
+
+void FileTables::clone(pid_t parent, pid_t child, bool share) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	table(parent);
+	std::shared_ptr<Table> parent_table = tables_.at(parent);
+	tables_[child]
+		= share ? parent_table : std::make_shared<Table>(*parent_table);
+}
+
+void FileTables::exec(pid_t former, pid_t tid) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto table = tables_.find(former);
+	if (table == tables_.end()) {
+		tables_.erase(tid);
+		return;
+	}
+	auto unshared = std::make_shared<Table>();
+	for (const auto &[fd, file] : *table->second)
+		if (!file.cloexec)
+			unshared->emplace(fd, file);
+	tables_.erase(table);
+	tables_[tid] = std::move(unshared);
+}
+
+void FileTables::exit(pid_t tid) noexcept {
+	std::lock_guard<std::mutex> lock(mutex_);
+	tables_.erase(tid);
+}
+
+FileTables::Table &FileTables::table(pid_t tid) {
+	std::shared_ptr<Table> &table = tables_[tid];
+	if (table == nullptr)
+		table = std::make_shared<Table>();
+	return *table;
+}
+
+void FileTables::add(pid_t tid, uint64_t fd, bool cloexec) {
+	std::string proc_path = proc_fd(tid, fd);
+	struct stat st;
+	char path[PATH_MAX];
+	ssize_t len = ::readlink(proc_path.c_str(), path, sizeof(path));
+	if (::stat(proc_path.c_str(), &st) < 0 || len < 0) {
+		// closed by another thread
+		close(tid, fd);
+		return;
+	}
+	File file = {std::string(path, len), st.st_dev, st.st_ino, cloexec};
+	std::lock_guard<std::mutex> lock(mutex_);
+	table(tid)[fd] = std::move(file);
+}
+
+void FileTables::dup(pid_t tid, uint64_t oldfd, uint64_t newfd, bool cloexec) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Table &t = table(tid);
+	auto file = t.find(oldfd);
+	if (file == t.end()) {
+		t.erase(newfd);
+		return;
+	}
+	File copy = file->second;
+	copy.cloexec = cloexec;
+	t[newfd] = std::move(copy);
+}
+
+void FileTables::close(pid_t tid, uint64_t fd) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto table = tables_.find(tid);
+	if (table != tables_.end())
+		table->second->erase(fd);
+}
+
+}  // namespace TracerDetails
+}  // namespace GravelBox
@@ -0,0 +1,114 @@
+#ifndef FILE_TABLES_H_
+#define FILE_TABLES_H_
+
+#include <utils.h>
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace GravelBox {
+
+namespace TracerDetails {
+
+/**
+ * The fds of the tracees whose creating syscall was allowed.
+ *
+ * Like the kernel file tables, a table is shared by the threads created with
+ * `CLONE_FILES`, copied on `fork`, and unshared on `exec`, where close-on-exec
+ * fds are dropped. Only the x86-64 syscalls that open, duplicate or close fds
+ * by number are tracked. Other syscalls (e.g. `pipe`, or a `close` allowed by
+ * the seccomp filter) may leave stale entries, so every entry remembers the
+ * device and inode of its file and is verified before use.
+ *
+ * The tables are shared by all tracer threads, and all methods are
+ * thread-safe.
+ */
+class FileTables {
+  public:
+	/**
+	 * Check if a syscall updates the file table when it returns.
+	 *
+	 * @param args user registers at syscall entry.
+	 */
+	static bool tracks(const Utils::SyscallArgs &args) noexcept;
+
+	/**
+	 * Update the file table of a tracee after an allowed syscall returns.
+	 *
+	 * @param tid the thread that made the syscall.
+	 * @param args user registers at syscall entry.
+	 * @param rval the return value of the syscall.
+	 */
+	void update(pid_t tid, const Utils::SyscallArgs &args, int64_t rval);
+
+	/**
+	 * Check if an fd refers to a file whose open was allowed.
+	 *
+	 * @param tid the thread using the fd.
+	 * @param fd the fd.
+	 */
+	bool allowed(pid_t tid, uint64_t fd);
+
+	/**
+	 * Return the path of an fd whose open was allowed.
+	 *
+	 * @param tid the thread using the fd.
+	 * @param fd the fd.
+	 * @return the path resolved when the fd was opened, or an empty string if
+	 * the fd is not in the table.
+	 */
+	std::string path(pid_t tid, uint64_t fd) const;
+
+	/**
+	 * Give a new tracee the file table of its parent.
+	 *
+	 * @param parent the thread that created the tracee.
+	 * @param child the new tracee.
+	 * @param share whether the table is shared (`CLONE_FILES`) or copied.
+	 */
+	void clone(pid_t parent, pid_t child, bool share);
+
+	/**
+	 * Unshare the file table of a tracee after `exec`, and drop its
+	 * close-on-exec fds.
+	 *
+	 * @param former the thread that called `exec`.
+	 * @param tid the thread id after `exec`, which differs from `former` if
+	 * `exec` was called by a thread other than the thread group leader.
+	 */
+	void exec(pid_t former, pid_t tid);
+
+	/**
+	 * Forget an exited tracee.
+	 *
+	 * @param tid the exited thread.
+	 */
+	void exit(pid_t tid) noexcept;
+
+  private:
+	struct File {
+		std::string path;
+		dev_t dev;
+		ino_t ino;
+		bool cloexec;
+	};
+	using Table = std::unordered_map<uint64_t, File>;
+
+	mutable std::mutex mutex_;
+	std::unordered_map<pid_t, std::shared_ptr<Table>> tables_;
+
+	Table &table(pid_t tid);
+	void add(pid_t tid, uint64_t fd, bool cloexec);
+	void dup(pid_t tid, uint64_t oldfd, uint64_t newfd, bool cloexec);
+	void close(pid_t tid, uint64_t fd);
+};
+
+}  // namespace TracerDetails
+}  // namespace GravelBox
+
+#endif  // FILE_TABLES_H_
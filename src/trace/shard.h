@@ -0,0 +1,357 @@
+#ifndef SHARD_H_
+#define SHARD_H_
+
+#include "affinity.h"
+#include "file_tables.h"
+#include <probes.h>
+#include <utils.h>
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace GravelBox {
+
+namespace TracerDetails {
+
+enum class ThreadStatus {
+	NEW,       // attached, but the initial stop has not been seen
+	ADOPTING,  // handed off by another shard, waiting for the interrupt stop
+	USERSPACE,
+	KERNELSPACE_ALLOW,
+	KERNELSPACE_DENY
+};
+
+/**
+ * Check if the return of a syscall is passed to the exit callback.
+ */
+bool reports_exit(const Utils::SyscallArgs &args) noexcept;
+
+class Shard;
+
+/**
+ * State shared by all shards.
+ */
+struct Pool {
+	// whether returns are passed to the exit callback
+	const bool reports_exits;
+	const bool seccomp;  // whether the tracees run under a seccomp filter
+	const uint64_t options;
+	// fd-based syscalls allowed on the files in `files`
+	const std::unordered_set<uint64_t> fd_inherit;
+	FileTables files;
+	std::vector<std::unique_ptr<Shard>> shards;
+	std::atomic<size_t> tracees{0};
+	std::atomic<bool> done{false};
+	std::atomic<int> exit_code{EXIT_SUCCESS};
+	std::mutex error_mutex;
+	std::exception_ptr error;
+
+	Pool(bool reports_exits, bool seccomp,
+		 const std::vector<uint64_t> &fd_inherit,
+		 const std::vector<Placement> &placements);
+
+	/**
+	 * Whether the file tables are used.
+	 */
+	bool tracks_files() const noexcept { return !fd_inherit.empty(); }
+
+	/**
+	 * Whether an allowed syscall is followed to its syscall-exit-stop.
+	 */
+	bool tracks(const Utils::SyscallArgs &args) const noexcept {
+		return (tracks_files() && FileTables::tracks(args))
+			   || (reports_exits && reports_exit(args));
+	}
+
+	/**
+	 * Stop all shards.
+	 */
+	void finish();
+
+	/**
+	 * Record the first fatal error and stop all shards.
+	 */
+	void fail(std::exception_ptr e);
+
+	/**
+	 * Return the shard with the fewest tracees.
+	 */
+	Shard &least_loaded() const;
+};
+
+/**
+ * A tracer thread and the tracees it owns.
+ *
+ * Ptrace requests are only accepted from the thread that attached to the
+ * tracee, so every shard waits only for its own tracees (`__WNOTHREAD`) and
+ * keeps its own `thread_status_`. New threads and processes are
+ * auto-attached to the shard of their parent. The shard then balances the
+ * load by parking the new tracee in a `ppoll` with all signals blocked,
+ * detaching from it, and handing it off to the least loaded shard, which
+ * attaches with `PTRACE_SEIZE` and restores the registers. The parked
+ * tracee cannot run any code while no shard is attached.
+ *
+ * Each shard (when there is more than one) has a doorbell: a tiny traced
+ * child process that other shards signal to wake the shard from `waitpid`
+ * when a hand-off is posted.
+ *
+ * When the tracees run under a seccomp filter, they are resumed with
+ * `PTRACE_CONT` and only stop at `PTRACE_EVENT_SECCOMP` for the syscalls the
+ * filter does not allow.
+ *
+ * When the file tables or the exit callback are used, allowed syscalls that
+ * open or close fds (and others reported to the exit callback) are followed
+ * to their syscall-exit-stop, with `PTRACE_SYSCALL` after a seccomp stop.
+ *
+ * Each wakeup drains every stop that is ready, and handles them as a batch in
+ * the order they were reaped. A tracee has at most one pending stop (or its
+ * exit after a stop), so it is served once per batch, and a busy thread cannot
+ * starve the others between two blocking `waitpid` calls.
+ *
+ * In low-latency mode, the shard thread is pinned to a CPU, and may pin its
+ * tracees near it. Before blocking, it polls for a stop for an adaptive
+ * interval, which doubles when a stop comes in time and halves otherwise.
+ *
+ * The event loop is a template over the callbacks, so the decision path is
+ * compiled into the loop. Handling a stop reports a tracee that vanished
+ * (`ESRCH`) with a return value; its exit is seen later. Only fatal errors
+ * are thrown.
+ */
+class Shard {
+  public:
+	Shard(Pool &pool, const Placement &placement)
+		: pool_(pool), placement_(placement),
+		  spin_(placement.spins ? kMaxSpin : std::chrono::nanoseconds(0)) {}
+
+	Shard(const Shard &) = delete;
+	Shard &operator=(const Shard &) = delete;
+
+	/**
+	 * Register the initial child process, which is already attached to the
+	 * calling thread and stopped.
+	 */
+	void trace(pid_t child) {
+		thread_status_[child] = ThreadStatus::USERSPACE;
+		attached();
+		settled(child);
+	}
+
+	/**
+	 * Pin the calling thread to the CPU of the shard, if any. Must be called
+	 * from the shard thread.
+	 *
+	 * @throw std::system_error if the CPU is not available.
+	 */
+	void pin() const {
+		if (placement_.tracer >= 0)
+			pin_self(placement_.tracer);
+	}
+
+	/**
+	 * Fork the doorbell process. Must be called from the shard thread.
+	 */
+	void open_doorbell();
+
+	/**
+	 * Run the event loop until all tracees have exited, or another shard
+	 * fails. Errors are reported to the pool.
+	 *
+	 * @param callbacks has `syscall(pid, args)`, which returns whether to
+	 * allow a syscall, and `exit(pid, args, rval)`, which is called when a
+	 * syscall returns if `Pool::reports_exits`.
+	 */
+	template <typename Callbacks>
+	void serve(Callbacks &callbacks) noexcept {
+		try {
+			run(callbacks);
+		} catch (...) { pool_.fail(std::current_exception()); }
+		close_doorbell();
+	}
+
+	/**
+	 * Hand off a parked tracee to this shard. May be called from any thread.
+	 *
+	 * @param tid the parked tracee.
+	 * @param regs the registers to restore after attaching.
+	 */
+	void post(pid_t tid, const user_regs_struct &regs);
+
+	/**
+	 * Wake the shard thread. May be called from any thread.
+	 */
+	void ring() const noexcept;
+
+	/**
+	 * Return the number of tracees owned by, or being handed off to, the
+	 * shard.
+	 */
+	size_t load() const noexcept {
+		return load_.load(std::memory_order_relaxed);
+	}
+
+  private:
+	/**
+	 * What the event loop does after a stop is handled.
+	 */
+	enum class Stop {
+		RESUMED,  // nothing, the tracee is resumed or gone
+		ENTRY,    // decide a syscall at syscall-enter-stop, then `entered`
+		SECCOMP,  // decide a syscall at a seccomp stop, then `filtered`
+		EXIT      // report the return of a syscall, then `resume`
+	};
+
+	// bounds of the polling interval in low-latency mode
+	static constexpr std::chrono::nanoseconds kMinSpin{1000};
+	static constexpr std::chrono::nanoseconds kMaxSpin{100000};
+
+	Pool &pool_;
+	const Placement placement_;
+	std::chrono::nanoseconds spin_;  // 0 if the shard does not poll
+	std::unordered_map<pid_t, ThreadStatus> thread_status_;
+	std::unordered_map<pid_t, user_regs_struct> adopting_;
+	// tids attached before the parent's clone event was seen
+	std::unordered_set<pid_t> unannounced_;
+	// allowed syscalls that are followed to their syscall-exit-stop
+	std::unordered_map<pid_t, Utils::SyscallArgs> tracked_;
+	std::atomic<size_t> load_{0};
+	std::atomic<pid_t> doorbell_{-1};
+	std::mutex inbox_mutex_;
+	std::vector<std::pair<pid_t, user_regs_struct>> inbox_;
+	// the tids and wait statuses reaped by the last wakeup
+	std::vector<std::pair<pid_t, int>> ready_;
+
+	template <typename Callbacks>
+	void run(Callbacks &callbacks);
+	template <typename Callbacks>
+	void handle(Callbacks &callbacks, pid_t tid, int wstatus);
+	template <typename Callbacks>
+	bool allow(Callbacks &callbacks, pid_t tid,
+			   const Utils::SyscallArgs &args);
+	void attached() noexcept {
+		pool_.tracees.fetch_add(1);
+		load_.fetch_add(1, std::memory_order_relaxed);
+	}
+	void detached() noexcept {
+		load_.fetch_sub(1, std::memory_order_relaxed);
+	}
+	bool reap();
+	pid_t poll(int &wstatus);
+	void settled(pid_t tid) const noexcept {
+		if (placement_.tracees >= 0)
+			TracerDetails::pin(tid, placement_.tracees);
+	}
+	bool traced(long retval) const;
+	bool forget(pid_t tid);
+	void exited(int wstatus) noexcept;
+	Stop stopped(pid_t tid, int wstatus, Utils::SyscallArgs &args,
+				 int64_t &rval);
+	void entered(pid_t tid, bool allowed);
+	void filtered(pid_t tid, bool allowed);
+	void cloned(pid_t tid, int event, pid_t new_tid);
+	void resume(pid_t tid);
+	void start(pid_t tid);
+	bool park(pid_t tid, user_regs_struct &regs);
+	void answer_doorbell(int wstatus);
+	void adopt(pid_t tid, const user_regs_struct &regs);
+	void close_doorbell() noexcept;
+};
+
+template <typename Callbacks>
+void Shard::run(Callbacks &callbacks) {
+	while (!pool_.done.load()) {
+		if (!reap())
+			continue;
+		uint64_t start = Probes::start(GRAVELBOX_PROBE_ENABLED(queued)
+									   || GRAVELBOX_PROBE_ENABLED(batch));
+		int64_t longest = 0;
+		for (const auto &[tid, wstatus] : ready_) {
+			if (pool_.done.load())
+				break;
+			if (start != 0) {
+				int64_t delay = Probes::elapsed(start);
+				longest = std::max(longest, delay);
+				GRAVELBOX_PROBE2(queued, tid, delay);
+			}
+			handle(callbacks, tid, wstatus);
+		}
+		if (start != 0)
+			GRAVELBOX_PROBE3(batch, ready_.size(), longest,
+							 Probes::elapsed(start));
+	}
+}
+
+template <typename Callbacks>
+void Shard::handle(Callbacks &callbacks, pid_t tid, int wstatus) {
+	if (tid == doorbell_) {
+		answer_doorbell(wstatus);
+		return;
+	}
+	if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)) {
+		if (forget(tid)) {
+			if (pool_.reports_exits)
+				callbacks.exit(tid, {SYS_exit, {}, false}, 0);
+			exited(wstatus);
+		}
+		return;
+	}
+	if (!WIFSTOPPED(wstatus))
+		return;
+	Utils::SyscallArgs args;
+	int64_t rval;
+	Stop stop = stopped(tid, wstatus, args, rval);
+	switch (stop) {
+	case Stop::RESUMED:
+		break;
+	case Stop::ENTRY:
+	case Stop::SECCOMP: {
+		uint64_t start = Probes::start(GRAVELBOX_PROBE_ENABLED(resume));
+		GRAVELBOX_PROBE2(syscall_enter, tid, args.number);
+		bool allowed = allow(callbacks, tid, args);
+		if (stop == Stop::ENTRY)
+			entered(tid, allowed);
+		else
+			filtered(tid, allowed);
+		if (start != 0)
+			GRAVELBOX_PROBE4(resume, tid, args.number, allowed,
+							 Probes::elapsed(start));
+		break;
+	}
+	case Stop::EXIT:
+		callbacks.exit(tid, args, rval);
+		resume(tid);
+		break;
+	}
+}
+
+template <typename Callbacks>
+bool Shard::allow(Callbacks &callbacks, pid_t tid,
+				  const Utils::SyscallArgs &args) {
+	bool allowed = (pool_.tracks_files() && !args.int80
+					&& pool_.fd_inherit.count(args.number) > 0
+					&& pool_.files.allowed(tid, args.args[0]))
+				   || callbacks.syscall(tid, args);
+	if (allowed && pool_.tracks(args))
+		tracked_[tid] = args;
+	return allowed;
+}
+
+}  // namespace TracerDetails
+}  // namespace GravelBox
+
+#endif  // SHARD_H_
@@ -1,11 +1,17 @@
 #include "tracer.h"
+#include "file_tables.h"
+#include "shard.h"
 #include <utils.h>
 #include <exceptions.h>
 
 #include <linux/version.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sched.h>
 #include <signal.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <sys/user.h>
 
@@ -16,13 +22,27 @@
 #endif
 #include <linux/ptrace.h>
 #include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 extern "C" {
 	extern int32_t ptrace(int __request, ...) noexcept;
 }
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <functional>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace GravelBox {
 
@@ -30,37 +50,599 @@ namespace TracerDetails {
 
 using Utils::check;
 
-enum class ThreadStatus { USERSPACE, KERNELSPACE_ALLOW, KERNELSPACE_DENY };
+// code segment selector of 64-bit tasks
+constexpr uint64_t kUserCS64 = 0x33;
+// encoding of the x86-64 `syscall` instruction
+constexpr uint8_t kSyscallInsn[] = {0x0f, 0x05};
+// stack memory below `rsp` that may be in use by leaf functions
+constexpr uint64_t kRedZone = 128;
+// syscall numbers with this bit set belong to the x32 ABI
+constexpr uint32_t kX32SyscallBit = 0x40000000;
+
+uint64_t trace_options(bool seccomp) {
+	uint64_t options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE
+					   | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK
+					   | PTRACE_O_TRACEEXEC;
+	if (seccomp)
+		options |= PTRACE_O_TRACESECCOMP;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 11, 0)
+	options |= PTRACE_O_EXITKILL;  // kill target if GravelBox is killed
+#else
+#warning Linux kernel version < 3.11, PTRACE_O_KILLEXIT is disabled
+#endif
+	return options;
+}
+
+/**
+ * Build a seccomp filter that allows the listed x86-64 syscalls and sends all
+ * the others to the tracer.
+ *
+ * @param allow x86-64 syscall numbers to allow.
+ * @param landlock x86-64 syscall numbers to allow unless their open flags,
+ * if any, contain `O_PATH`, with the index of the flags argument or -1.
+ * @param park whether to allow the `ppoll` used to park tracees.
+ */
+std::vector<sock_filter> seccomp_filter(
+	const std::vector<uint64_t> &allow,
+	const std::vector<std::pair<uint64_t, int>> &landlock, bool park) {
+	std::vector<sock_filter> filter = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, kX32SyscallBit, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE),
+	};
+	for (uint64_t nr : allow) {
+		if (nr >= kX32SyscallBit)
+			continue;
+		filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+								  static_cast<uint32_t>(nr), 0, 1));
+		filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+	}
+	for (auto [nr, flags_arg] : landlock) {
+		if (nr >= kX32SyscallBit)
+			continue;
+		if (flags_arg < 0) {
+			filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+									  static_cast<uint32_t>(nr), 0, 1));
+			filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+			continue;
+		}
+		// the flags are an int, in the low word of the argument
+		uint32_t offset = offsetof(seccomp_data, args) + flags_arg * 8;
+		filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+								  static_cast<uint32_t>(nr), 0, 4));
+		filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offset));
+		filter.push_back(BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, O_PATH, 1, 0));
+		filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+		filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+	}
+	if (park) {
+		// ppoll(NULL, 0, NULL, ...) only waits for a signal. The parked
+		// tracee runs it with no tracer attached, which would otherwise fail
+		// with ENOSYS and let the tracee run untraced.
+		constexpr uint8_t kWords = 3 * 2;
+		filter.push_back(
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_ppoll, 0, 2 * kWords + 1));
+		for (uint8_t i = 0; i < kWords; i++) {
+			uint32_t offset
+				= offsetof(seccomp_data, args) + i * sizeof(uint32_t);
+			uint8_t skip = 2 * (kWords - i - 1) + 1;
+			filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offset));
+			filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, skip));
+		}
+		filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+	}
+	filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+	return filter;
+}
+
+/**
+ * Convert syscall information from ptrace.
+ */
+Utils::SyscallArgs syscall_args(uint32_t arch, uint64_t nr,
+								const __u64 (&args)[6]) {
+	assert(arch == AUDIT_ARCH_I386 || arch == AUDIT_ARCH_X86_64);
+	return {nr,
+			{args[0], args[1], args[2], args[3], args[4], args[5]},
+			arch == AUDIT_ARCH_I386};
+}
+
+bool reports_exit(const Utils::SyscallArgs &args) noexcept {
+	if (args.int80)
+		return false;
+	switch (args.number) {
+	case SYS_close:
+	case SYS_close_range:
+	case SYS_dup2:
+	case SYS_dup3:
+	case SYS_chdir:
+	case SYS_fchdir:
+	case SYS_execve:
+	case SYS_execveat:
+		return true;
+	default:
+		return false;
+	}
+}
+
+Pool::Pool(bool reports_exits, bool seccomp,
+		   const std::vector<uint64_t> &fd_inherit,
+		   const std::vector<Placement> &placements)
+	: reports_exits(reports_exits), seccomp(seccomp),
+	  options(trace_options(seccomp)),
+	  fd_inherit(fd_inherit.begin(), fd_inherit.end()) {
+	assert(!placements.empty());
+	for (const Placement &placement : placements)
+		shards.push_back(std::make_unique<Shard>(*this, placement));
+}
+
+void Pool::finish() {
+	done.store(true);
+	for (const auto &shard : shards)
+		shard->ring();
+}
+
+void Pool::fail(std::exception_ptr e) {
+	{
+		std::lock_guard<std::mutex> lock(error_mutex);
+		if (!error)
+			error = e;
+	}
+	finish();
+}
+
+Shard &Pool::least_loaded() const {
+	return **std::min_element(shards.begin(), shards.end(),
+							  [](const auto &a, const auto &b) {
+								  return a->load() < b->load();
+							  });
+}
+
+void Shard::open_doorbell() {
+	pid_t pid = check(::fork());
+	if (pid == 0) {
+		// only async-signal-safe calls after fork in a multi-threaded process
+		if (::ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0
+			|| ::raise(SIGSTOP) != 0)
+			::_exit(EXIT_FAILURE);
+		while (true)
+			::pause();
+	}
+	int wstatus;
+	check(::waitpid(pid, &wstatus, __WALL));
+	if (!WIFSTOPPED(wstatus))
+		throw std::system_error(ECHILD, std::system_category(),
+								"Tracer doorbell failed to start");
+	doorbell_ = pid;
+	check(::ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_EXITKILL));
+	check(::ptrace(PTRACE_CONT, pid, nullptr, 0));
+}
+
+void Shard::close_doorbell() noexcept {
+	pid_t doorbell = doorbell_.exchange(-1);
+	if (doorbell <= 0)
+		return;
+	::kill(doorbell, SIGKILL);
+	while (::waitpid(doorbell, nullptr, __WALL) < 0 && errno == EINTR)
+		continue;
+}
+
+void Shard::post(pid_t tid, const user_regs_struct &regs) {
+	load_.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(inbox_mutex_);
+		inbox_.emplace_back(tid, regs);
+	}
+	ring();
+}
+
+void Shard::ring() const noexcept {
+	pid_t doorbell = doorbell_.load();
+	if (doorbell > 0)
+		::kill(doorbell, SIGUSR1);
+}
+
+bool Shard::reap() {
+	ready_.clear();
+	int wstatus;
+	pid_t tid = spin_.count() > 0 ? poll(wstatus) : 0;
+	if (tid == 0)
+		tid = ::waitpid(-1, &wstatus, __WALL | __WNOTHREAD);
+	if (tid < 0) {
+		if (errno == EINTR)
+			return false;
+		Utils::throw_system_error();
+	}
+	ready_.emplace_back(tid, wstatus);
+	// The drain ends, since a reaped tracee stays stopped until it is handled.
+	// A lone tracee has nothing more to drain, so it costs no extra syscall.
+	if (thread_status_.size() < 2)
+		return true;
+	while ((tid = ::waitpid(-1, &wstatus, __WALL | __WNOTHREAD | WNOHANG)) > 0)
+		ready_.emplace_back(tid, wstatus);
+	return true;
+}
+
+pid_t Shard::poll(int &wstatus) {
+	auto start = std::chrono::steady_clock::now();
+	do {
+		pid_t tid = ::waitpid(-1, &wstatus, __WALL | __WNOTHREAD | WNOHANG);
+		if (tid != 0) {
+			if (tid > 0)
+				spin_ = std::min(spin_ * 2, kMaxSpin);
+			return tid;
+		}
+		__builtin_ia32_pause();
+	} while (std::chrono::steady_clock::now() - start < spin_);
+	spin_ = std::max(spin_ / 2, kMinSpin);
+	return 0;
+}
+
+bool Shard::traced(long retval) const {
+	if (retval >= 0)
+		return true;
+	// the tracee was killed, and its exit is seen later
+	if (errno == ESRCH)
+		return false;
+	Utils::throw_system_error();
+}
+
+bool Shard::forget(pid_t tid) {
+	adopting_.erase(tid);
+	tracked_.erase(tid);
+	if (thread_status_.erase(tid) == 0)
+		return false;
+	if (pool_.tracks_files())
+		pool_.files.exit(tid);
+	return true;
+}
+
+void Shard::exited(int wstatus) noexcept {
+	detached();
+	if (pool_.tracees.fetch_sub(1) == 1) {
+		pool_.exit_code = WIFEXITED(wstatus)
+							  ? WEXITSTATUS(wstatus)
+							  : 128 + WTERMSIG(wstatus);  // consistent with bash
+		pool_.finish();
+	}
+}
+
+Shard::Stop Shard::stopped(pid_t tid, int wstatus, Utils::SyscallArgs &args,
+						   int64_t &rval) {
+	switch (wstatus >> 16) {
+	case PTRACE_EVENT_CLONE:
+	case PTRACE_EVENT_FORK:
+	case PTRACE_EVENT_VFORK: {
+		// the new tracee is counted before its parent can exit
+		unsigned long new_tid;
+		if (!traced(::ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &new_tid)))
+			return Stop::RESUMED;
+		if (unannounced_.erase(new_tid) == 0
+			&& thread_status_.find(new_tid) == thread_status_.end()) {
+			thread_status_[new_tid] = ThreadStatus::NEW;
+			attached();
+		}
+		if (pool_.tracks_files())
+			cloned(tid, wstatus >> 16, new_tid);
+		resume(tid);
+		return Stop::RESUMED;
+	}
+	case PTRACE_EVENT_EXEC: {
+		unsigned long former_tid;
+		if (!traced(::ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &former_tid)))
+			return Stop::RESUMED;
+		if (pool_.tracks_files())
+			pool_.files.exec(former_tid, tid);
+		resume(tid);
+		return Stop::RESUMED;
+	}
+	case PTRACE_EVENT_SECCOMP: {
+		ptrace_syscall_info info;
+		if (!traced(
+				::ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), &info)))
+			return Stop::RESUMED;
+		assert(info.op == PTRACE_SYSCALL_INFO_SECCOMP);
+		args = syscall_args(info.arch, info.seccomp.nr, info.seccomp.args);
+		return Stop::SECCOMP;
+	}
+	}
+
+	auto it = thread_status_.find(tid);
+	if (it == thread_status_.end()) {
+		// initial stop of a new tracee, before the parent's clone event
+		it = thread_status_.emplace(tid, ThreadStatus::NEW).first;
+		unannounced_.insert(tid);
+		attached();
+	}
+	switch (it->second) {
+	case ThreadStatus::NEW:
+		start(tid);
+		return Stop::RESUMED;
+	case ThreadStatus::ADOPTING: {
+		// interrupt stop after PTRACE_SEIZE, resume where the tracee was parked
+		user_regs_struct regs = adopting_.at(tid);
+		adopting_.erase(tid);
+		if (!traced(::ptrace(PTRACE_SETREGS, tid, nullptr, &regs)))
+			return Stop::RESUMED;
+		it->second = ThreadStatus::USERSPACE;
+		break;
+	}
+	default:
+		if (WSTOPSIG(wstatus) != (SIGTRAP | 0x80))
+			break;
+		// syscall-enter-stop or syscall-exit-stop
+		switch (it->second) {
+		case ThreadStatus::USERSPACE: {
+			// syscall-enter-stop
+			ptrace_syscall_info info;
+			if (!traced(::ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info),
+								 &info)))
+				return Stop::RESUMED;
+			assert(info.op == PTRACE_SYSCALL_INFO_ENTRY);
+			args = syscall_args(info.arch, info.entry.nr, info.entry.args);
+			return Stop::ENTRY;
+		}
+		case ThreadStatus::KERNELSPACE_DENY: {
+			// syscall-exit-stop
+			user_regs_struct regs;
+			if (!traced(::ptrace(PTRACE_GETREGS, tid, nullptr, &regs)))
+				return Stop::RESUMED;
+			regs.rax = -EPERM;
+			if (!traced(::ptrace(PTRACE_SETREGS, tid, nullptr, &regs)))
+				return Stop::RESUMED;
+			[[fallthrough]];
+		}
+		case ThreadStatus::KERNELSPACE_ALLOW: {
+			// syscall-exit-stop
+			it->second = ThreadStatus::USERSPACE;
+			auto tracked = tracked_.find(tid);
+			if (tracked == tracked_.end())
+				break;
+			args = tracked->second;
+			tracked_.erase(tracked);
+			ptrace_syscall_info info;
+			if (!traced(::ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info),
+								 &info)))
+				return Stop::RESUMED;
+			assert(info.op == PTRACE_SYSCALL_INFO_EXIT);
+			if (pool_.tracks_files() && FileTables::tracks(args))
+				pool_.files.update(tid, args, info.exit.rval);
+			if (pool_.reports_exits && reports_exit(args)) {
+				rval = info.exit.rval;
+				return Stop::EXIT;
+			}
+			break;
+		}
+		default:
+			assert(false);
+		}
+	}
+	resume(tid);
+	return Stop::RESUMED;
+}
+
+void Shard::entered(pid_t tid, bool allowed) {
+	if (allowed) {
+		thread_status_.at(tid) = ThreadStatus::KERNELSPACE_ALLOW;
+	} else {
+		user_regs_struct regs;
+		if (!traced(::ptrace(PTRACE_GETREGS, tid, nullptr, &regs)))
+			return;
+		regs.orig_rax = -1;
+		if (!traced(::ptrace(PTRACE_SETREGS, tid, nullptr, &regs)))
+			return;
+		thread_status_.at(tid) = ThreadStatus::KERNELSPACE_DENY;
+	}
+	resume(tid);
+}
+
+void Shard::filtered(pid_t tid, bool allowed) {
+	if (allowed) {
+		// seccomp stops come after syscall-enter-stops, so resuming with
+		// PTRACE_SYSCALL stops at syscall-exit-stop
+		if (tracked_.count(tid) > 0)
+			thread_status_.at(tid) = ThreadStatus::KERNELSPACE_ALLOW;
+	} else {
+		// skip the syscall, there will be no syscall-exit-stop
+		user_regs_struct regs;
+		if (!traced(::ptrace(PTRACE_GETREGS, tid, nullptr, &regs)))
+			return;
+		regs.orig_rax = -1;
+		regs.rax = -EPERM;
+		if (!traced(::ptrace(PTRACE_SETREGS, tid, nullptr, &regs)))
+			return;
+	}
+	resume(tid);
+}
+
+void Shard::resume(pid_t tid) {
+	// syscall stops are only needed to finish a syscall under seccomp
+	auto it = thread_status_.find(tid);
+	bool userspace
+		= it == thread_status_.end() || it->second == ThreadStatus::USERSPACE;
+	traced(::ptrace(pool_.seccomp && userspace ? PTRACE_CONT : PTRACE_SYSCALL,
+					tid, nullptr, 0));
+}
+
+void Shard::cloned(pid_t tid, int event, pid_t new_tid) {
+	bool share = false;
+	if (event == PTRACE_EVENT_CLONE) {
+		user_regs_struct regs;
+		uint64_t flags = 0;
+		if (!traced(::ptrace(PTRACE_GETREGS, tid, nullptr, &regs))) {
+			// the parent was killed, the child is handled alone
+		} else if (regs.cs != kUserCS64) {
+			// 32-bit tracees do not use the file tables
+		} else if (regs.orig_rax == SYS_clone) {
+			flags = regs.rdi;
+		} else if (regs.orig_rax == SYS_clone3) {
+			// the flags are the first field of `struct clone_args`
+			::iovec local = {&flags, sizeof(flags)};
+			::iovec remote = {reinterpret_cast<void *>(regs.rdi),
+							  sizeof(flags)};
+			if (::process_vm_readv(tid, &local, 1, &remote, 1, 0)
+				!= sizeof(flags))
+				flags = 0;
+		}
+		share = flags & CLONE_FILES;
+	}
+	pool_.files.clone(tid, new_tid, share);
+}
+
+void Shard::start(pid_t tid) {
+	if (pool_.shards.size() > 1) {
+		Shard &target = pool_.least_loaded();
+		user_regs_struct regs;
+		if (&target != this && target.load() + 1 < load() && park(tid, regs)) {
+			thread_status_.erase(tid);
+			detached();
+			target.post(tid, regs);
+			return;
+		}
+	}
+	thread_status_[tid] = ThreadStatus::USERSPACE;
+	settled(tid);
+	resume(tid);
+}
+
+bool Shard::park(pid_t tid, user_regs_struct &regs) {
+	if (!traced(::ptrace(PTRACE_GETREGS, tid, nullptr, &regs)))
+		return false;
+	// A new tracee stops right after the `syscall` instruction that created
+	// it. Re-execute that instruction as `ppoll` to park it. 32-bit tracees
+	// use different syscall numbers and instructions, and stay in this shard.
+	if (regs.cs != kUserCS64)
+		return false;
+	uint8_t insn[sizeof(kSyscallInsn)];
+	::iovec local = {insn, sizeof(insn)};
+	::iovec remote = {reinterpret_cast<void *>(regs.rip - sizeof(insn)),
+					  sizeof(insn)};
+	if (::process_vm_readv(tid, &local, 1, &remote, 1, 0) != sizeof(insn)
+		|| std::memcmp(insn, kSyscallInsn, sizeof(insn)) != 0)
+		return false;
+
+	// full signal mask, stored on the tracee stack below the red zone
+	uint64_t mask = ~0ULL;
+	uint64_t mask_addr = (regs.rsp - kRedZone - sizeof(mask)) & ~7ULL;
+	local = {&mask, sizeof(mask)};
+	remote = {reinterpret_cast<void *>(mask_addr), sizeof(mask)};
+	if (::process_vm_writev(tid, &local, 1, &remote, 1, 0) != sizeof(mask))
+		return false;
+
+	user_regs_struct parked = regs;
+	parked.rip -= sizeof(kSyscallInsn);
+	parked.rax = SYS_ppoll;
+	parked.orig_rax = -1;  // do not restart the syscall that created it
+	parked.rdi = 0;        // fds
+	parked.rsi = 0;        // nfds
+	parked.rdx = 0;        // no timeout
+	parked.r10 = mask_addr;
+	parked.r8 = sizeof(mask);
+	if (!traced(::ptrace(PTRACE_SETREGS, tid, nullptr, &parked))
+		|| !traced(::ptrace(PTRACE_DETACH, tid, nullptr, 0)))
+		return false;
+	regs.orig_rax = -1;
+	return true;
+}
+
+void Shard::answer_doorbell(int wstatus) {
+	if (!WIFSTOPPED(wstatus)) {
+		doorbell_ = -1;
+		throw std::system_error(ECHILD, std::system_category(),
+								"Tracer doorbell exited");
+	}
+	std::vector<std::pair<pid_t, user_regs_struct>> inbox;
+	{
+		std::lock_guard<std::mutex> lock(inbox_mutex_);
+		inbox.swap(inbox_);
+	}
+	for (const auto &[tid, regs] : inbox)
+		adopt(tid, regs);
+	check(::ptrace(PTRACE_CONT, doorbell_.load(), nullptr, 0));
+}
+
+void Shard::adopt(pid_t tid, const user_regs_struct &regs) {
+	if (::ptrace(PTRACE_SEIZE, tid, nullptr, pool_.options) < 0) {
+		// killed while parked
+		detached();
+		if (pool_.tracees.fetch_sub(1) == 1)
+			pool_.finish();
+		return;
+	}
+	thread_status_[tid] = ThreadStatus::ADOPTING;
+	adopting_[tid] = regs;
+	settled(tid);
+	if (::ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) < 0 && errno != ESRCH)
+		Utils::throw_system_error();
+}
+
+int run_shards(const std::vector<std::string> &args, const std::string &std_in,
+			   const std::string &std_out, bool append_stdout,
+			   const std::string &std_err, bool append_stderr,
+			   bool reports_exits, size_t threads, bool stops_once,
+			   const std::vector<uint64_t> &seccomp_allow,
+			   const std::vector<uint64_t> &fd_inherit, int landlock_ruleset,
+			   const std::vector<std::pair<uint64_t, int>> &landlock_allow,
+			   const LowLatency &low_latency, void (*loop)(Shard &, void *),
+			   void *context) {
+	bool seccomp
+		= stops_once || !seccomp_allow.empty() || !landlock_allow.empty();
+	std::vector<sock_filter> filter;
+	if (seccomp) {
+		// syscalls whose return the tracer needs are always traced
+		auto untraced = [&](uint64_t nr) {
+			Utils::SyscallArgs args{nr, {}, false};
+			return (!reports_exits || !reports_exit(args))
+				   && (fd_inherit.empty() || !FileTables::tracks(args));
+		};
+		std::vector<uint64_t> allow;
+		for (uint64_t nr : seccomp_allow)
+			if (untraced(nr))
+				allow.push_back(nr);
+		std::vector<std::pair<uint64_t, int>> landlock;
+		for (const auto &syscall : landlock_allow)
+			if (untraced(syscall.first))
+				landlock.push_back(syscall);
+		filter = seccomp_filter(allow, landlock, threads > 1);
+	}
+
+	// a designated CPU that is not available fails before the child exists
+	std::vector<Placement> placements
+		= low_latency.enabled ? place(threads, low_latency)
+							  : std::vector<Placement>(threads);
+	if (low_latency.enabled
+		&& std::none_of(placements.begin(), placements.end(),
+						[](const Placement &p) { return p.spins; }))
+		std::cerr << "Low-latency mode: too few CPUs for the tracer threads "
+					 "to poll, they are only pinned"
+				  << std::endl;
 
-int run_with_callbacks(
-	const std::vector<std::string> &args, const std::string &std_in,
-	const std::string &std_out, bool append_stdout,
-	const std::string &std_err, bool append_stderr,
-	const std::function<void(pid_t)> &pid_callback,
-	const std::function<bool(const Utils::SyscallArgs &)> &syscall_callback) {
 	// spawn child
 	pid_t child = Utils::spawn(args, [&]() {
 		check(::ptrace(PTRACE_TRACEME, 0, nullptr, nullptr));
 		if (::raise(SIGSTOP) != 0)
 			Utils::throw_system_error();
-		if (std_in != "-") {
-			Utils::Fd fd(check(::open(std_in.c_str(), O_RDONLY)));
-			check(::dup2(fd, 0));
-		}
-		if (std_out != "-") {
-			Utils::Fd fdout(check(::open(
-				std_out.c_str(),
-				O_WRONLY | O_CREAT | (append_stdout ? O_APPEND : 0),
-				S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)));
-			check(::dup2(fdout, 1));
-		}
-		if (std_err != "-") {
-			Utils::Fd fderr(check(::open(
-				std_err.c_str(),
-				O_WRONLY | O_CREAT | (append_stderr ? O_APPEND : 0),
-				S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)));
-			check(::dup2(fderr, 2));
+		if (seccomp) {
+			// not traced, the tracer resumes the child with PTRACE_CONT
+			// required to install a filter without CAP_SYS_ADMIN
+			check(::prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0));
+			// the ruleset fd is closed on exec
+			if (landlock_ruleset >= 0)
+				LandlockRuleset::restrict_self(landlock_ruleset);
+			sock_fprog prog = {static_cast<unsigned short>(filter.size()),
+							   filter.data()};
+			check(::prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog));
 		}
+		if (std_in != "-")
+			check(::dup2(Utils::open_redirection(std_in, false, false), 0));
+		if (std_out != "-")
+			check(::dup2(Utils::open_redirection(std_out, true, append_stdout),
+						 1));
+		if (std_err != "-")
+			check(::dup2(Utils::open_redirection(std_err, true, append_stderr),
+						 2));
 	});
 	// wait for child process to be ready for trace
 	int wstatus;
@@ -73,102 +655,54 @@ int run_with_callbacks(
 	assert(WIFSTOPPED(wstatus) && WSTOPSIG(wstatus) == SIGSTOP);
 
 	// set-up trace
-	uint64_t options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE
-					   | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK;
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 11, 0)
-	options |= PTRACE_O_EXITKILL;  // kill target if GravelBox is killed
-#else
-#warning Linux kernel version < 3.11, PTRACE_O_KILLEXIT is disabled
-#endif
-	check(::ptrace(PTRACE_SETOPTIONS, child, nullptr, options));
-	check(::ptrace(PTRACE_SYSCALL, child, nullptr, 0));
-	std::unordered_map<pid_t, ThreadStatus> thread_status{
-		{child, ThreadStatus::USERSPACE}};
+	Pool pool(reports_exits, seccomp, fd_inherit, placements);
+	check(::ptrace(PTRACE_SETOPTIONS, child, nullptr, pool.options));
+	Shard &main_shard = *pool.shards.front();
+	main_shard.trace(child);
 
-	// start tracing
-	while (true) {
-		child = check(::waitpid(-1, &wstatus, 0));
-		if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)) {
-			thread_status.erase(child);
-			if (thread_status.size() == 0)
-				return WIFEXITED(wstatus)
-						   ? WEXITSTATUS(wstatus)
-						   : 128 + WTERMSIG(wstatus);  // consistent with bash
-			continue;
-		}
-		try {
-			if (WIFSTOPPED(wstatus)) {
-				switch (WSTOPSIG(wstatus)) {
-				case SIGSTOP:
-					if (thread_status.find(child) == thread_status.end())
-						thread_status[child] = ThreadStatus::USERSPACE;
-					break;
-				case SIGTRAP | 0x80:
-					// syscall-enter-stop or syscall-exit-stop
-					switch (thread_status.at(child)) {
-					case ThreadStatus::USERSPACE: {
-						// syscall-enter-stop
-						ptrace_syscall_info info;
-						check(::ptrace(PTRACE_GET_SYSCALL_INFO, child,
-									   sizeof(info), &info));
-						assert(info.op == PTRACE_SYSCALL_INFO_ENTRY);
-						assert(info.arch == AUDIT_ARCH_I386
-							   || info.arch == AUDIT_ARCH_X86_64);
-						pid_callback(child);
-						Utils::SyscallArgs args
-							= {info.entry.nr,
-							   {
-								   info.entry.args[0],
-								   info.entry.args[1],
-								   info.entry.args[2],
-								   info.entry.args[3],
-								   info.entry.args[4],
-								   info.entry.args[5],
-							   },
-							   info.arch == AUDIT_ARCH_I386};
-						if (syscall_callback(args)) {
-							thread_status[child]
-								= ThreadStatus::KERNELSPACE_ALLOW;
-						} else {
-							user_regs_struct regs;
-							check(::ptrace(PTRACE_GETREGS, child, nullptr,
-										   &regs));
-							regs.orig_rax = -1;
-							check(::ptrace(PTRACE_SETREGS, child, nullptr,
-										   &regs));
-							thread_status[child]
-								= ThreadStatus::KERNELSPACE_DENY;
-						}
-						break;
-					}
-					case ThreadStatus::KERNELSPACE_DENY: {
-						// syscall-exit-stop
-						user_regs_struct regs;
-						check(::ptrace(PTRACE_GETREGS, child, nullptr, &regs));
-						regs.rax = -EPERM;
-						check(::ptrace(PTRACE_SETREGS, child, nullptr, &regs));
-						[[fallthrough]];
-					}
-					case ThreadStatus::KERNELSPACE_ALLOW: {
-						// syscall-exit-stop
-						thread_status[child] = ThreadStatus::USERSPACE;
-						break;
-					}
-					}
-					break;
-				}
-				check(::ptrace(PTRACE_SYSCALL, child, nullptr, 0));
+	// start the other tracer threads, the child is traced by this thread
+	std::vector<std::thread> workers;
+	std::exception_ptr error;
+	for (size_t i = 1; i < pool.shards.size() && !error; i++) {
+		std::promise<void> ready;
+		std::future<void> started = ready.get_future();
+		workers.emplace_back([&shard = *pool.shards[i], loop, context,
+							  ready = std::move(ready)]() mutable {
+			try {
+				shard.pin();
+				shard.open_doorbell();
+				ready.set_value();
+			} catch (...) {
+				ready.set_exception(std::current_exception());
+				return;
 			}
-		} catch (const std::system_error &se) {
-			if (se.code().value() == ESRCH) {
-				// tracee died during stop
-				// clean-up only when we see the exit notification
-				continue;
-			} else {
-				throw se;
-			}
-		}
+			loop(shard, context);
+		});
+		try {
+			started.get();
+		} catch (...) { error = std::current_exception(); }
 	}
+	try {
+		if (!error)
+			main_shard.pin();
+		if (!error && pool.shards.size() > 1)
+			main_shard.open_doorbell();
+	} catch (...) { error = std::current_exception(); }
+
+	// start tracing
+	if (error)
+		pool.fail(error);
+	else if (::ptrace(seccomp ? PTRACE_CONT : PTRACE_SYSCALL, child, nullptr, 0)
+			 < 0)
+		pool.fail(std::make_exception_ptr(
+			std::system_error(errno, std::system_category())));
+	else
+		loop(main_shard, context);
+	for (auto &worker : workers)
+		worker.join();
+	if (pool.error)
+		std::rethrow_exception(pool.error);
+	return pool.exit_code;
 }
 
 }  // namespace TracerDetails
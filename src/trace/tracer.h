@@ -1,13 +1,26 @@
 #ifndef TRACER_H_
 #define TRACER_H_
 
+#include "shard.h"
+#include <config/journal.h>
+#include <config/landlock.h>
+#include <exceptions.h>
+#include <parser/rendering.h>
+#include <probes.h>
 #include <type_traits.h>
 #include <utils.h>
 
+#include <array>
 #include <cassert>
-#include <functional>
+#include <iomanip>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace GravelBox {
@@ -16,19 +29,106 @@ namespace TracerDetails {
 
 /**
  * Non-template run.
- * Spawn and trace the child process and calls the callback when an syscall is
- * intercepted. Return after the child process exits.
+ * Spawn and trace the child process, and run the event loop of each tracer
+ * thread. Return after the child process exits.
+ *
+ * Tracees are sharded across `threads` tracer threads. Each tracer thread owns
+ * the ptrace relationships of its tracees, so the callbacks may be invoked
+ * concurrently from different threads, but never concurrently for the same
+ * tracee.
+ *
+ * If `seccomp_allow` is not empty, a seccomp filter is installed in the child
+ * before `exec`, allowing the listed x86-64 syscalls without stopping the
+ * tracee. Only the other syscalls are passed to the syscall callback.
+ *
+ * If `stops_once` is true, the seccomp filter is installed even if it allows
+ * nothing, so a syscall only stops at its seccomp stop, and not at its
+ * syscall-exit-stop unless it is followed there.
+ *
+ * If `reports_exits` is true, the exit callback is called when an allowed
+ * x86-64 syscall that closes or replaces fds, changes the working directory,
+ * or executes a program returns, and with `exit` when a tracee exits. These
+ * syscalls are then never allowed by the seccomp filter.
+ *
+ * If `fd_inherit` is not empty, the tracer keeps a table of the fds created by
+ * allowed syscalls. The listed x86-64 syscalls are allowed without calling
+ * the syscall callback if their first argument is an fd in the table. The
+ * syscalls that create fds are then never allowed by the seccomp filter.
+ *
+ * If `landlock_ruleset` is a Landlock ruleset fd, the child restricts itself
+ * with it before `exec`, and the seccomp filter allows the syscalls in
+ * `landlock_allow`, which the ruleset restricts instead of the tracer.
+ *
+ * If `low_latency` is enabled, the tracer threads, and optionally the
+ * tracees, are pinned to CPUs, and the tracer threads poll before blocking.
  *
  * @param args the arguments used to spawn the child process.
- * @param callback a callback function when an syscall is intercepted.
+ * @param reports_exits whether the exit callback is used.
+ * @param threads the number of tracer threads.
+ * @param stops_once whether to install the seccomp filter in any case.
+ * @param seccomp_allow x86-64 syscall numbers that are not traced.
+ * @param fd_inherit x86-64 syscall numbers allowed on fds in the table.
+ * @param landlock_ruleset the Landlock ruleset fd, or -1.
+ * @param landlock_allow x86-64 syscall numbers restricted by the ruleset,
+ * with the index of their open flags argument or -1. Opens with `O_PATH` are
+ * still traced.
+ * @param low_latency the low-latency mode.
+ * @param loop runs the event loop of a shard with `context`.
+ * @return child process exit code.
+ */
+int run_shards(const std::vector<std::string> &args, const std::string &std_in,
+			   const std::string &std_out, bool append_stdout,
+			   const std::string &std_err, bool append_stderr,
+			   bool reports_exits, size_t threads, bool stops_once,
+			   const std::vector<uint64_t> &seccomp_allow,
+			   const std::vector<uint64_t> &fd_inherit, int landlock_ruleset,
+			   const std::vector<std::pair<uint64_t, int>> &landlock_allow,
+			   const LowLatency &low_latency, void (*loop)(Shard &, void *),
+			   void *context);
+
+/**
+ * The callbacks of the event loop.
+ */
+template <typename OnSyscall, typename OnExit>
+struct Callbacks {
+	OnSyscall syscall;  // bool(pid_t, const Utils::SyscallArgs &)
+	OnExit exit;        // void(pid_t, const Utils::SyscallArgs &, int64_t)
+};
+
+template <typename OnSyscall, typename OnExit>
+Callbacks(OnSyscall, OnExit) -> Callbacks<OnSyscall, OnExit>;
+
+/**
+ * Spawn and trace the child process like `run_shards`, with the callbacks
+ * compiled into the event loop.
+ *
+ * @param callbacks has `syscall(pid, args)`, which returns whether to allow
+ * an intercepted syscall, and `exit(pid, args, rval)`, which is called when a
+ * syscall returns if `reports_exits`.
  * @return child process exit code.
  */
-int run_with_callbacks(
-	const std::vector<std::string> &args, const std::string &std_in,
-	const std::string &std_out, bool append_stdout,
-	const std::string &std_err, bool append_stderr,
-	const std::function<void(pid_t)> &pid_callback,
-	const std::function<bool(const Utils::SyscallArgs &)> &syscall_callback);
+template <typename Callbacks>
+int run_with_callbacks(const std::vector<std::string> &args,
+					   const std::string &std_in, const std::string &std_out,
+					   bool append_stdout, const std::string &std_err,
+					   bool append_stderr, Callbacks &callbacks,
+					   bool reports_exits, size_t threads, bool stops_once,
+					   const std::vector<uint64_t> &seccomp_allow,
+					   const std::vector<uint64_t> &fd_inherit,
+					   int landlock_ruleset,
+					   const std::vector<std::pair<uint64_t, int>>
+						   &landlock_allow,
+					   const LowLatency &low_latency) {
+	return run_shards(
+		args, std_in, std_out, append_stdout, std_err, append_stderr,
+		reports_exits, threads, stops_once, seccomp_allow, fd_inherit,
+		landlock_ruleset,
+		landlock_allow, low_latency,
+		[](Shard &shard, void *context) {
+			shard.serve(*static_cast<Callbacks *>(context));
+		},
+		&callbacks);
+}
 
 }  // namespace TracerDetails
 
@@ -46,62 +146,169 @@ class Tracer {
 	 * @param config the config object
 	 * @param ui the ui object.
 	 * @param logger the logger object
+	 * @param journal the journal of user decisions, which is consulted before
+	 * the config and records the answers to asked syscalls. Optional, and not
+	 * owned.
 	 */
 	Tracer(std::unique_ptr<Parser> parser, std::unique_ptr<Config> config,
-		   std::unique_ptr<UI> ui, std::unique_ptr<Logger> logger) noexcept
+		   std::unique_ptr<UI> ui, std::unique_ptr<Logger> logger,
+		   Journal *journal = nullptr) noexcept
 		: parser_(std::move(parser)), config_(std::move(config)),
-		  ui_(std::move(ui)), logger_(std::move(logger)) {}
+		  ui_(std::move(ui)), logger_(std::move(logger)), journal_(journal) {}
 
 	/**
 	 * Spawn and trace a child process.
 	 * Return after the child process exits.
 	 *
+	 * The parser and the config are shared by all tracer threads without
+	 * locking, while the logger, and the UI unless it is concurrent, are
+	 * serialized.
+	 *
 	 * @param args the arguments used to spawn the child process.
 	 * @param std_in the redirected path of stdin, or "-" if not redirected.
 	 * @param std_out the redirected path of stdout, or "-" if not redirected.
 	 * @param append_stdout whether the redirected stdout should be opened in APPEND mode.
 	 * @param std_err the redirected path of stderr, or "-" if not redirected.
 	 * @param append_stderr whether the redirected stderr should be opened in APPEND mode.
+	 * @param threads the number of tracer threads.
+	 * @param low_latency the low-latency mode, off by default.
 	 */
 	int run(const std::vector<std::string> &args, const std::string &std_in,
 			const std::string &std_out, bool append_stdout,
-			const std::string &std_err, bool append_stderr) const {
+			const std::string &std_err, bool append_stderr,
+			size_t threads = 1, const LowLatency &low_latency = {}) const {
+		std::vector<uint64_t> fd_inherit = fd_inherit_numbers();
+		// the ruleset is only applied if some syscall is left to it
+		std::vector<std::pair<uint64_t, int>> landlock_allow;
+		Utils::Fd landlock_ruleset;
+		if (const LandlockRuleset *landlock = config_->landlock()) {
+			for (const auto &syscall : landlock->syscalls())
+				if (auto number = parser_->number(syscall.name))
+					landlock_allow.emplace_back(*number, syscall.flags_arg);
+			if (LandlockRuleset::abi() == 0)
+				std::cerr << "Landlock is not available, all rules are "
+							 "enforced by tracing"
+						  << std::endl;
+			else if (!landlock_allow.empty())
+				landlock_ruleset = landlock->create();
+			else
+				std::cerr << "No rule can be enforced by Landlock, all rules "
+							 "are enforced by tracing"
+						  << std::endl;
+		}
+		std::mutex ui_mutex;
+		std::mutex logger_mutex;
+		TracerDetails::Callbacks callbacks{
+			[this, &ui_mutex, &logger_mutex](
+				pid_t pid, const Utils::SyscallArgs &args) -> bool {
+				// reused by each tracer thread, so rendering does not allocate
+				thread_local Rendering rendering;
+				uint64_t start = Probes::start(GRAVELBOX_PROBE_ENABLED(parse));
+				std::string_view syscall_str
+					= (*parser_)(pid, args, rendering);
+				if (start != 0)
+					GRAVELBOX_PROBE3(parse, pid, args.number,
+									 Probes::elapsed(start));
+				bool allowed = decide(pid, args, rendering, ui_mutex);
+				std::lock_guard<std::mutex> lock(logger_mutex);
+				logger_->write(pid, args, syscall_str, allowed);
+				return allowed;
+			},
+			[this](pid_t pid, const Utils::SyscallArgs &args, int64_t rval) {
+				parser_->exited(pid, args, rval);
+			}};
 		return TracerDetails::run_with_callbacks(
 			args, std_in, std_out, append_stdout, std_err, append_stderr,
-			[&parser = *parser_](pid_t child) { parser.setpid(child); },
-			[&parser = *parser_, &config = *config_, &ui = *ui_,
-			 &logger = *logger_](const Utils::SyscallArgs &args) -> bool {
-				auto syscall_str = parser(args);
-				logger.write(syscall_str);
-				switch (config.get_action(syscall_str)) {
-				case Config::Action::ALLOW:
-					return true;
-				case Config::Action::ASK: {
-					if (!ui.ask(syscall_str))
-						return false;
-					if (!config.has_password())
-						return true;
-					constexpr auto message
-						= "Enter the user decision password to continue.";
-					constexpr auto prompt = "password: ";
-					typename UI::Password password
-						= ui.ask_password(message, prompt, "");
-					if (!password)
-						return false;
-					while (!config.verify_password(password.password)) {
-						password = ui.ask_password(message, prompt,
-												   "Incorrect password");
-						if (!password)
-							return false;
-					}
-					return true;
-				}
-				case Config::Action::DENY:
-					return false;
-				}
-				assert(false);
-				return false;
-			});
+			callbacks, parser_->resolves_paths(), threads, false,
+			config_->seccomp_allow(), fd_inherit, landlock_ruleset,
+			landlock_allow, low_latency);
+	}
+
+	/**
+	 * Spawn and trace a child process in a dry run of the config, which
+	 * decides nothing. Return after the child process exits.
+	 *
+	 * Every syscall is evaluated by the config, and logged with the decision
+	 * it would have had, but allowed: the user is never asked, and the
+	 * journal is not used. Each syscall only stops once, at its seccomp stop,
+	 * and the registers of the tracees are never written. Landlock is not
+	 * applied. The fd-inherit syscalls, which depend on the files opened, are
+	 * allowed and counted apart from the rules.
+	 *
+	 * The config must tell the rule that decides a syscall (`rule`, `rules`,
+	 * `action` and `describe`, see `FileConfig`), and the parser should not
+	 * need `exited` calls, which would follow syscalls to their exit.
+	 *
+	 * @param summary written with the count of would-be actions per rule,
+	 * after the child process exits.
+	 * @see run for the other parameters.
+	 */
+	int dry_run(const std::vector<std::string> &args,
+				const std::string &std_in, const std::string &std_out,
+				bool append_stdout, const std::string &std_err,
+				bool append_stderr, std::ostream &summary,
+				size_t threads = 1, const LowLatency &low_latency = {}) const {
+		std::vector<uint64_t> numbers = fd_inherit_numbers();
+		std::unordered_set<uint64_t> fd_inherit(numbers.begin(),
+												numbers.end());
+		// the count of each action per rule, the default action, and the
+		// fd-inherit syscalls
+		size_t rules = config_->rules();
+		std::vector<std::array<uint64_t, 3>> counts(rules + 2);
+		std::mutex mutex;
+		TracerDetails::Callbacks callbacks{
+			[this, &fd_inherit, rules, &counts, &mutex](
+				pid_t pid, const Utils::SyscallArgs &args) -> bool {
+				thread_local Rendering rendering;
+				uint64_t start = Probes::start(GRAVELBOX_PROBE_ENABLED(parse));
+				std::string_view syscall_str
+					= (*parser_)(pid, args, rendering);
+				if (start != 0)
+					GRAVELBOX_PROBE3(parse, pid, args.number,
+									 Probes::elapsed(start));
+				start = Probes::start(GRAVELBOX_PROBE_ENABLED(config));
+				bool inherited
+					= !args.int80 && fd_inherit.count(args.number) > 0;
+				size_t rule = inherited ? rules + 1 : config_->rule(rendering);
+				typename Config::Action action
+					= inherited ? Config::Action::ALLOW : config_->action(rule);
+				if (start != 0)
+					GRAVELBOX_PROBE4(config, pid, args.number, action,
+									 Probes::elapsed(start));
+				std::lock_guard<std::mutex> lock(mutex);
+				counts[rule][static_cast<size_t>(action)]++;
+				logger_->write(pid, args, syscall_str,
+							   action == Config::Action::ALLOW);
+				return true;
+			},
+			[this](pid_t pid, const Utils::SyscallArgs &args, int64_t rval) {
+				parser_->exited(pid, args, rval);
+			}};
+		int exit_code = TracerDetails::run_with_callbacks(
+			args, std_in, std_out, append_stdout, std_err, append_stderr,
+			callbacks, parser_->resolves_paths(), threads, true,
+			config_->seccomp_allow(), {}, -1, {}, low_latency);
+
+		constexpr int kWidth = 12;
+		uint64_t total = 0;
+		for (const auto &count : counts)
+			for (uint64_t n : count)
+				total += n;
+		summary << "Dry run of " << total << " syscalls, would-be actions:\n"
+				<< std::setw(kWidth) << "allow" << std::setw(kWidth) << "deny"
+				<< std::setw(kWidth) << "ask"
+				<< "  rule\n";
+		for (size_t rule = 0; rule < counts.size(); rule++) {
+			if (rule == rules + 1 && fd_inherit.empty())
+				break;
+			for (uint64_t n : counts[rule])
+				summary << std::setw(kWidth) << n;
+			summary << "  "
+					<< (rule <= rules ? config_->describe(rule) : "fd-inherit")
+					<< '\n';
+		}
+		summary.flush();
+		return exit_code;
 	}
 
   private:
@@ -109,6 +316,137 @@ class Tracer {
 	std::unique_ptr<Config> config_;
 	std::unique_ptr<UI> ui_;
 	std::unique_ptr<Logger> logger_;
+	Journal *journal_;
+
+	/**
+	 * Return the x86-64 numbers of the fd-inherit syscalls of the config.
+	 *
+	 * @throw ConfigException if a syscall is not defined.
+	 */
+	std::vector<uint64_t> fd_inherit_numbers() const {
+		std::vector<uint64_t> fd_inherit;
+		for (const std::string &name : config_->fd_inherit()) {
+			auto number = parser_->number(name);
+			if (!number)
+				throw ConfigException(config_->syscalldef(),
+									  "syscall definition",
+									  "fd-inherit syscall \"" + name
+										  + "\" is not defined");
+			fd_inherit.push_back(*number);
+		}
+		return fd_inherit;
+	}
+
+	/**
+	 * Decide whether to allow a syscall, asking the user if needed.
+	 *
+	 * @param pid the tracee.
+	 * @param args the syscall, for the probes.
+	 * @param syscall the rendering of the syscall.
+	 * @param ui_mutex the mutex serializing UI interactions.
+	 * @return true if the syscall is allowed.
+	 */
+	bool decide(pid_t pid, const Utils::SyscallArgs &args,
+				const Rendering &syscall, std::mutex &ui_mutex) const {
+		if (journal_ != nullptr)
+			if (std::optional<bool> decision = journal_->decision(syscall.str()))
+				return *decision;
+		uint64_t start = Probes::start(GRAVELBOX_PROBE_ENABLED(config));
+		typename Config::Action action = config_->get_action(syscall);
+		if (start != 0)
+			GRAVELBOX_PROBE4(config, pid, args.number, action,
+							 Probes::elapsed(start));
+		switch (action) {
+		case Config::Action::ALLOW:
+			return true;
+		case Config::Action::ASK: {
+			std::optional<typename Config::AskTimeout> timeout
+				= config_->ask_timeout(syscall);
+			// a concurrent UI has its questions outstanding at once
+			std::unique_lock<std::mutex> lock(ui_mutex, std::defer_lock);
+			if (!IsConcurrentUI<UI>::value)
+				lock.lock();
+			std::string syscall_str(syscall.str());
+			// another thread may have asked the same while this one waited
+			if (journal_ != nullptr)
+				if (std::optional<bool> decision
+					= journal_->decision(syscall_str))
+					return *decision;
+			GRAVELBOX_PROBE2(ask_start, pid, args.number);
+			start = Probes::start(GRAVELBOX_PROBE_ENABLED(ask_done));
+			Answer answer = ask(syscall_str, timeout);
+			if (start != 0)
+				GRAVELBOX_PROBE4(ask_done, pid, args.number, answer,
+								 Probes::elapsed(start));
+			switch (answer) {
+			case Answer::ALLOW:
+			case Answer::DENY:
+				if (journal_ != nullptr)
+					journal_->record(syscall_str, answer == Answer::ALLOW);
+				return answer == Answer::ALLOW;
+			case Answer::CANCELLED:
+				return false;
+			case Answer::TIMEOUT: {
+				// not a decision of the user, so not recorded in the journal
+				bool allowed = timeout->action == Config::Action::ALLOW;
+				std::cerr << "No answer in " << timeout->timeout.count()
+						  << " ms, " << (allowed ? "allowed: " : "denied: ")
+						  << syscall_str << std::endl;
+				return allowed;
+			}
+			}
+			assert(false);
+			return false;
+		}
+		case Config::Action::DENY:
+			return false;
+		}
+		assert(false);
+		return false;
+	}
+
+	/**
+	 * The outcome of asking the user, with the values passed to the probes.
+	 */
+	enum class Answer { DENY = 0, ALLOW = 1, CANCELLED = -1, TIMEOUT = -2 };
+
+	/**
+	 * Ask the user whether to allow a syscall, and for the password if the
+	 * user allows it. The timeout only applies to the question, since a user
+	 * who allowed the syscall is there to enter the password.
+	 *
+	 * @param syscall the string representation of the syscall.
+	 * @param timeout how long to wait for the user, or nothing to wait
+	 * indefinitely.
+	 * @return Answer the answer, `CANCELLED` if the user cancelled the
+	 * password, or `TIMEOUT` if the user did not answer in time.
+	 */
+	Answer ask(const std::string &syscall,
+			   const std::optional<typename Config::AskTimeout> &timeout) const {
+		if (timeout) {
+			std::optional<bool> confirmed = ui_->ask(syscall, timeout->timeout);
+			if (!confirmed)
+				return Answer::TIMEOUT;
+			if (!*confirmed)
+				return Answer::DENY;
+		} else if (!ui_->ask(syscall)) {
+			return Answer::DENY;
+		}
+		if (!config_->has_password())
+			return Answer::ALLOW;
+		constexpr auto message
+			= "Enter the user decision password to continue.";
+		constexpr auto prompt = "password: ";
+		typename UI::Password password = ui_->ask_password(message, prompt, "");
+		if (!password)
+			return Answer::CANCELLED;
+		while (!config_->verify_password(password.password)) {
+			password = ui_->ask_password(message, prompt, "Incorrect password");
+			if (!password)
+				return Answer::CANCELLED;
+		}
+		return Answer::ALLOW;
+	}
 
 	static_assert(IsParser<Parser>::value, "Tracer must take in a Parser");
 	static_assert(IsConfig<Config>::value, "Tracer must take in a Config");
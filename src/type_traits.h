@@ -4,13 +4,19 @@
 // We use type traits to avoid C++20 concepts.
 // We can switch to concepts once C++20 is out.
 
+#include <parser/rendering.h>
 #include <utils.h>
 
 #include <sys/types.h>
 
+#include <chrono>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace GravelBox {
 
@@ -22,12 +28,24 @@ struct IsParser<
 	Parser,
 	std::void_t<
 		std::enable_if_t<
-			std::is_same<decltype(std::declval<Parser>()(
-							 std::declval<const Utils::SyscallArgs>())),
-						 std::string>::value>,
-		std::enable_if_t<std::is_same<decltype(std::declval<Parser>().setpid(
-										  std::declval<const pid_t>())),
-									  void>::value>>> : std::true_type {};
+			std::is_same<decltype(std::declval<const Parser>()(
+							 std::declval<const pid_t>(),
+							 std::declval<const Utils::SyscallArgs>(),
+							 std::declval<Rendering &>())),
+						 std::string_view>::value>,
+		std::enable_if_t<std::is_same<
+			decltype(std::declval<const Parser>().number(
+				std::declval<const std::string>())),
+			std::optional<uint64_t>>::value>,
+		std::enable_if_t<std::is_same<
+			decltype(std::declval<const Parser>().resolves_paths()),
+			bool>::value>,
+		std::enable_if_t<
+			std::is_same<decltype(std::declval<Parser>().exited(
+							 std::declval<const pid_t>(),
+							 std::declval<const Utils::SyscallArgs>(),
+							 std::declval<const int64_t>())),
+						 void>::value>>> : std::true_type {};
 
 template <typename T, typename = void>
 struct IsUI : std::false_type {};
@@ -47,6 +65,11 @@ struct IsUI<
 		std::enable_if_t<std::is_same<decltype(std::declval<UI>().ask(
 										  std::declval<const std::string>())),
 									  bool>::value>,
+		std::enable_if_t<std::is_same<
+			decltype(std::declval<UI>().ask(
+				std::declval<const std::string>(),
+				std::declval<const std::chrono::milliseconds>())),
+			std::optional<bool>>::value>,
 		std::enable_if_t<std::is_same<decltype(std::declval<UI>().ask_password(
 										  std::declval<const std::string>(),
 										  std::declval<const std::string>(),
@@ -54,6 +77,20 @@ struct IsUI<
 									  typename UI::Password>::value>>>
 	: std::true_type {};
 
+/**
+ * Whether a UI may be asked from several threads at once, which it declares
+ * with `static constexpr bool kConcurrent = true`. Other UIs are asked one
+ * question at a time.
+ */
+template <typename T, typename = void>
+struct IsConcurrentUI : std::false_type {};
+
+template <typename UI>
+struct IsConcurrentUI<UI, std::enable_if_t<UI::kConcurrent>>
+	: std::true_type {};
+
+class LandlockRuleset;
+
 template <typename T, typename = void>
 struct IsConfig : std::false_type {};
 
@@ -71,10 +108,23 @@ struct IsConfig<
 		std::enable_if_t<
 			std::is_same<decltype(std::declval<const Config>().max_str_len()),
 						 size_t>::value>,
+		std::enable_if_t<std::is_same<
+			decltype(std::declval<const Config>().seccomp_allow()),
+			const std::vector<uint64_t> &>::value>,
+		std::enable_if_t<std::is_same<
+			decltype(std::declval<const Config>().fd_inherit()),
+			const std::vector<std::string> &>::value>,
+		std::enable_if_t<
+			std::is_same<decltype(std::declval<const Config>().landlock()),
+						 const LandlockRuleset *>::value>,
 		std::enable_if_t<
 			std::is_same<decltype(std::declval<const Config>().get_action(
-							 std::declval<const std::string>())),
+							 std::declval<const Rendering>())),
 						 typename Config::Action>::value>,
+		std::enable_if_t<
+			std::is_same<decltype(std::declval<const Config>().ask_timeout(
+							 std::declval<const Rendering>())),
+						 std::optional<typename Config::AskTimeout>>::value>,
 		std::enable_if_t<
 			std::is_same<decltype(std::declval<const Config>().has_password()),
 						 bool>::value>,
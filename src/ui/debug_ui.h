@@ -3,7 +3,9 @@
 
 #include <type_traits.h>
 
+#include <chrono>
 #include <iostream>
+#include <optional>
 #include <string>
 
 namespace GravelBox {
@@ -24,6 +26,17 @@ class DebugUI {
 		return true;
 	}
 
+	/**
+	 * Display the syscall on stderr, and return true without waiting.
+	 *
+	 * @param syscall the human readable string for the syscall.
+	 * @return always true.
+	 */
+	std::optional<bool> ask(const std::string &syscall,
+							std::chrono::milliseconds) const noexcept {
+		return ask(syscall);
+	}
+
 	/**
 	 * Password struct. Always empty.
 	 */
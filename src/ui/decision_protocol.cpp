@@ -0,0 +1,88 @@
+#include "decision_protocol.h"
+#include <utils.h>
+
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace GravelBox {
+namespace DecisionService {
+
+using Utils::check;
+
+constexpr uint32_t kMaxMessageSize = 1 << 20;
+// the id and the type
+constexpr uint32_t kFixedSize = sizeof(uint32_t) + sizeof(Type);
+
+[[noreturn]] static void protocol_error(const char *what) {
+	throw std::system_error(EPROTO, std::system_category(), what);
+}
+
+/**
+ * Receive exactly `size` bytes.
+ *
+ * @return false if the connection was closed before the first byte.
+ */
+static bool recv_all(int sock, void *data, size_t size) {
+	auto p = static_cast<char *>(data);
+	size_t left = size;
+	while (left > 0) {
+		ssize_t received = ::recv(sock, p, left, 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (check(received) == 0) {
+			if (left == size)
+				return false;
+			protocol_error("Connection closed");
+		}
+		p += received;
+		left -= received;
+	}
+	return true;
+}
+
+void send(int sock, const Message &message) {
+	if (message.payload.size() > kMaxMessageSize - kFixedSize)
+		protocol_error("Message too large");
+	uint32_t size = kFixedSize + message.payload.size();
+	std::string frame;
+	frame.reserve(sizeof(size) + size);
+	frame.append(reinterpret_cast<const char *>(&size), sizeof(size));
+	frame.append(reinterpret_cast<const char *>(&message.id),
+				 sizeof(message.id));
+	frame.push_back(static_cast<char>(message.type));
+	frame.append(message.payload);
+	const char *p = frame.data();
+	size_t left = frame.size();
+	while (left > 0) {
+		ssize_t sent = ::send(sock, p, left, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		check(sent);
+		p += sent;
+		left -= sent;
+	}
+}
+
+std::optional<Message> recv(int sock) {
+	uint32_t size;
+	if (!recv_all(sock, &size, sizeof(size)))
+		return std::nullopt;
+	if (size < kFixedSize)
+		protocol_error("Truncated message");
+	if (size > kMaxMessageSize)
+		protocol_error("Message too large");
+	std::string frame(size, '\0');
+	if (!recv_all(sock, frame.data(), frame.size()))
+		protocol_error("Connection closed");
+	Message message;
+	std::memcpy(&message.id, frame.data(), sizeof(message.id));
+	message.type = static_cast<Type>(frame[sizeof(message.id)]);
+	message.payload = frame.substr(kFixedSize);
+	return message;
+}
+
+}  // namespace DecisionService
+}  // namespace GravelBox
@@ -0,0 +1,77 @@
+#ifndef DECISION_PROTOCOL_H_
+#define DECISION_PROTOCOL_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace GravelBox {
+
+/**
+ * The protocol between GravelBox and a decision service, which answers the
+ * questions of "ask" rules in place of a user.
+ *
+ * GravelBox connects to the service over a Unix stream socket. Every message
+ * is a frame: its size (not counting the size itself), the request id, the
+ * type, and a payload. Integers are 32-bit little-endian. Requests may be
+ * pipelined: GravelBox sends a request as soon as a tracer thread asks, and
+ * the service may answer requests in any order, matched by id.
+ *
+ * - `ASK`: the timeout in milliseconds (0 for none), then the syscall.
+ *   Answered by a `REPLY` of 1 to allow or 0 to deny.
+ * - `PASSWORD`: the message, the prompt and the error, each terminated by a
+ *   NUL. Answered by a `REPLY` of 1 followed by the password, or of 0 to
+ *   cancel.
+ * - `CANCEL`: no payload. GravelBox stopped waiting for the request with the
+ *   same id, which needs no reply.
+ */
+namespace DecisionService {
+
+/**
+ * The type of a message.
+ */
+enum class Type : uint8_t { ASK = 1, PASSWORD = 2, CANCEL = 3, REPLY = 4 };
+
+/**
+ * A message.
+ */
+struct Message {
+	/**
+	 * The id of the request, or of the request it answers.
+	 */
+	uint32_t id;
+
+	/**
+	 * The type.
+	 */
+	Type type;
+
+	/**
+	 * The payload, in the format of the type.
+	 */
+	std::string payload;
+};
+
+/**
+ * Send a message.
+ *
+ * @param sock the connected socket.
+ * @param message the message.
+ * @throw std::system_error if the message cannot be sent.
+ */
+void send(int sock, const Message &message);
+
+/**
+ * Receive a message.
+ *
+ * @param sock the connected socket.
+ * @return std::optional<Message> the message, or nothing if the connection
+ * was closed between messages.
+ * @throw std::system_error if the message is malformed or cannot be received.
+ */
+std::optional<Message> recv(int sock);
+
+}  // namespace DecisionService
+}  // namespace GravelBox
+
+#endif  // DECISION_PROTOCOL_H_
@@ -1,6 +1,13 @@
 #include "pinentry_conn.h"
 #include <exceptions.h>
+#include <utils.h>
 
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
 #include <sstream>
 
 namespace GravelBox {
@@ -20,6 +27,39 @@ void PinentryConn::open(Utils::Fd pipe_in, Utils::Fd pipe_out) {
 	ok();
 }
 
+void PinentryConn::abort() noexcept {
+	try {
+		odev_.close();
+	} catch (const std::exception &) {}
+	try {
+		idev_.close();
+	} catch (const std::exception &) {}
+	os_.clear();
+	is_.clear();
+}
+
+bool PinentryConn::readable(std::chrono::milliseconds timeout) {
+	// pinentry only writes in response to a request, so nothing is buffered
+	// unless it was read with an earlier response
+	if (is_.rdbuf()->in_avail() > 0)
+		return true;
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point deadline = Clock::now() + timeout;
+	::pollfd pfd = {idev_.handle(), POLLIN, 0};
+	while (true) {
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(
+			deadline - Clock::now());
+		int r = ::poll(&pfd, 1,
+					   std::clamp<int64_t>(left.count(), 0, INT_MAX));
+		if (r > 0)
+			return true;
+		if (r == 0 && Clock::now() >= deadline)
+			return false;
+		if (r < 0 && errno != EINTR)
+			Utils::throw_system_error();
+	}
+}
+
 PinentryConn::Response PinentryConn::recv() {
 	std::string data;
 	while (true) {
@@ -4,6 +4,8 @@
 #include <exceptions.h>
 #include <utils.h>
 
+#include <chrono>
+#include <optional>
 #include <sstream>
 
 #include <boost/iostreams/device/file_descriptor.hpp>
@@ -61,21 +63,34 @@ class PinentryConn {
 	 * @return false if the user cancels the operation.
 	 */
 	bool confirm(const std::string &message) {
-		os_ << "SETDESC " << message << std::endl;
-		ok();
-		os_ << "SETOK Allow" << std::endl;
-		ok();
-		os_ << "SETCANCEL Deny" << std::endl;
-		ok();
-		os_ << "CONFIRM" << std::endl;
-		Response r = recv();
-		if (r)
-			return true;
-		if (r.code == kCancel)
-			return false;
-		r.throw_error();
+		send_confirm(message);
+		return confirmed();
 	}
 
+	/**
+	 * Confirm with a message, giving up if the user does not answer in time.
+	 * The connection must then be aborted, since pinentry still shows the
+	 * dialog.
+	 *
+	 * @param message message to display.
+	 * @param timeout how long to wait for the user.
+	 * @return std::optional<bool> whether the user confirms, or nothing if the
+	 * user did not answer in time.
+	 */
+	std::optional<bool> confirm(const std::string &message,
+								std::chrono::milliseconds timeout) {
+		send_confirm(message);
+		if (!readable(timeout))
+			return std::nullopt;
+		return confirmed();
+	}
+
+	/**
+	 * Close the pipes without waiting for pinentry, e.g. after a timeout. The
+	 * connection can then be opened again.
+	 */
+	void abort() noexcept;
+
 	/**
 	 * Result of `getpin` pinentry command.
 	 */
@@ -159,6 +174,45 @@ class PinentryConn {
 	 */
 	Response recv();
 
+	/**
+	 * Send a confirmation request.
+	 *
+	 * @param message message to display.
+	 */
+	void send_confirm(const std::string &message) {
+		os_ << "SETDESC " << message << std::endl;
+		ok();
+		os_ << "SETOK Allow" << std::endl;
+		ok();
+		os_ << "SETCANCEL Deny" << std::endl;
+		ok();
+		os_ << "CONFIRM" << std::endl;
+	}
+
+	/**
+	 * Receive the answer to a confirmation request.
+	 *
+	 * @return true if the user confirms.
+	 * @return false if the user cancels the operation.
+	 */
+	bool confirmed() {
+		Response r = recv();
+		if (r)
+			return true;
+		if (r.code == kCancel)
+			return false;
+		r.throw_error();
+	}
+
+	/**
+	 * Wait until a response can be received.
+	 *
+	 * @param timeout how long to wait.
+	 * @return true if a response can be received.
+	 * @return false if the timeout expired.
+	 */
+	bool readable(std::chrono::milliseconds timeout);
+
 	/**
 	 * Assert that operation is successful.
 	 * Throw `PinentryException` if there is any error.
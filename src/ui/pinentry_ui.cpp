@@ -2,29 +2,36 @@
 #include <utils.h>
 
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <cerrno>
+#include <chrono>
+#include <future>
+#include <optional>
 #include <string>
+#include <thread>
 
 namespace GravelBox {
 
 using Utils::check;
 
-PinentryUI::PinentryUI(const std::string &pinentry) : pid_self_(::getpid()) {
-	// set up pipes
+void PinentryUI::launch() {
+	// set up pipes, which the target must not inherit if it is spawned
+	// concurrently
 	int fds[4];
 	check(::pipe2(fds + 0, O_CLOEXEC));
 	Utils::Fd to_pinentry_r(fds[0]);
 	Utils::Fd to_pinentry_w(fds[1]);
-	check(::pipe(fds + 2));
+	check(::pipe2(fds + 2, O_CLOEXEC));
 	Utils::Fd from_pinentry_r(fds[2]);
 	Utils::Fd from_pinentry_w(fds[3]);
 	const char *ttyname = ::ttyname(0);
 	if (ttyname == nullptr)
 		Utils::throw_system_error();
 	pid_pinentry_ = Utils::spawn(
-		{pinentry, "--ttyname", ttyname, "--lc-ctype", "utf-8"}, [&fds]() {
+		{pinentry_, "--ttyname", ttyname, "--lc-ctype", "utf-8"}, [&fds]() {
 			check(::dup2(fds[0], 0));
 			check(::dup2(fds[3], 1));
 			for (int fd : fds)
@@ -35,21 +42,76 @@ PinentryUI::PinentryUI(const std::string &pinentry) : pid_self_(::getpid()) {
 	conn_.open(std::move(from_pinentry_r), std::move(to_pinentry_w));
 }
 
+void PinentryUI::prewarm() {
+	if (!launched_.valid())
+		launched_ = std::async(std::launch::async, [this]() { launch(); });
+}
+
+PinentryConn &PinentryUI::conn() {
+	// launched on its own thread, so pinentry is never the child of a tracer
+	// thread waiting for any of its children
+	prewarm();
+	launched_.get();
+	return conn_;
+}
+
+void PinentryUI::abandon() noexcept {
+	conn_.abort();
+	::kill(pid_pinentry_, SIGTERM);
+	// give pinentry a second to restore the terminal
+	bool reaped = false;
+	for (int i = 0; i < 100 && !reaped; i++) {
+		pid_t pid = ::waitpid(pid_pinentry_, nullptr, WNOHANG);
+		// ECHILD if a tracer thread has reaped it
+		reaped = pid > 0 || (pid < 0 && errno != EINTR);
+		if (!reaped)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	if (!reaped) {
+		::kill(pid_pinentry_, SIGKILL);
+		while (::waitpid(pid_pinentry_, nullptr, 0) < 0 && errno == EINTR)
+			continue;
+	}
+	pid_pinentry_ = -1;
+	launched_ = std::shared_future<void>();
+}
+
 PinentryUI::~PinentryUI() {
 	if (::getpid() != pid_self_) {
 		// forked instance, do not destruct
 		return;
 	}
+	if (!launched_.valid())
+		return;
+	try {
+		launched_.get();
+	} catch (...) {
+		// pinentry failed to launch, and the error has been thrown
+		return;
+	}
 	conn_.close();
 	int wstatus;
 	check(::waitpid(pid_pinentry_, &wstatus, 0));
 	assert(WIFEXITED(wstatus));
 }
 
+/**
+ * Return the description of the dialog asking for a syscall.
+ */
+static std::string ask_message(const std::string &syscall) {
+	return "Do you allow the following system call?%0a%0a" + syscall;
+}
+
 bool PinentryUI::ask(const std::string &syscall) {
-	std::string message
-		= "Do you allow the following system call?%0a%0a" + syscall;
-	return conn_.confirm(message);
+	return conn().confirm(ask_message(syscall));
+}
+
+std::optional<bool> PinentryUI::ask(const std::string &syscall,
+									std::chrono::milliseconds timeout) {
+	std::optional<bool> answer = conn().confirm(ask_message(syscall), timeout);
+	if (!answer)
+		abandon();
+	return answer;
 }
 
 }  // namespace GravelBox
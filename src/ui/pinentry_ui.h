@@ -8,6 +8,9 @@
 
 #include <sys/types.h>
 
+#include <chrono>
+#include <future>
+#include <optional>
 #include <string>
 #include <boost/iostreams/device/file_descriptor.hpp>
 #include <boost/iostreams/stream.hpp>
@@ -27,17 +30,28 @@ class PinentryUI {
 	using Password = PinentryConn::Password;
 
 	/**
-	 * Construct a PinentryUI object and launch pinentry process.
+	 * Construct a PinentryUI object. The pinentry process is launched on the
+	 * first interaction, or in the background by `prewarm`, so a run that
+	 * never asks the user never launches it.
 	 *
 	 * @param pinentry the pinentry program name.
 	 */
-	explicit PinentryUI(const std::string &pinentry);
+	explicit PinentryUI(const std::string &pinentry)
+		: pid_self_(::getpid()), pinentry_(pinentry) {}
 
 	/**
-	 * Destroy the PinentryUI object and join the pinentry process.
+	 * Destroy the PinentryUI object and join the pinentry process, if it was
+	 * launched.
 	 */
 	~PinentryUI();
 
+	/**
+	 * Launch the pinentry process on a background thread, so the first
+	 * interaction does not wait for it. Errors are thrown by the first
+	 * interaction.
+	 */
+	void prewarm();
+
 	PinentryUI(const PinentryUI &) = delete;
 	PinentryUI &operator=(const PinentryUI &) = delete;
 
@@ -50,6 +64,19 @@ class PinentryUI {
 	 */
 	bool ask(const std::string &syscall);
 
+	/**
+	 * Ask the user for permission via pinentry, giving up after a timeout.
+	 * An unanswered pinentry is terminated, and launched again on the next
+	 * interaction.
+	 *
+	 * @param syscall human-readable string representation of the syscall.
+	 * @param timeout how long to wait for the user.
+	 * @return std::optional<bool> whether the user accepts the syscall, or
+	 * nothing if the user did not answer in time.
+	 */
+	std::optional<bool> ask(const std::string &syscall,
+							std::chrono::milliseconds timeout);
+
 	/**
 	 * Ask the user for a password.
 	 *
@@ -60,13 +87,20 @@ class PinentryUI {
 	 */
 	Password ask_password(const std::string &message, const std::string &prompt,
 						  const std::string &error) {
-		return conn_.getpin(message, prompt, error);
+		return conn().getpin(message, prompt, error);
 	}
 
   private:
 	const pid_t pid_self_;
-	pid_t pid_pinentry_;
+	const std::string pinentry_;
+	pid_t pid_pinentry_ = -1;
 	PinentryConn conn_;
+	// ready once pinentry is launched, invalid before the first use
+	std::shared_future<void> launched_;
+
+	void launch();
+	PinentryConn &conn();
+	void abandon() noexcept;
 };
 
 static_assert(IsUI<PinentryUI>::value,
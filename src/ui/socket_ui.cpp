@@ -0,0 +1,132 @@
+#include "socket_ui.h"
+#include <exceptions.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <system_error>
+
+namespace GravelBox {
+
+using Utils::check;
+using DecisionService::Message;
+using DecisionService::Type;
+
+SocketUI::SocketUI(const std::string &socket_path)
+	: sock_(check(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0))) {
+	::sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path))
+		throw std::system_error(ENAMETOOLONG, std::system_category(),
+								"Socket path too long");
+	std::strcpy(addr.sun_path, socket_path.c_str());
+	if (::connect(sock_, reinterpret_cast<::sockaddr *>(&addr), sizeof(addr))
+		< 0)
+		throw std::system_error(errno, std::system_category(),
+								"Cannot connect to the decision service \""
+									+ socket_path + '"');
+	receiver_ = std::thread([this]() { receive(); });
+}
+
+SocketUI::~SocketUI() {
+	// the receiver sees the end of the connection
+	::shutdown(sock_, SHUT_RDWR);
+	receiver_.join();
+}
+
+SocketUI::Password SocketUI::ask_password(const std::string &message,
+										  const std::string &prompt,
+										  const std::string &error) {
+	std::string payload;
+	for (const std::string *field : {&message, &prompt, &error})
+		payload.append(field->c_str(), field->size() + 1);
+	Reply reply = request(Type::PASSWORD, payload, std::nullopt);
+	if (!*reply.answer)
+		return {true, ""};
+	return {false, std::move(reply.data)};
+}
+
+std::string SocketUI::encode_ask(const std::string &syscall,
+								 uint64_t timeout_ms) {
+	uint32_t timeout = std::min<uint64_t>(timeout_ms, UINT32_MAX);
+	std::string payload(reinterpret_cast<const char *>(&timeout),
+						sizeof(timeout));
+	payload.append(syscall);
+	return payload;
+}
+
+SocketUI::Reply SocketUI::request(
+	Type type, const std::string &payload,
+	std::optional<std::chrono::milliseconds> timeout) {
+	uint32_t id;
+	std::future<Reply> reply;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!error_.empty())
+			throw DecisionServiceException(error_);
+		id = next_id_++;
+		reply = pending_[id].get_future();
+	}
+	try {
+		std::lock_guard<std::mutex> lock(send_mutex_);
+		DecisionService::send(sock_, {id, type, payload});
+	} catch (const std::system_error &e) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.erase(id);
+		throw DecisionServiceException(e.what());
+	}
+	if (timeout && reply.wait_for(*timeout) == std::future_status::timeout) {
+		bool withdrawn;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			// unless the reply came in the meantime
+			withdrawn = pending_.erase(id) > 0;
+		}
+		if (withdrawn) {
+			try {
+				std::lock_guard<std::mutex> lock(send_mutex_);
+				DecisionService::send(sock_, {id, Type::CANCEL, ""});
+			} catch (const std::system_error &) {
+				// the receiver sees the connection lost
+			}
+			return {};
+		}
+	}
+	return reply.get();
+}
+
+void SocketUI::receive() noexcept {
+	try {
+		while (std::optional<Message> message = DecisionService::recv(sock_)) {
+			if (message->type != Type::REPLY || message->payload.empty())
+				throw std::system_error(EPROTO, std::system_category(),
+										"Unexpected message");
+			std::lock_guard<std::mutex> lock(mutex_);
+			// a withdrawn request has no promise
+			auto it = pending_.find(message->id);
+			if (it == pending_.end())
+				continue;
+			it->second.set_value(
+				{message->payload[0] != 0, message->payload.substr(1)});
+			pending_.erase(it);
+		}
+		lost("Connection closed by the decision service");
+	} catch (const std::exception &e) { lost(e.what()); }
+}
+
+void SocketUI::lost(const std::string &error) noexcept {
+	std::lock_guard<std::mutex> lock(mutex_);
+	error_ = error;
+	for (auto &[id, promise] : pending_)
+		promise.set_exception(
+			std::make_exception_ptr(DecisionServiceException(error)));
+	pending_.clear();
+}
+
+}  // namespace GravelBox
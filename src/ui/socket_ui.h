@@ -0,0 +1,150 @@
+#ifndef SOCKET_UI_H_
+#define SOCKET_UI_H_
+
+#include "decision_protocol.h"
+#include <type_traits.h>
+#include <utils.h>
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace GravelBox {
+
+/**
+ * A headless UI, which asks a local decision service over a Unix socket, see
+ * `DecisionService` for the protocol.
+ *
+ * Unlike pinentry, the service needs no terminal and can answer several
+ * questions at once, so the tracer threads ask concurrently, and their
+ * requests are pipelined on the connection. A background thread receives the
+ * replies and wakes the thread waiting for each. A request whose timeout
+ * expires is withdrawn with `CANCEL`, and its late reply is dropped.
+ */
+class SocketUI {
+  public:
+	/**
+	 * The UI may be asked from several threads at once.
+	 */
+	static constexpr bool kConcurrent = true;
+
+	/**
+	 * The password returned by the service.
+	 */
+	struct Password {
+		/**
+		 * Whether the service cancelled the interaction.
+		 */
+		bool cancelled;
+
+		/**
+		 * The password, if not cancelled.
+		 */
+		std::string password;
+
+		/**
+		 * Return whether the service returned a password.
+		 */
+		operator bool() const noexcept { return !cancelled; }
+	};
+
+	/**
+	 * Connect to a decision service.
+	 *
+	 * @param socket_path the path of the socket of the service.
+	 * @throw std::system_error if the service cannot be reached.
+	 */
+	explicit SocketUI(const std::string &socket_path);
+
+	/**
+	 * Disconnect from the service. Threads still waiting for a reply get a
+	 * `DecisionServiceException`.
+	 */
+	~SocketUI();
+
+	SocketUI(const SocketUI &) = delete;
+	SocketUI &operator=(const SocketUI &) = delete;
+
+	/**
+	 * Ask the service whether to allow a syscall.
+	 *
+	 * @param syscall human-readable string representation of the syscall.
+	 * @return true if the service allows the syscall.
+	 * @throw DecisionServiceException if the connection is lost.
+	 */
+	bool ask(const std::string &syscall) {
+		return *request(DecisionService::Type::ASK, encode_ask(syscall, 0),
+						std::nullopt)
+					.answer;
+	}
+
+	/**
+	 * Ask the service whether to allow a syscall, giving up after a timeout.
+	 * The timeout is also sent to the service.
+	 *
+	 * @param syscall human-readable string representation of the syscall.
+	 * @param timeout how long to wait for the service.
+	 * @return std::optional<bool> whether the service allows the syscall, or
+	 * nothing if it did not answer in time.
+	 * @throw DecisionServiceException if the connection is lost.
+	 */
+	std::optional<bool> ask(const std::string &syscall,
+							std::chrono::milliseconds timeout) {
+		return request(DecisionService::Type::ASK,
+					   encode_ask(syscall, timeout.count()), timeout)
+			.answer;
+	}
+
+	/**
+	 * Ask the service for a password.
+	 *
+	 * @param message descriptive message of the password.
+	 * @param prompt prompt of the password.
+	 * @param error error message, or empty for no error.
+	 * @return Password the password, or cancelled.
+	 * @throw DecisionServiceException if the connection is lost.
+	 */
+	Password ask_password(const std::string &message, const std::string &prompt,
+						  const std::string &error);
+
+  private:
+	/**
+	 * A reply: the answer, and the rest of the payload.
+	 */
+	struct Reply {
+		std::optional<bool> answer;
+		std::string data;
+	};
+
+	Utils::Fd sock_;
+	std::thread receiver_;
+	// serializes sending, apart from `mutex_` so replies are received while
+	// a request is sent
+	std::mutex send_mutex_;
+	// guards the members below
+	std::mutex mutex_;
+	uint32_t next_id_ = 0;
+	std::unordered_map<uint32_t, std::promise<Reply>> pending_;
+	// why the connection was lost, or empty while connected
+	std::string error_;
+
+	static std::string encode_ask(const std::string &syscall,
+								  uint64_t timeout_ms);
+	Reply request(DecisionService::Type type, const std::string &payload,
+				  std::optional<std::chrono::milliseconds> timeout);
+	void receive() noexcept;
+	void lost(const std::string &error) noexcept;
+};
+
+static_assert(IsUI<SocketUI>::value, "SocketUI does not fulfill UI concept");
+static_assert(IsConcurrentUI<SocketUI>::value,
+			  "SocketUI does not ask concurrently");
+
+}  // namespace GravelBox
+
+#endif  // SOCKET_UI_H_
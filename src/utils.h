@@ -1,6 +1,7 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <array>
@@ -9,6 +10,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <system_error>
 #include <vector>
 
@@ -131,6 +133,8 @@ class Fd {
 	 */
 	Fd &operator=(Fd &&fd) noexcept {
 		if (this != std::addressof(fd)) {
+			if (fd_ >= 0)
+				::close(fd_);
 			fd_ = fd.fd_;
 			fd.fd_ = -1;
 		}
@@ -174,6 +178,42 @@ class Fd {
 	int fd_ = -1;
 };
 
+/**
+ * Escape a string so that it matches itself as a regular expression.
+ *
+ * @param s the literal string.
+ * @return std::string the regular expression.
+ */
+inline std::string escape_regex(const std::string &s) {
+	std::string escaped;
+	escaped.reserve(s.size() * 2);
+	for (char c : s) {
+		if (std::string_view("\\^$.|?*+()[]{}").find(c)
+			!= std::string_view::npos)
+			escaped.push_back('\\');
+		escaped.push_back(c);
+	}
+	return escaped;
+}
+
+/**
+ * Open a file for I/O redirection of the target.
+ * Output files are created if they do not exist.
+ *
+ * @param path the path of the file.
+ * @param output whether the file is opened for writing instead of reading.
+ * @param append whether an output file is opened in APPEND mode.
+ * @return Fd the opened file.
+ * @throw system_error if the file cannot be opened.
+ */
+inline Fd open_redirection(const std::string &path, bool output, bool append) {
+	if (!output)
+		return Fd(check(::open(path.c_str(), O_RDONLY)));
+	return Fd(check(::open(
+		path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : 0),
+		S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)));
+}
+
 }  // namespace Utils
 }  // namespace GravelBox
 